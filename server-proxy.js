@@ -38,11 +38,17 @@ function sendToCppServer(command) {
     let responseData = '';
 
     client.connect(CPP_SERVER_PORT, CPP_SERVER_HOST, () => {
-      client.write(command);
+      // Commands and responses are newline-delimited
+      client.write(command + '\n');
     });
 
     client.on('data', (data) => {
       responseData += data.toString();
+      const newline = responseData.indexOf('\n');
+      if (newline !== -1) {
+        responseData = responseData.slice(0, newline);
+        client.end();
+      }
     });
 
     client.on('end', () => {
@@ -0,0 +1,261 @@
+#include "ai_personality.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// The aiPersonalities.js table in the personality file format
+const char* const BUILTIN_PERSONALITIES = R"(
+EMBER  name=Ember  difficulty=Easy   aggressiveness=0.8 conservativeness=0.2 counterPriority=0.4 preferred=FIRE,EARTH,POWER
+FROST  name=Frost  difficulty=Medium aggressiveness=0.3 conservativeness=0.7 counterPriority=0.7 preferred=ICE,WATER,NEUTRAL
+AQUA   name=Aqua   difficulty=Medium aggressiveness=0.5 conservativeness=0.5 counterPriority=0.6 preferred=WATER,ICE,NEUTRAL flags=adaptive
+VOLT   name=Volt   difficulty=Hard   aggressiveness=0.7 conservativeness=0.4 counterPriority=0.8 preferred=ELECTRICITY,LIGHT,POWER flags=comboFocus
+TERRA  name=Terra  difficulty=Hard   aggressiveness=0.4 conservativeness=0.8 counterPriority=0.9 preferred=EARTH,FIRE,DARK flags=defensive
+LUMINA name=Lumina difficulty=Expert aggressiveness=0.6 conservativeness=0.6 counterPriority=0.8 preferred=LIGHT,POWER,ELECTRICITY flags=perfectPlay
+SHADOW name=Shadow difficulty=Expert aggressiveness=0.5 conservativeness=0.7 counterPriority=0.9 preferred=DARK,POWER,NEUTRAL flags=exploitative,unpredictable
+NEXUS  name=Nexus  difficulty=Master aggressiveness=0.7 conservativeness=0.7 counterPriority=1.0 preferred=POWER,LEGENDARY flags=perfectPlay,adaptive,comboFocus,exploitative
+CHAOS  name=Chaos  difficulty=Master aggressiveness=0.5 conservativeness=0.5 counterPriority=0.5 preferred=NEUTRAL,random flags=random,unpredictable
+)";
+
+// Bit per element that each element counters (elementCounters in the JS)
+constexpr uint8_t bit(Element element) {
+    return static_cast<uint8_t>(1u << static_cast<unsigned>(element));
+}
+
+constexpr uint8_t COUNTERS[AiPersonality::ELEMENT_COUNT] = {
+    bit(Element::ICE) | bit(Element::WATER),           // FIRE
+    bit(Element::ELECTRICITY) | bit(Element::FIRE),    // ICE
+    bit(Element::EARTH) | bit(Element::ELECTRICITY),   // WATER
+    bit(Element::EARTH) | bit(Element::WATER),         // ELECTRICITY
+    bit(Element::FIRE) | bit(Element::ICE),            // EARTH
+    0                                                  // POWER
+};
+
+const uint32_t CHANCE_SCALE = uint32_t(1) << 24;
+
+uint32_t chanceThreshold(double probability) {
+    return static_cast<uint32_t>(std::clamp(probability, 0.0, 1.0) * CHANCE_SCALE);
+}
+
+// Splits "a,b,c"
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+bool parseNumber(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && end == text.c_str() + text.size() && std::isfinite(value) && value >= 0;
+}
+
+// Parses one non-empty line into spec; false with a reason
+bool parseSpec(const std::string& line, PersonalitySpec& spec, std::string& reason) {
+    std::stringstream tokens(line);
+    tokens >> spec.key;
+    spec.name = spec.key;
+    std::string field;
+    while (tokens >> field) {
+        size_t equals = field.find('=');
+        if (equals == std::string::npos) {
+            reason = "expected field=value, got " + field;
+            return false;
+        }
+        std::string name = field.substr(0, equals);
+        std::string value = field.substr(equals + 1);
+        if (name == "name") {
+            spec.name = value;
+        } else if (name == "difficulty") {
+            spec.difficulty = value;
+        } else if (name == "aggressiveness" || name == "conservativeness" || name == "counterPriority") {
+            double number;
+            if (!parseNumber(value, number)) {
+                reason = "bad number for " + name;
+                return false;
+            }
+            (name == "aggressiveness" ? spec.aggressiveness
+             : name == "conservativeness" ? spec.conservativeness : spec.counterPriority) = number;
+        } else if (name == "preferred") {
+            for (const auto& element : splitList(value)) {
+                for (int e = 0; e < AiPersonality::ELEMENT_COUNT; e++) {
+                    if (ELEMENT_NAMES[e] == element) spec.preferredElements |= uint8_t(1) << e;
+                }
+            }
+        } else if (name == "flags") {
+            for (const auto& flag : splitList(value)) {
+                if (flag == "random") spec.random = true;
+                else if (flag == "perfectPlay") spec.perfectPlay = true;
+                else if (flag == "comboFocus") spec.comboFocus = true;
+                else if (flag == "exploitative") spec.exploitative = true;
+                else if (flag == "defensive") spec.defensive = true;
+            }
+        } else {
+            reason = "unknown field " + name;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+PersonalityContext makePersonalityContext(const GameRoom& room, const Player& player) {
+    PersonalityContext context;
+    for (const auto& other : room.getPlayers()) {
+        if (other == &player) {
+            continue;
+        }
+        if (const Card* chosen = other->getChosenCard()) {
+            context.opponentElement = static_cast<int>(chosen->getElement());
+        }
+        context.margin = player.getScore() - other->getScore();
+    }
+    if (const Card* last = player.getLastChosenCard()) {
+        context.lastElement = static_cast<int>(last->getElement());
+    }
+    return context;
+}
+
+AiPersonality::AiPersonality(const PersonalitySpec& personality) : spec(personality) {
+    const float aggressiveness = static_cast<float>(spec.aggressiveness);
+    for (size_t i = 0; i < DECK_SIZE; i++) {
+        Card card = ELEMENTAL_DECK[i];
+        int element = static_cast<int>(card.getElement());
+        float score = static_cast<float>(card.getStrength());
+        if (spec.preferredElements & (1u << element)) score += 3;
+        if (card.getElement() == Element::POWER) score += aggressiveness * 3;
+        cardScore[i] = score;
+    }
+    for (int context = 0; context <= PersonalityContext::NO_ELEMENT; context++) {
+        for (int element = 0; element < ELEMENT_COUNT; element++) {
+            bool counters = context < ELEMENT_COUNT && (COUNTERS[element] & (1u << context));
+            counterBonus[context][element] = counters ? static_cast<float>(spec.counterPriority * 5) : 0.0f;
+            comboBonus[context][element] = spec.comboFocus && context == element ? 4.0f : 0.0f;
+        }
+    }
+    // Behind, level, ahead
+    multiplier[0] = spec.exploitative ? static_cast<float>(1 + spec.aggressiveness) : 1.0f;
+    multiplier[1] = 1.0f;
+    multiplier[2] = spec.exploitative ? static_cast<float>(1 - spec.conservativeness) : 1.0f;
+    strengthBonus[0] = spec.defensive ? 0.5f : 0.0f;
+    strengthBonus[1] = 0.0f;
+    strengthBonus[2] = 0.0f;
+
+    aggressiveThreshold = chanceThreshold(spec.aggressiveness);
+    conservativeThreshold = chanceThreshold(spec.conservativeness);
+    // selectAICard falls back to random play without either trait
+    playsRandomly = spec.random || (spec.aggressiveness == 0 && spec.conservativeness == 0);
+}
+
+float AiPersonality::score(Card card, const PersonalityContext& context) const {
+    int element = static_cast<int>(card.getElement());
+    int standing = standingOf(context.margin);
+    float base = cardScore[deckIndexOf(card)] + counterBonus[context.opponentElement][element] +
+                 comboBonus[context.lastElement][element];
+    return base * multiplier[standing] + strengthBonus[standing] * card.getStrength();
+}
+
+int AiPersonality::chooseCard(const Player::CardList& hand, const PersonalityContext& context,
+                              GameRandom& random) const {
+    const size_t size = hand.size();
+    if (size == 0) {
+        return -1;
+    }
+    if (playsRandomly) {
+        return static_cast<int>(random.below(static_cast<uint32_t>(size)));
+    }
+
+    // The context picks one row of each table for the whole hand
+    const int standing = standingOf(context.margin);
+    const float* counter = counterBonus[context.opponentElement];
+    const float* combo = comboBonus[context.lastElement];
+    const float scale = multiplier[standing];
+    const float perStrength = strengthBonus[standing];
+    std::array<float, Player::MAX_CARDS> scores;
+    for (size_t i = 0; i < size; i++) {
+        int element = static_cast<int>(hand[i].getElement());
+        scores[i] = (cardScore[deckIndexOf(hand[i])] + counter[element] + combo[element]) * scale +
+                    perStrength * hand[i].getStrength();
+    }
+
+    // Best first, equal scores keeping hand order like the JS sort
+    std::array<uint8_t, Player::MAX_CARDS> order;
+    for (size_t i = 0; i < size; i++) {
+        size_t j = i;
+        while (j > 0 && scores[order[j - 1]] < scores[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = static_cast<uint8_t>(i);
+    }
+
+    if (random.below(CHANCE_SCALE) < aggressiveThreshold) {
+        return order[0];
+    }
+    if (random.below(CHANCE_SCALE) < conservativeThreshold) {
+        size_t from = size / 3, to = size * 2 / 3;
+        if (to > from) {
+            return order[from + random.below(static_cast<uint32_t>(to - from))];
+        }
+    }
+    if (spec.perfectPlay) {
+        return order[0];
+    }
+    size_t topHalf = (size + 1) / 2;
+    return order[random.below(static_cast<uint32_t>(topHalf))];
+}
+
+PersonalityTable PersonalityTable::builtin() {
+    PersonalityTable table;
+    std::stringstream input(BUILTIN_PERSONALITIES);
+    std::string error;
+    table.parse(input, error);
+    return table;
+}
+
+bool PersonalityTable::parse(std::istream& input, std::string& error) {
+    std::vector<AiPersonality> parsed;
+    std::string line;
+    for (int number = 1; std::getline(input, line); number++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        PersonalitySpec spec;
+        std::string reason;
+        if (!parseSpec(line, spec, reason)) {
+            error = "line " + std::to_string(number) + ": " + reason;
+            return false;
+        }
+        parsed.emplace_back(spec);
+    }
+    personalities = std::move(parsed);
+    return true;
+}
+
+bool PersonalityTable::load(const std::string& path, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    return parse(file, error);
+}
+
+const AiPersonality* PersonalityTable::find(std::string_view key) const {
+    for (const auto& personality : personalities) {
+        if (personality.getKey() == key) {
+            return &personality;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,102 @@
+#ifndef AI_PERSONALITY_H
+#define AI_PERSONALITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "card_game.h"
+
+// A personality as written in a personality file; the same fields and
+// meanings as aiPersonalities.js
+struct PersonalitySpec {
+    std::string key;  // what CREATE_ROOM names, e.g. EMBER
+    std::string name; // the AI player's name, e.g. Ember
+    std::string difficulty;
+    double aggressiveness = 0;
+    double conservativeness = 0;
+    double counterPriority = 0;
+    uint8_t preferredElements = 0; // bit per Element
+    bool random = false;
+    bool perfectPlay = false;
+    bool comboFocus = false;
+    bool exploitative = false;
+    bool defensive = false;
+};
+
+// What a personality looks at besides its hand
+struct PersonalityContext {
+    static const int NO_ELEMENT = 6;
+    int opponentElement = NO_ELEMENT; // the opponent's card this round
+    int lastElement = NO_ELEMENT;     // the AI's card last round
+    int margin = 0;                   // AI score minus opponent score
+};
+
+// Fills the context for player's move in a two-player room
+PersonalityContext makePersonalityContext(const GameRoom& room, const Player& player);
+
+// A personality compiled for scoring. selectAICard's score for a card is
+// ((strength + preferred + POWER bonus) + counter bonus + combo bonus)
+// * exploitative factor + defensive bonus; each term depends on the card
+// and at most one piece of context, so each is a small table and scoring
+// a card is a handful of loads and one multiply-add, with no branches.
+class AiPersonality {
+public:
+    static const int ELEMENT_COUNT = 6;
+    static const int STANDINGS = 3; // behind, level, ahead
+
+private:
+    PersonalitySpec spec;
+    float cardScore[DECK_SIZE]; // by ELEMENTAL_DECK index
+    // By the opponent's card element, then by the AI's last card element
+    float counterBonus[PersonalityContext::NO_ELEMENT + 1][ELEMENT_COUNT];
+    float comboBonus[PersonalityContext::NO_ELEMENT + 1][ELEMENT_COUNT];
+    float multiplier[STANDINGS];
+    float strengthBonus[STANDINGS];
+    // Math.random() < p, as below(2^24) < threshold
+    uint32_t aggressiveThreshold;
+    uint32_t conservativeThreshold;
+    bool playsRandomly;
+
+    static int standingOf(int margin) { return (margin > 0) - (margin < 0) + 1; }
+
+public:
+    explicit AiPersonality(const PersonalitySpec& personality);
+
+    const PersonalitySpec& getSpec() const { return spec; }
+    const std::string& getKey() const { return spec.key; }
+    const std::string& getName() const { return spec.name; }
+
+    float score(Card card, const PersonalityContext& context) const;
+
+    // selectAICard: rank the hand by score, then play the best card, a
+    // middle one or one from the top half as the personality's odds say.
+    // -1 for an empty hand.
+    int chooseCard(const Player::CardList& hand, const PersonalityContext& context, GameRandom& random) const;
+};
+
+// The personalities a server offers, looked up by key
+class PersonalityTable {
+private:
+    std::vector<AiPersonality> personalities;
+
+public:
+    // The personalities of aiPersonalities.js
+    static PersonalityTable builtin();
+
+    // One personality per line: its key, then field=value pairs (name,
+    // difficulty, aggressiveness, conservativeness, counterPriority,
+    // preferred=ELEMENT,..., flags=flag,...). # starts a comment. Elements
+    // and flags this game doesn't have are ignored. On failure error names
+    // the line and the table is unchanged.
+    bool parse(std::istream& input, std::string& error);
+    bool load(const std::string& path, std::string& error);
+
+    const AiPersonality* find(std::string_view key) const;
+    const std::vector<AiPersonality>& all() const { return personalities; }
+};
+
+#endif // AI_PERSONALITY_H
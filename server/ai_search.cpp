@@ -0,0 +1,345 @@
+#include "ai_search.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "batch_engine.h"
+#include "endgame_solver.h"
+
+namespace {
+
+// UCB1 exploration constant, for rewards between 0 and 1
+const double EXPLORATION = 0.7;
+
+struct MoveStats {
+    uint64_t visits = 0;
+    double reward = 0;
+};
+
+using MoveTable = std::array<MoveStats, Player::MAX_CARDS>;
+
+// Draws count distinct cards from the unseen ones
+Player::CardList sampleHand(uint64_t unseen, size_t count, GameRandom& random) {
+    Player::CardList hand;
+    while (hand.size() < count && unseen != 0) {
+        size_t index = random.below(static_cast<uint32_t>(DECK_SIZE));
+        if (unseen & (uint64_t(1) << index)) {
+            unseen &= ~(uint64_t(1) << index);
+            hand.push_back(ELEMENTAL_DECK[index]);
+        }
+    }
+    return hand;
+}
+
+// Candidate with the highest UCB1 score, counting rollouts already planned
+// for this wave as visits
+size_t pickCandidate(const MoveTable& stats, const MoveTable& planned, size_t candidates) {
+    uint64_t total = 0;
+    for (size_t m = 0; m < candidates; m++) {
+        total += stats[m].visits + planned[m].visits;
+    }
+    size_t best = 0;
+    double bestScore = -1;
+    for (size_t m = 0; m < candidates; m++) {
+        uint64_t visits = stats[m].visits + planned[m].visits;
+        if (visits == 0) return m;
+        double mean = stats[m].visits ? stats[m].reward / stats[m].visits : 0.5;
+        double score = mean + EXPLORATION * std::sqrt(std::log(static_cast<double>(total)) / visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = m;
+        }
+    }
+    return best;
+}
+
+// Runs up to count rollouts a wave at a time, adding the results to stats.
+// Stops early once the deadline has passed, but always finishes one wave.
+uint64_t runRollouts(const SearchPosition& position, size_t count, bool limited,
+                     std::chrono::steady_clock::time_point deadline, uint64_t seed, MoveTable& stats) {
+    const int me = position.seat;
+    const int opponent = 1 - me;
+    const size_t candidates = position.hand.size();
+    GameRandom random(seed);
+    BatchEngine engine(AiSearch::WAVE_SIZE);
+
+    BatchEngine::Position start;
+    start.hands[me] = position.hand;
+    for (const auto& card : position.opponentPlayed) {
+        start.playedStrength[opponent] += card.getStrength();
+    }
+    start.playedCount[opponent] = static_cast<int>(position.opponentPlayed.size());
+    start.scores[0] = position.scores[0];
+    start.scores[1] = position.scores[1];
+    start.roundsPlayed = position.roundsPlayed;
+
+    std::array<uint8_t, AiSearch::WAVE_SIZE> candidate;
+    std::array<bool, AiSearch::WAVE_SIZE> stalled;
+    uint64_t done = 0;
+    while (done < count) {
+        if (limited && done > 0 && std::chrono::steady_clock::now() >= deadline) break;
+        size_t wave = std::min<size_t>(AiSearch::WAVE_SIZE, count - done);
+
+        MoveTable planned{};
+        for (size_t r = 0; r < wave; r++) {
+            candidate[r] = static_cast<uint8_t>(pickCandidate(stats, planned, candidates));
+            planned[candidate[r]].visits++;
+            start.hands[opponent] = sampleHand(position.unseen, position.opponentHandSize, random);
+            engine.load(r, start, random.next());
+            stalled[r] = false;
+        }
+
+        // The candidate is our first move; everything after it is random.
+        // A hand that runs out stops the game where it is, as in a room.
+        for (int round = position.roundsPlayed; round < GameRoom::ROUNDS_PER_GAME; round++) {
+            for (int seat = 0; seat < 2; seat++) {
+                bool first = round == position.roundsPlayed && seat == me;
+                for (size_t r = 0; r < wave; r++) {
+                    if (stalled[r] || engine.isGameOver(r) || engine.getPlayedCount(r, seat) > 0) continue;
+                    size_t size = engine.getHandSize(r, seat);
+                    if (size == 0) {
+                        stalled[r] = true;
+                        continue;
+                    }
+                    int index = first ? candidate[r] : static_cast<int>(random.below(static_cast<uint32_t>(size)));
+                    engine.play(r, seat, index);
+                }
+            }
+            engine.resolve();
+        }
+
+        for (size_t r = 0; r < wave; r++) {
+            int mine = engine.getScore(r, me), theirs = engine.getScore(r, opponent);
+            stats[candidate[r]].visits++;
+            stats[candidate[r]].reward += mine > theirs ? 1.0 : mine == theirs ? 0.5 : 0.0;
+        }
+        done += wave;
+    }
+    return done;
+}
+
+// Most tried candidate, the better average breaking ties
+AiChoice bestCandidate(const MoveTable& stats, size_t candidates) {
+    size_t best = 0;
+    for (size_t m = 1; m < candidates; m++) {
+        if (stats[m].visits > stats[best].visits ||
+            (stats[m].visits == stats[best].visits && stats[m].reward > stats[best].reward)) {
+            best = m;
+        }
+    }
+    AiChoice choice;
+    choice.cardIndex = static_cast<int>(best);
+    if (stats[best].visits > 0) {
+        choice.expectedScore = stats[best].reward / stats[best].visits;
+    }
+    return choice;
+}
+
+bool wantsSolve(const SearchPosition& position, const AiSettings& settings) {
+    return settings.endgameRounds > 0 &&
+           GameRoom::ROUNDS_PER_GAME - position.roundsPlayed <= settings.endgameRounds;
+}
+
+// Solves with this thread's solver, whose table carries over between moves
+bool solveExactly(const SearchPosition& position, AiChoice& choice) {
+    thread_local EndgameSolver solver;
+    EndgameSolver::Result result;
+    if (!solver.solve(position, result)) {
+        return false;
+    }
+    choice.cardIndex = result.cardIndex;
+    choice.expectedScore = result.expectedScore;
+    choice.exact = true;
+    return true;
+}
+
+// The answer when there is nothing to search
+AiChoice trivialChoice(const SearchPosition& position) {
+    AiChoice choice;
+    choice.cardIndex = position.hand.empty() ? -1 : 0;
+    return choice;
+}
+
+} // namespace
+
+bool makeSearchPosition(const GameRoom& room, SearchPosition& position) {
+    const auto& players = room.getPlayers();
+    auto current = room.getCurrentPlayer();
+    if (players.size() != 2 || !room.isGameStarted() || room.isGameOver() || !current) {
+        return false;
+    }
+    int seat = current == players[0] ? 0 : 1;
+    const Player& me = *players[seat];
+    const Player& opponent = *players[1 - seat];
+    if (me.getHand().empty()) {
+        return false;
+    }
+
+    position.hand = me.getHand();
+    position.seat = seat;
+    position.opponentHandSize = opponent.getHand().size();
+    position.opponentPlayed = opponent.getPlayedCards();
+    position.scores[0] = players[0]->getScore();
+    position.scores[1] = players[1]->getScore();
+    position.roundsPlayed = room.getRoundsPlayed();
+
+    uint64_t seen = room.getPlayedCardMask();
+    for (const auto& card : position.hand) {
+        seen |= uint64_t(1) << deckIndexOf(card);
+    }
+    position.unseen = ((uint64_t(1) << DECK_SIZE) - 1) & ~seen;
+    return true;
+}
+
+// One move's search, shared by its jobs
+struct AiSearch::Search {
+    SearchPosition position;
+    AiSettings settings;
+    uint64_t seed;
+    std::chrono::steady_clock::time_point deadline;
+    std::function<void(const AiChoice&)> onDone;
+    std::vector<MoveTable> results; // one per job
+    std::atomic<size_t> pending;
+};
+
+const size_t AiSearch::WAVE_SIZE;
+
+AiSearch::AiSearch(size_t threadCount) : stopping(false), searches(0), rollouts(0), solves(0) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        threads.emplace_back(&AiSearch::workerLoop, this);
+    }
+}
+
+AiSearch::~AiSearch() {
+    stop();
+}
+
+void AiSearch::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) return;
+        stopping = true;
+        jobs.clear();
+    }
+    wakeup.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void AiSearch::workerLoop() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void AiSearch::search(const SearchPosition& position, const AiSettings& settings, uint64_t seed,
+                      std::function<void(const AiChoice&)> onDone) {
+    searches.fetch_add(1, std::memory_order_relaxed);
+    bool solve = !position.hand.empty() && wantsSolve(position, settings);
+    if (!solve && (position.hand.size() <= 1 || settings.rollouts == 0)) {
+        // Nothing to weigh up; answer without queueing
+        onDone(trivialChoice(position));
+        return;
+    }
+
+    size_t waves = std::max<size_t>(1, (settings.rollouts + WAVE_SIZE - 1) / WAVE_SIZE);
+    size_t jobCount = std::min(threads.size(), waves);
+    auto shared = std::make_shared<Search>();
+    shared->position = position;
+    shared->settings = settings;
+    shared->seed = seed;
+    shared->deadline = std::chrono::steady_clock::now() + settings.budget;
+    shared->onDone = std::move(onDone);
+    shared->results.resize(jobCount);
+    shared->pending = jobCount;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) return;
+    if (!solve) {
+        queueRollouts(shared);
+        return;
+    }
+    // The solver runs as one job and hands over to rollouts if it gives up
+    jobs.push_back([this, shared] {
+        AiChoice choice;
+        if (solveExactly(shared->position, choice)) {
+            solves.fetch_add(1, std::memory_order_relaxed);
+            shared->onDone(choice);
+            return;
+        }
+        if (shared->position.hand.size() <= 1 || shared->settings.rollouts == 0) {
+            shared->onDone(trivialChoice(shared->position));
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stopping) {
+            queueRollouts(shared);
+        }
+    });
+    wakeup.notify_one();
+}
+
+void AiSearch::queueRollouts(const std::shared_ptr<Search>& shared) {
+    size_t waves = (shared->settings.rollouts + WAVE_SIZE - 1) / WAVE_SIZE;
+    size_t jobCount = shared->results.size();
+    for (size_t j = 0; j < jobCount; j++) {
+        // Whole waves per job, so no job simulates a partial one
+        size_t share = (waves * (j + 1) / jobCount - waves * j / jobCount) * WAVE_SIZE;
+        jobs.push_back([this, shared, j, share] {
+            const Search& s = *shared;
+            bool limited = s.settings.budget != std::chrono::steady_clock::duration::zero();
+            uint64_t done = runRollouts(s.position, share, limited, s.deadline, s.seed + j, shared->results[j]);
+            rollouts.fetch_add(done, std::memory_order_relaxed);
+
+            if (shared->pending.fetch_sub(1) == 1) {
+                MoveTable merged{};
+                for (const auto& result : shared->results) {
+                    for (size_t m = 0; m < merged.size(); m++) {
+                        merged[m].visits += result[m].visits;
+                        merged[m].reward += result[m].reward;
+                    }
+                }
+                shared->onDone(bestCandidate(merged, s.position.hand.size()));
+            }
+        });
+    }
+    wakeup.notify_all();
+}
+
+AiChoice AiSearch::searchNow(const SearchPosition& position, const AiSettings& settings, uint64_t seed) {
+    AiChoice choice;
+    if (!position.hand.empty() && wantsSolve(position, settings) && solveExactly(position, choice)) {
+        return choice;
+    }
+    if (position.hand.size() <= 1 || settings.rollouts == 0) {
+        return trivialChoice(position);
+    }
+    bool limited = settings.budget != std::chrono::steady_clock::duration::zero();
+    MoveTable stats{};
+    runRollouts(position, settings.rollouts, limited, std::chrono::steady_clock::now() + settings.budget, seed, stats);
+    return bestCandidate(stats, position.hand.size());
+}
+
+uint64_t AiSearch::getSearchCount() const {
+    return searches.load(std::memory_order_relaxed);
+}
+
+uint64_t AiSearch::getRolloutCount() const {
+    return rollouts.load(std::memory_order_relaxed);
+}
+
+uint64_t AiSearch::getSolveCount() const {
+    return solves.load(std::memory_order_relaxed);
+}
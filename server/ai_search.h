@@ -0,0 +1,106 @@
+#ifndef AI_SEARCH_H
+#define AI_SEARCH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "card_game.h"
+
+// What the player to move knows: its own hand, how many cards the opponent
+// holds, the cards the opponent has already played this round, the scores, and
+// which cards could still be in the opponent's hand (everything it has not
+// seen in its own hand or played on the table).
+struct SearchPosition {
+    Player::CardList hand;
+    int seat = 0; // 0 leads each round, 1 answers
+    size_t opponentHandSize = 0;
+    Player::CardList opponentPlayed;
+    int scores[2] = {}; // by seat
+    int roundsPlayed = 0;
+    uint64_t unseen = 0; // ELEMENTAL_DECK indices
+};
+
+// Fills position for the current player of a started two-player game.
+// False if there is no such turn or the player has no cards.
+bool makeSearchPosition(const GameRoom& room, SearchPosition& position);
+
+// A chosen card and how well it is expected to do: the chance of winning,
+// counting a tie as half. Exact when the endgame solver chose the card,
+// otherwise the card's average over its rollouts.
+struct AiChoice {
+    int cardIndex = -1;
+    double expectedScore = 0.5;
+    bool exact = false;
+};
+
+// Monte Carlo AI. Each rollout deals the opponent a hand sampled from the
+// unseen cards, plays one of the candidate cards and finishes the game with
+// random play under the real rules (a BatchEngine, so the POWER follow-ups
+// and round resolution are the GameRoom ones). Rollouts run a wave of rooms
+// at a time; before each wave, UCB1 decides how many of its rooms try each
+// candidate, so promising cards get most of the budget. The card tried most
+// often is played.
+//
+// With AiSettings::endgameRounds set (the hard AI), a position with that
+// few rounds left is solved exactly by an EndgameSolver instead, falling
+// back to rollouts if the solver gives up.
+//
+// A move's rollouts are split into jobs for a fixed pool of threads, each
+// job with its own generator, and merged when the last one finishes. As
+// long as the time budget is not hit, a move depends only on the position,
+// the seed and the number of threads.
+class AiSearch {
+private:
+    struct Search;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::function<void()>> jobs;
+    bool stopping;
+    std::atomic<uint64_t> searches;
+    std::atomic<uint64_t> rollouts;
+    std::atomic<uint64_t> solves;
+
+    void workerLoop();
+    // Queues the search's rollout jobs; called with the mutex held
+    void queueRollouts(const std::shared_ptr<Search>& shared);
+
+public:
+    // Rooms simulated side by side per wave
+    static const size_t WAVE_SIZE = 256;
+
+    explicit AiSearch(size_t threadCount = 0);
+    ~AiSearch();
+
+    AiSearch(const AiSearch&) = delete;
+    AiSearch& operator=(const AiSearch&) = delete;
+
+    // Searches on the pool and calls onDone on a pool thread, or straight
+    // away when there is nothing to choose. Rollouts are rounded up to whole
+    // waves. Searches dropped by stop() never call back.
+    void search(const SearchPosition& position, const AiSettings& settings, uint64_t seed,
+                std::function<void(const AiChoice&)> onDone);
+
+    // The same search on the calling thread, as a single job
+    static AiChoice searchNow(const SearchPosition& position, const AiSettings& settings, uint64_t seed);
+
+    // Drops queued searches and waits for running jobs, whose callbacks
+    // still run, to finish
+    void stop();
+
+    uint64_t getSearchCount() const;
+    uint64_t getRolloutCount() const;
+    // Moves the endgame solver chose
+    uint64_t getSolveCount() const;
+};
+
+#endif // AI_SEARCH_H
@@ -0,0 +1,231 @@
+#include "batch_engine.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BATCH_ENGINE_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Rooms per AVX2 step; the columns are padded to a multiple of it
+const size_t KERNEL_WIDTH = 32;
+
+// Columns one round resolution reads and writes
+struct ResolveColumns {
+    uint8_t* strength[BatchEngine::SEATS];
+    uint8_t* played[BatchEngine::SEATS];
+    uint8_t* scores[BatchEngine::SEATS];
+    uint8_t* rounds;
+    uint8_t* over;
+    size_t count;
+};
+
+// resolveRound, one room at a time
+void resolveScalar(const ResolveColumns& c) {
+    for (size_t i = 0; i < c.count; i++) {
+        if (c.played[0][i] == 0 || c.played[1][i] == 0) continue;
+
+        if (c.strength[0][i] > c.strength[1][i]) {
+            c.scores[0][i]++;
+        } else if (c.strength[1][i] > c.strength[0][i]) {
+            c.scores[1][i]++;
+        }
+        c.strength[0][i] = c.strength[1][i] = 0;
+        c.played[0][i] = c.played[1][i] = 0;
+
+        c.rounds[i]++;
+        if (c.rounds[i] >= GameRoom::ROUNDS_PER_GAME) {
+            c.over[i] = 1;
+        }
+    }
+}
+
+#ifdef BATCH_ENGINE_AVX2
+__attribute__((target("avx2")))
+inline __m256i load(const uint8_t* column) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column));
+}
+
+__attribute__((target("avx2")))
+inline void store(uint8_t* column, __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(column), value);
+}
+
+// The same, 32 rooms per step. Every value is a small count or strength
+// total well below 128, so signed byte compares are exact.
+__attribute__((target("avx2")))
+void resolveAvx2(const ResolveColumns& c) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i lastRound = _mm256_set1_epi8(GameRoom::ROUNDS_PER_GAME - 1);
+
+    for (size_t i = 0; i < c.count; i += KERNEL_WIDTH) {
+        __m256i played0 = load(c.played[0] + i);
+        __m256i played1 = load(c.played[1] + i);
+        // waiting is 0xFF where a seat has yet to play, readyBit 1 where both have
+        __m256i waiting = _mm256_or_si256(_mm256_cmpeq_epi8(played0, zero), _mm256_cmpeq_epi8(played1, zero));
+        __m256i readyBit = _mm256_andnot_si256(waiting, one);
+        if (_mm256_testz_si256(readyBit, readyBit)) continue;
+
+        __m256i strength0 = load(c.strength[0] + i);
+        __m256i strength1 = load(c.strength[1] + i);
+        __m256i win0 = _mm256_and_si256(_mm256_cmpgt_epi8(strength0, strength1), readyBit);
+        __m256i win1 = _mm256_and_si256(_mm256_cmpgt_epi8(strength1, strength0), readyBit);
+        store(c.scores[0] + i, _mm256_add_epi8(load(c.scores[0] + i), win0));
+        store(c.scores[1] + i, _mm256_add_epi8(load(c.scores[1] + i), win1));
+
+        // Resolved rooms start the next round with nothing played
+        store(c.strength[0] + i, _mm256_and_si256(strength0, waiting));
+        store(c.strength[1] + i, _mm256_and_si256(strength1, waiting));
+        store(c.played[0] + i, _mm256_and_si256(played0, waiting));
+        store(c.played[1] + i, _mm256_and_si256(played1, waiting));
+
+        __m256i rounds = _mm256_add_epi8(load(c.rounds + i), readyBit);
+        store(c.rounds + i, rounds);
+        __m256i finished = _mm256_and_si256(_mm256_cmpgt_epi8(rounds, lastRound), readyBit);
+        store(c.over + i, _mm256_or_si256(load(c.over + i), finished));
+    }
+}
+#endif
+
+} // namespace
+
+BatchEngine::BatchEngine(size_t rooms)
+    : roomCount(rooms), paddedCount((rooms + KERNEL_WIDTH - 1) / KERNEL_WIDTH * KERNEL_WIDTH), random(rooms, GameRandom(0)) {
+    for (int seat = 0; seat < SEATS; seat++) {
+        for (auto& column : hands[seat]) {
+            column.assign(paddedCount, 0);
+        }
+        handSize[seat].assign(paddedCount, 0);
+        playedStrength[seat].assign(paddedCount, 0);
+        playedCount[seat].assign(paddedCount, 0);
+        scores[seat].assign(paddedCount, 0);
+    }
+    rounds.assign(paddedCount, 0);
+    over.assign(paddedCount, 0);
+}
+
+Card BatchEngine::handCard(size_t room, int seat, size_t slot) const {
+    return Card::fromByte(hands[seat][slot][room]);
+}
+
+void BatchEngine::removeFromHand(size_t room, int seat, size_t slot) {
+    // Keeps the order of the remaining cards, like Player::removeCard
+    size_t size = handSize[seat][room];
+    for (size_t i = slot + 1; i < size; i++) {
+        hands[seat][i - 1][room] = hands[seat][i][room];
+    }
+    handSize[seat][room] = static_cast<uint8_t>(size - 1);
+}
+
+void BatchEngine::deal(size_t room, uint64_t seed) {
+    random[room] = GameRandom(seed);
+    Deck deck;
+    deck.shuffle(random[room]);
+
+    for (int seat = 0; seat < SEATS; seat++) {
+        Player::CardList hand;
+        deck.deal(GameServer::CARDS_PER_PLAYER, hand);
+        for (size_t i = 0; i < hand.size(); i++) {
+            hands[seat][i][room] = hand[i].toByte();
+        }
+        handSize[seat][room] = static_cast<uint8_t>(hand.size());
+        playedStrength[seat][room] = 0;
+        playedCount[seat][room] = 0;
+        scores[seat][room] = 0;
+    }
+    rounds[room] = 0;
+    over[room] = 0;
+}
+
+void BatchEngine::load(size_t room, const Position& position, uint64_t seed) {
+    random[room] = GameRandom(seed);
+    for (int seat = 0; seat < SEATS; seat++) {
+        const Player::CardList& hand = position.hands[seat];
+        for (size_t i = 0; i < hand.size(); i++) {
+            hands[seat][i][room] = hand[i].toByte();
+        }
+        handSize[seat][room] = static_cast<uint8_t>(hand.size());
+        playedStrength[seat][room] = static_cast<uint8_t>(position.playedStrength[seat]);
+        playedCount[seat][room] = static_cast<uint8_t>(position.playedCount[seat]);
+        scores[seat][room] = static_cast<uint8_t>(position.scores[seat]);
+    }
+    rounds[room] = static_cast<uint8_t>(position.roundsPlayed);
+    over[room] = position.roundsPlayed >= GameRoom::ROUNDS_PER_GAME ? 1 : 0;
+}
+
+bool BatchEngine::play(size_t room, int seat, int index) {
+    if (over[room] || index < 0 || index >= handSize[seat][room]) {
+        return false;
+    }
+
+    Card card = handCard(room, seat, index);
+    removeFromHand(room, seat, index);
+    playedStrength[seat][room] += card.getStrength();
+    playedCount[seat][room]++;
+
+    // A POWER card brings a random one of the seat's other POWER cards
+    if (card.getElement() == Element::POWER) {
+        InlineVector<uint8_t, HAND_SLOTS> powerSlots;
+        for (size_t i = 0; i < handSize[seat][room]; i++) {
+            if (handCard(room, seat, i).getElement() == Element::POWER) {
+                powerSlots.push_back(static_cast<uint8_t>(i));
+            }
+        }
+        if (!powerSlots.empty()) {
+            size_t slot = powerSlots[random[room].below(static_cast<uint32_t>(powerSlots.size()))];
+            playedStrength[seat][room] += handCard(room, seat, slot).getStrength();
+            playedCount[seat][room]++;
+            removeFromHand(room, seat, slot);
+        }
+    }
+    return true;
+}
+
+void BatchEngine::resolve() {
+    resolve(bestKernel());
+}
+
+void BatchEngine::resolve(Kernel kernel) {
+    ResolveColumns columns;
+    for (int seat = 0; seat < SEATS; seat++) {
+        columns.strength[seat] = playedStrength[seat].data();
+        columns.played[seat] = playedCount[seat].data();
+        columns.scores[seat] = scores[seat].data();
+    }
+    columns.rounds = rounds.data();
+    columns.over = over.data();
+    columns.count = paddedCount;
+
+#ifdef BATCH_ENGINE_AVX2
+    if (kernel == Kernel::AVX2 && isAvailable(Kernel::AVX2)) {
+        resolveAvx2(columns);
+        return;
+    }
+#endif
+    resolveScalar(columns);
+}
+
+bool BatchEngine::isAvailable(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::SCALAR:
+            return true;
+        case Kernel::AVX2: {
+#ifdef BATCH_ENGINE_AVX2
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+#else
+            return false;
+#endif
+        }
+    }
+    return false;
+}
+
+BatchEngine::Kernel BatchEngine::bestKernel() {
+    return isAvailable(Kernel::AVX2) ? Kernel::AVX2 : Kernel::SCALAR;
+}
+
+const char* BatchEngine::kernelName(Kernel kernel) {
+    return kernel == Kernel::AVX2 ? "avx2" : "scalar";
+}
@@ -0,0 +1,89 @@
+#ifndef BATCH_ENGINE_H
+#define BATCH_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "card_game.h"
+#include "game_random.h"
+
+// Plays many two-player games side by side for simulations. Rooms are
+// stored as structure-of-arrays columns (one byte per room per field), so
+// resolving a round for every room at once is a straight pass over a few
+// arrays that the AVX2 kernel does 32 rooms at a time.
+//
+// The rules match GameRoom exactly: deal() shuffles and deals like
+// startGame+dealCards, play() is chooseCard's card handling (including the
+// POWER follow-up, drawn from the same per-room generator) and resolve()
+// is resolveRound. A room dealt with the same seed and played the same way
+// ends with the same scores as a GameRoom.
+class BatchEngine {
+public:
+    enum class Kernel : uint8_t {
+        SCALAR,
+        AVX2
+    };
+
+    static const int SEATS = 2;
+    static const size_t HAND_SLOTS = Player::MAX_CARDS;
+
+    // A game part way through, for starting a room mid-game
+    struct Position {
+        Player::CardList hands[SEATS];
+        int playedStrength[SEATS] = {};
+        int playedCount[SEATS] = {};
+        int scores[SEATS] = {};
+        int roundsPlayed = 0;
+    };
+
+private:
+    size_t roomCount;
+    size_t paddedCount; // rounded up to a whole kernel step
+
+    // Card bytes (Card::toByte) per seat and hand slot; handSize per seat
+    std::vector<uint8_t> hands[SEATS][HAND_SLOTS];
+    std::vector<uint8_t> handSize[SEATS];
+    // This round's played strength total and card count per seat
+    std::vector<uint8_t> playedStrength[SEATS];
+    std::vector<uint8_t> playedCount[SEATS];
+    std::vector<uint8_t> scores[SEATS];
+    std::vector<uint8_t> rounds;
+    std::vector<uint8_t> over;
+    std::vector<GameRandom> random;
+
+    Card handCard(size_t room, int seat, size_t slot) const;
+    void removeFromHand(size_t room, int seat, size_t slot);
+
+public:
+    explicit BatchEngine(size_t rooms);
+
+    size_t size() const { return roomCount; }
+
+    // Starts a fresh game in the room with the given seed
+    void deal(size_t room, uint64_t seed);
+    // Puts the room in the given position; seed drives its POWER follow-ups
+    void load(size_t room, const Position& position, uint64_t seed);
+
+    // Plays the card at index for the seat; false if the index is invalid
+    // or the game is over. Seat order within a round is up to the caller.
+    bool play(size_t room, int seat, int index);
+
+    // Resolves the round in every room where both seats have played
+    void resolve();
+    void resolve(Kernel kernel);
+
+    static bool isAvailable(Kernel kernel);
+    static Kernel bestKernel();
+    static const char* kernelName(Kernel kernel);
+
+    size_t getHandSize(size_t room, int seat) const { return handSize[seat][room]; }
+    Card getCard(size_t room, int seat, size_t index) const { return handCard(room, seat, index); }
+    int getPlayedStrength(size_t room, int seat) const { return playedStrength[seat][room]; }
+    int getPlayedCount(size_t room, int seat) const { return playedCount[seat][room]; }
+    int getScore(size_t room, int seat) const { return scores[seat][room]; }
+    int getRoundsPlayed(size_t room) const { return rounds[room]; }
+    bool isGameOver(size_t room) const { return over[room] != 0; }
+};
+
+#endif // BATCH_ENGINE_H
@@ -0,0 +1,2129 @@
+// Microbenchmarks for the card game server hot paths.
+//
+// Usage: card_game_bench [suite] [iterations]
+//   suite: parser, registry, rooms, state, cards, allocations, random, deck, fanout,
+//          lifecycle, turns, batch, ai, endgame, personalities, lobby, pool, journal, snapshot,
+//          loop or all (default)
+
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <new>
+#include <cmath>
+#include <map>
+#include <filesystem>
+#include <fstream>
+
+#include "card_game.h"
+#include "command_parser.h"
+#include "wire_protocol.h"
+#include "push_queue.h"
+#include "timing_wheel.h"
+#include "batch_engine.h"
+#include "ai_search.h"
+#include "endgame_solver.h"
+#include "ai_personality.h"
+#include "room_registry.h"
+#include "flat_hash_map.h"
+#include "slab_pool.h"
+#include "journal.h"
+#include "binary_codec.h"
+#include "snapshot.h"
+#include "event_loop.h"
+
+#ifdef __linux__
+    #include <deque>
+    #include <future>
+    #include <mutex>
+    #include <condition_variable>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+#endif
+
+// Heap allocations made by the current thread, for the allocations suite.
+// Every replaceable form of new and delete is replaced, so array, sized
+// and over-aligned allocations are counted and freed alike.
+thread_local size_t threadAllocations = 0;
+
+namespace {
+
+void* countedAllocate(size_t size) {
+    threadAllocations++;
+    if (void* block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void* countedAllocate(size_t size, std::align_val_t alignment) {
+    threadAllocations++;
+    // aligned_alloc wants a whole number of alignments
+    size_t align = static_cast<size_t>(alignment);
+    if (void* block = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, size_t, std::align_val_t) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, size_t, std::align_val_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+
+namespace {
+
+const char* const SAMPLE_COMMANDS[] = {
+    "PLAY_CARD room_42 player_7 3",
+    "GET_STATE room_42",
+    "JOIN_ROOM room_42 player_8 Ember Knight",
+    "PLAY_CARD room_1337 player_1024 0",
+    "GET_STATE room_1337",
+    "START_GAME room_42",
+    "CREATE_ROOM",
+};
+
+const size_t SAMPLE_COUNT = sizeof(SAMPLE_COMMANDS) / sizeof(SAMPLE_COMMANDS[0]);
+
+// The request parsing the server used before the string_view parser:
+// std::string per request, a chain of find()==0 checks, substr copies
+// and std::stoi.
+size_t legacyParse(const char* buffer) {
+    std::string request(buffer);
+    size_t checksum = 0;
+
+    if (request.find("CREATE_ROOM") == 0) {
+        checksum += 1;
+    }
+    else if (request.find("JOIN_ROOM") == 0) {
+        size_t pos1 = request.find(' ');
+        size_t pos2 = request.find(' ', pos1 + 1);
+        size_t pos3 = request.find(' ', pos2 + 1);
+        if (pos1 != std::string::npos && pos2 != std::string::npos && pos3 != std::string::npos) {
+            std::string roomId = request.substr(pos1 + 1, pos2 - pos1 - 1);
+            std::string playerId = request.substr(pos2 + 1, pos3 - pos2 - 1);
+            std::string playerName = request.substr(pos3 + 1);
+            checksum += roomId.size() + playerId.size() + playerName.size();
+        }
+    }
+    else if (request.find("START_GAME") == 0) {
+        size_t pos = request.find(' ');
+        if (pos != std::string::npos) {
+            std::string roomId = request.substr(pos + 1);
+            checksum += roomId.size();
+        }
+    }
+    else if (request.find("PLAY_CARD") == 0) {
+        size_t pos1 = request.find(' ');
+        size_t pos2 = request.find(' ', pos1 + 1);
+        size_t pos3 = request.find(' ', pos2 + 1);
+        if (pos1 != std::string::npos && pos2 != std::string::npos && pos3 != std::string::npos) {
+            std::string roomId = request.substr(pos1 + 1, pos2 - pos1 - 1);
+            std::string playerId = request.substr(pos2 + 1, pos3 - pos2 - 1);
+            int cardIndex = std::stoi(request.substr(pos3 + 1));
+            checksum += roomId.size() + playerId.size() + cardIndex;
+        }
+    }
+    else if (request.find("GET_STATE") == 0) {
+        size_t pos = request.find(' ');
+        if (pos != std::string::npos) {
+            std::string roomId = request.substr(pos + 1);
+            checksum += roomId.size();
+        }
+    }
+    return checksum;
+}
+
+size_t viewParse(std::string_view line) {
+    Command command;
+    if (parseCommand(line, command) != ParseStatus::OK) {
+        return 0;
+    }
+    size_t checksum = command.roomId.size() + command.playerId.size() + command.playerName.size();
+    if (command.type == CommandType::PLAY_CARD) checksum += command.cardIndex;
+    if (command.type == CommandType::CREATE_ROOM) checksum += 1;
+    return checksum;
+}
+
+template <typename Fn>
+void report(const char* name, size_t operations, Fn&& body) {
+    auto start = std::chrono::steady_clock::now();
+    size_t checksum = body();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << static_cast<long long>(operations / elapsed) << " ops/s"
+              << " (" << elapsed * 1e3 << " ms, checksum " << checksum << ")" << std::endl;
+}
+
+// A binary CREATE_ROOM frame carrying the seed
+std::string binaryCreateRoom(uint64_t seed) {
+    std::string payload;
+    appendVarint(payload, seed);
+    std::string frame;
+    frame.push_back(static_cast<char>(static_cast<uint8_t>(CommandType::CREATE_ROOM) + 1));
+    frame.push_back(static_cast<char>(payload.size() & 0xFF));
+    frame.push_back(static_cast<char>(payload.size() >> 8));
+    return frame + payload;
+}
+
+// Seeds up to GameRandom::SEED_MASK are taken by both parsers, anything
+// above is rejected. Returns false if either parser disagrees.
+bool checkSeedLimit() {
+    const uint64_t largest = GameRandom::SEED_MASK;
+    bool ok = true;
+    for (uint64_t seed : {uint64_t(0), largest, largest + 1, ~uint64_t(0)}) {
+        ParseStatus expected = seed <= largest ? ParseStatus::OK : ParseStatus::INVALID_ARGUMENTS;
+        Command text, binary;
+        std::string line = "CREATE_ROOM " + std::to_string(seed);
+        bool textOk = parseCommand(line, text) == expected && (expected != ParseStatus::OK || text.seed == seed);
+        std::string frame = binaryCreateRoom(seed);
+        bool binaryOk = parseBinaryCommand(frame, binary) == expected &&
+                        (expected != ParseStatus::OK || binary.seed == seed);
+        if (!textOk || !binaryOk) {
+            std::cout << "  seed " << seed << " misparsed by the" << (textOk ? "" : " text") << (binaryOk ? "" : " binary")
+                      << " parser" << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool benchParser(size_t iterations) {
+    std::vector<std::string_view> views(SAMPLE_COMMANDS, SAMPLE_COMMANDS + SAMPLE_COUNT);
+    size_t operations = iterations * SAMPLE_COUNT;
+
+    report("parse/legacy find+substr+stoi", operations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            for (size_t j = 0; j < SAMPLE_COUNT; j++) {
+                checksum += legacyParse(SAMPLE_COMMANDS[j]);
+            }
+        }
+        return checksum;
+    });
+
+    report("parse/string_view perfect hash", operations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            for (size_t j = 0; j < SAMPLE_COUNT; j++) {
+                checksum += viewParse(views[j]);
+            }
+        }
+        return checksum;
+    });
+    return checkSeedLimit();
+}
+
+// The flat map against std::map through random inserts and erases, then
+// room lookups by id string and by handle, stale handles after rooms are
+// erased and their slots reused, and rooms registered in two steps.
+// Returns false on any disagreement.
+bool checkHandles(size_t iterations) {
+    FlatStringMap<uint64_t> flat;
+    std::map<std::string, uint64_t> reference;
+    std::mt19937_64 rng(5);
+    bool ok = true;
+    for (size_t i = 0; i < iterations; i++) {
+        std::string key = "room_" + std::to_string(rng() % 4096);
+        uint64_t hash = FlatStringMap<uint64_t>::hashOf(key);
+        if (rng() % 3 == 0) {
+            ok = ok && flat.erase(key, hash) == (reference.erase(key) == 1);
+        } else {
+            ok = ok && flat.insert(key, hash, i) == reference.emplace(key, i).second;
+        }
+    }
+    for (const auto& [key, value] : reference) {
+        const uint64_t* found = flat.find(key);
+        ok = ok && found && *found == value;
+    }
+    ok = ok && flat.size() == reference.size();
+
+    const size_t ROOMS = 100000;
+    RoomRegistry registry;
+    std::vector<std::string> ids;
+    std::vector<RoomHandle> handles;
+    for (size_t i = 0; i < ROOMS; i++) {
+        ids.push_back("room_" + std::to_string(i + 1));
+        handles.push_back(registry.insert(ids.back(), std::make_shared<GameRoom>(ids.back())));
+    }
+    report("registry/find by room id", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            checksum += registry.find(ids[(i * 7919) % ROOMS]) != nullptr;
+        }
+        return checksum;
+    });
+    report("registry/find by handle", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            checksum += registry.find(handles[(i * 7919) % ROOMS]) != nullptr;
+        }
+        return checksum;
+    });
+
+    // Every other room goes and a new one takes its slot
+    for (size_t i = 0; i < ROOMS; i += 2) {
+        ok = ok && registry.erase(handles[i], ids[i]);
+        RoomHandle reused = registry.insert("new_" + ids[i], std::make_shared<GameRoom>("new_" + ids[i]));
+        ok = ok && reused.valid() && registry.find(reused) != nullptr;
+    }
+    size_t stale = 0;
+    for (size_t i = 0; i < ROOMS; i++) {
+        bool gone = i % 2 == 0;
+        stale += gone && !registry.find(handles[i]) && !registry.find(ids[i]) ? 1 : 0;
+        ok = ok && (gone || registry.find(handles[i]) == registry.find(ids[i]));
+    }
+    ok = ok && stale == ROOMS / 2 && registry.size() == ROOMS;
+
+    // A reserved room holds its id but can't be found until it is published
+    auto room = std::make_shared<GameRoom>("reserved");
+    RoomHandle reserved = registry.reserve("reserved");
+    ok = ok && reserved.valid() && !registry.reserve("reserved").valid() && !registry.insert("reserved", room).valid();
+    ok = ok && !registry.find("reserved") && !registry.find(reserved) && registry.size() == ROOMS;
+    registry.publish(reserved, room);
+    ok = ok && registry.find("reserved") == room && registry.find(reserved) == room && registry.size() == ROOMS + 1;
+    ok = ok && registry.erase(reserved, "reserved");
+    RoomHandle released = registry.reserve("released");
+    registry.release(released, "released");
+    ok = ok && !registry.lookup("released").valid() && registry.size() == ROOMS;
+    std::cout << "  flat map matches std::map: " << (flat.size() == reference.size() ? "yes" : "no")
+              << ", stale handles rejected " << stale << "/" << ROOMS / 2 << std::endl;
+    return ok;
+}
+
+// Stress test for the sharded room registry: 64 threads create, join and
+// play through their own rooms while looking up rooms created by others.
+// Returns false if any room went missing.
+bool benchRegistry(size_t iterations) {
+    const int THREADS = 64;
+    size_t gamesPerThread = std::max<size_t>(1, iterations / 1000);
+    GameServer server;
+    AiSettings randomAi;
+    randomAi.rollouts = 0;
+    server.setAiSettings(randomAi);
+    std::atomic<size_t> failures(0);
+    std::atomic<size_t> lookups(0);
+
+    report("registry/64 threads create+join+play", THREADS * gamesPerThread, [&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t] {
+                std::string playerId = "player_" + std::to_string(t);
+                for (size_t g = 0; g < gamesPerThread; g++) {
+                    std::string roomId = server.createRoom(2);
+                    if (!server.joinRoom(roomId, playerId, "Stress") || !server.startGame(roomId)) {
+                        failures++;
+                        continue;
+                    }
+                    // POWER cards can empty a hand early, which ends our turns
+                    for (int round = 0; round < 5; round++) {
+                        if (!server.playCard(roomId, playerId, 0)) {
+                            break;
+                        }
+                    }
+                    // Probe a room likely owned by another thread; it may not exist yet
+                    std::string probe = "room_" + std::to_string(1 + (t * 7919 + g) % (THREADS * gamesPerThread));
+                    if (server.findRoom(probe)) {
+                        lookups++;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return failures.load();
+    });
+
+    size_t expected = THREADS * gamesPerThread;
+    size_t actual = server.getRoomCount();
+    std::cout << "  rooms " << actual << "/" << expected << ", failed ops " << failures.load()
+              << ", cross-thread lookups " << lookups.load() << std::endl;
+    return actual == expected && failures.load() == 0 && checkHandles(iterations);
+}
+
+// Message-passing throughput of the room executor: producer threads fire
+// asynchronous tasks at a set of rooms, and every room checks that tasks
+// from each producer arrive in the order they were sent. Returns false if
+// a task ran out of order.
+bool benchRooms(size_t iterations) {
+    const int PRODUCERS = 8;
+    const int ROOMS = 256;
+    GameServer server;
+    std::vector<std::string> roomIds;
+    for (int r = 0; r < ROOMS; r++) {
+        roomIds.push_back(server.createRoom(2));
+    }
+
+    // Indexed [room][producer]; each slot is only written by that room's worker
+    std::vector<std::vector<size_t>> lastSeen(ROOMS, std::vector<size_t>(PRODUCERS, 0));
+    std::atomic<size_t> completed(0);
+    std::atomic<size_t> reordered(0);
+    size_t perProducer = std::max<size_t>(ROOMS, iterations / PRODUCERS);
+
+    report("rooms/8 producers async submit", PRODUCERS * perProducer, [&] {
+        std::vector<std::thread> threads;
+        for (int p = 0; p < PRODUCERS; p++) {
+            threads.emplace_back([&, p] {
+                for (size_t i = 0; i < perProducer; i++) {
+                    int r = static_cast<int>((i * 31 + p) % ROOMS);
+                    size_t sequence = i + 1;
+                    server.submit(roomIds[r], [&, r, p, sequence](GameRoom&) {
+                        if (lastSeen[r][p] >= sequence) reordered++;
+                        lastSeen[r][p] = sequence;
+                        completed++;
+                    });
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        while (completed.load() < PRODUCERS * perProducer) {
+            std::this_thread::yield();
+        }
+        return reordered.load();
+    });
+
+    std::cout << "  completed " << completed.load() << "/" << PRODUCERS * perProducer
+              << ", reordered " << reordered.load() << std::endl;
+    return reordered.load() == 0;
+}
+
+// GET_STATE of a dealt two-player room: encoding the reply on every read
+// versus handing out the room's cached buffer.
+void benchState(size_t iterations) {
+    auto room = std::make_shared<GameRoom>("room_bench", 2);
+    room->addPlayer("player_1", "Alice");
+    room->startGame();
+    room->dealCards(GameServer::CARDS_PER_PLAYER);
+    room->publishChanges();
+
+    for (WireFormat format : { WireFormat::TEXT, WireFormat::BINARY }) {
+        const char* name = format == WireFormat::TEXT ? "json" : "binary";
+
+        report((std::string("state/") + name + " encode per read").c_str(), iterations, [&] {
+            size_t checksum = 0;
+            Reply reply;
+            reply.type = ReplyType::GAME_STATE;
+            reply.room = room;
+            for (size_t i = 0; i < iterations; i++) {
+                std::string encoded;
+                encodeReply(reply, format, encoded);
+                checksum += encoded.size();
+            }
+            return checksum;
+        });
+
+        report((std::string("state/") + name + " cached reply").c_str(), iterations, [&] {
+            size_t checksum = 0;
+            for (size_t i = 0; i < iterations; i++) {
+                SharedBuffer encoded = room->getStateReply(format);
+                checksum += encoded->size();
+            }
+            return checksum;
+        });
+    }
+}
+
+// The card layout before cards were packed: an int-sized enum and an int,
+// with hands in heap vectors
+struct LegacyCard {
+    Element element;
+    int strength;
+};
+
+// Dealing five cards, playing two and clearing the round, with the old
+// vector hands versus the inline one-byte card lists
+void benchCards(size_t iterations) {
+    std::cout << "  sizeof Card " << sizeof(Card) << " (was " << sizeof(LegacyCard) << "), sizeof Player "
+              << sizeof(Player) << std::endl;
+
+    report("cards/vector hand deal+play", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            std::vector<LegacyCard> hand;
+            std::vector<LegacyCard> played;
+            for (int c = 0; c < GameServer::CARDS_PER_PLAYER; c++) {
+                hand.push_back({ static_cast<Element>(c % 6), static_cast<int>(1 + (i + c) % 10) });
+            }
+            for (int index : { 2, 0 }) {
+                played.push_back(hand[index]);
+                hand.erase(hand.begin() + index);
+            }
+            for (const auto& card : played) checksum += card.strength;
+            checksum += hand.size();
+        }
+        return checksum;
+    });
+
+    report("cards/inline hand deal+play", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            Player::CardList hand;
+            Player::CardList played;
+            for (int c = 0; c < GameServer::CARDS_PER_PLAYER; c++) {
+                hand.push_back(Card(static_cast<Element>(c % 6), static_cast<int>(1 + (i + c) % 10)));
+            }
+            for (int index : { 2, 0 }) {
+                played.push_back(hand[index]);
+                hand.erase(index);
+            }
+            for (const auto& card : played) checksum += card.getStrength();
+            checksum += hand.size();
+        }
+        return checksum;
+    });
+}
+
+// Reads a number field out of a room's JSON state
+int stateField(const std::string& state, const std::string& field) {
+    size_t at = state.find("\"" + field + "\":");
+    return at == std::string::npos ? -1 : std::atoi(state.c_str() + at + field.size() + 3);
+}
+
+// Counts heap allocations while a two-player room plays whole games: the
+// human plays its first card and the AI answers, round after round. Card
+// play must not allocate at all, and setting up a game must cost the same
+// every time. Returns false otherwise.
+bool benchAllocations(size_t iterations) {
+    size_t games = std::max<size_t>(1, iterations / 1000);
+    size_t setupMin = SIZE_MAX, setupMax = 0, playMax = 0, rounds = 0, finished = 0;
+
+    // The thread's slab pool is set up by its first room, not counted here
+    GameRoom::create("room_alloc", 2, 0);
+    report("allocations/full games", games, [&] {
+        for (size_t g = 0; g < games; g++) {
+            size_t before = threadAllocations;
+            auto room = GameRoom::create("room_alloc", 2, g);
+            room->addPlayer("player_1", "Alice");
+            GameServer::startAndDeal(*room);
+            size_t setup = threadAllocations - before;
+            setupMin = std::min(setupMin, setup);
+            setupMax = std::max(setupMax, setup);
+
+            before = threadAllocations;
+            while (!room->isGameOver() && room->chooseCard("player_1", 0) && room->autoPlay()) {}
+            playMax = std::max(playMax, threadAllocations - before);
+
+            std::string state = room->getGameState();
+            rounds += stateField(state, "roundsPlayed");
+            finished += room->isGameOver() ? 1 : 0;
+        }
+        return rounds;
+    });
+
+    std::cout << "  " << finished << "/" << games << " games reached round 5, setup allocations "
+              << setupMin << "-" << setupMax << ", card play allocations at most " << playMax << std::endl;
+    return setupMin == setupMax && playMax == 0;
+}
+
+// Plays one seeded two-player game with both sides moving like the AI and
+// returns every intermediate state, joined
+std::string playSeededGame(uint64_t seed) {
+    GameRoom room("room_seeded", 2, seed);
+    room.addPlayer("player_1", "Alice");
+    GameServer::startAndDeal(room);
+    std::string transcript = room.getGameState();
+    while (!room.isGameOver() && room.autoPlay()) {
+        room.appendGameState(transcript);
+    }
+    return transcript;
+}
+
+// A random card pick as the game used to make it (a kernel-seeded
+// mt19937 per call) versus the room's generator, then the same seeds
+// replayed: returns false if two games with one seed differ at any step.
+bool benchRandom(size_t iterations) {
+    report("random/random_device+mt19937 per pick", iterations / 100, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations / 100; i++) {
+            std::random_device rd;
+            std::mt19937 gen(rd());
+            std::uniform_int_distribution<> dis(0, 4);
+            checksum += dis(gen);
+        }
+        return checksum;
+    });
+
+    GameRandom random(42);
+    report("random/room xoshiro256** pick", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            checksum += random.below(5);
+        }
+        return checksum;
+    });
+
+    size_t games = std::max<size_t>(1, iterations / 10000);
+    size_t mismatched = 0, distinct = 0;
+    std::string previous;
+    for (size_t g = 0; g < games; g++) {
+        std::string first = playSeededGame(g);
+        if (first != playSeededGame(g)) mismatched++;
+        if (first != previous) distinct++;
+        previous = std::move(first);
+    }
+    std::cout << "  " << games << " seeds replayed, " << mismatched << " diverged, " << distinct
+              << " distinct games" << std::endl;
+    return mismatched == 0 && distinct == games;
+}
+
+// Starting a game the way the server used to: rebuild the 60-card vector
+// with emplace_back, shuffle it with a fresh mt19937 and pop cards off
+size_t legacyStartAndDeal(std::vector<LegacyCard>& cards, int players) {
+    cards.clear();
+    for (int element = 0; element < 6; element++) {
+        for (int strength = 1; strength <= DECK_STRENGTHS; strength++) {
+            cards.push_back({ static_cast<Element>(element), strength });
+        }
+    }
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::shuffle(cards.begin(), cards.end(), gen);
+    size_t checksum = 0;
+    for (int i = 0; i < players * GameServer::CARDS_PER_PLAYER; i++) {
+        checksum += cards.back().strength;
+        cards.pop_back();
+    }
+    return checksum;
+}
+
+// The deck work of startGame+dealCards for a two-player room (reset,
+// shuffle, deal two hands): old versus new on one core, then the new path
+// on every core at once
+void benchDeck(size_t iterations) {
+    report("deck/legacy rebuild+shuffle+pop, 1 core", iterations / 10, [&] {
+        std::vector<LegacyCard> cards;
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations / 10; i++) {
+            checksum += legacyStartAndDeal(cards, 2);
+        }
+        return checksum;
+    });
+
+    auto startAndDeal = [](size_t rounds, uint64_t seed) {
+        Deck deck;
+        GameRandom random(seed);
+        size_t checksum = 0;
+        for (size_t i = 0; i < rounds; i++) {
+            deck.reset();
+            deck.shuffle(random);
+            for (int p = 0; p < 2; p++) {
+                Player::CardList hand;
+                deck.deal(GameServer::CARDS_PER_PLAYER, hand);
+                checksum += hand[0].getStrength();
+            }
+        }
+        return checksum;
+    };
+
+    report("deck/constexpr deck permutation, 1 core", iterations, [&] {
+        return startAndDeal(iterations, 1);
+    });
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> total(0);
+    report("deck/constexpr deck permutation, all cores", iterations * threads, [&] {
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] { total += startAndDeal(iterations, t); });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return total.load();
+    });
+    std::cout << "  " << threads << " cores" << std::endl;
+}
+
+// Stands in for a connection: counts what it is sent
+class CountingSession : public ClientSession {
+public:
+    size_t messages = 0;
+    size_t bytes = 0;
+
+    WireFormat getFormat() const override { return WireFormat::TEXT; }
+
+    bool push(SharedBuffer message, const void*) override {
+        messages++;
+        bytes += message->size();
+        return true;
+    }
+};
+
+// One room streamed to 10000 spectators: each state change encoded once and
+// shared, versus the per-client encode every GET_STATE poller costs. Also
+// checks that a reader that never drains keeps at most the latest state per
+// room. Returns false if it doesn't.
+bool benchFanout(size_t iterations) {
+    const int SPECTATORS = 10000;
+    size_t updates = std::max<size_t>(1, iterations / 10000);
+    auto room = std::make_shared<GameRoom>("room_bench", 4);
+    std::vector<std::shared_ptr<CountingSession>> sessions;
+    for (int i = 0; i < SPECTATORS; i++) {
+        sessions.push_back(std::make_shared<CountingSession>());
+        room->addSpectator(sessions.back());
+    }
+
+    report("fanout/10000 spectators shared buffer", updates * SPECTATORS, [&] {
+        for (size_t i = 0; i < updates; i++) {
+            if (i % 2 == 0) {
+                room->addPlayer("player_1", "Alice");
+            } else {
+                room->removePlayer("player_1");
+            }
+            room->publishChanges();
+        }
+        size_t checksum = 0;
+        for (const auto& session : sessions) checksum += session->messages;
+        return checksum;
+    });
+
+    report("fanout/10000 spectators encode each", updates * SPECTATORS, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < updates; i++) {
+            for (int s = 0; s < SPECTATORS; s++) {
+                std::string encoded;
+                encodeStateUpdate(*room, WireFormat::TEXT, encoded);
+                checksum += encoded.size();
+            }
+        }
+        return checksum;
+    });
+
+    // A stalled reader following 3 rooms through 1000 updates each
+    PushQueue stalled;
+    int streams[3];
+    std::vector<SharedBuffer> latest(3);
+    size_t dropped = 0;
+    for (int i = 0; i < 1000; i++) {
+        for (int r = 0; r < 3; r++) {
+            latest[r] = std::make_shared<std::string>(std::to_string(r) + ":" + std::to_string(i));
+            if (!stalled.push(latest[r], &streams[r])) dropped++;
+        }
+    }
+    bool kept = stalled.size() <= PushQueue::CAPACITY;
+    for (int r = 0; r < 3; r++) {
+        bool found = false;
+        for (size_t i = 0; i < stalled.size(); i++) {
+            found = found || stalled.pending(i) == *latest[r];
+        }
+        kept = kept && found;
+    }
+    std::cout << "  stalled reader: " << stalled.size() << " queued, " << dropped << " dropped, latest kept: "
+              << (kept ? "yes" : "no") << std::endl;
+    return kept;
+}
+
+// Timing wheel throughput on 1M timers spread over ~18 hours of 10ms ticks,
+// then room eviction on a live server with short TTLs: finished games go
+// first, then idle rooms, while rooms that keep changing survive. Returns
+// false if a timer fires off its tick or a room is evicted at the wrong time.
+bool benchLifecycle(size_t iterations) {
+    struct BenchTimer : TimingWheel::Timer {};
+    const uint64_t HORIZON = 1 << 22;
+    std::vector<BenchTimer> timers(iterations);
+    std::mt19937_64 rng(42);
+    TimingWheel wheel;
+    size_t misfired = 0;
+
+    report("lifecycle/timing wheel schedule+fire", iterations, [&] {
+        for (auto& timer : timers) {
+            wheel.schedule(&timer, 1 + rng() % HORIZON);
+        }
+        size_t fired = 0;
+        wheel.advance(HORIZON, [&](TimingWheel::Timer* timer) {
+            fired++;
+            if (timer->expiry != wheel.getNow()) misfired++;
+        });
+        return fired;
+    });
+
+    using std::chrono::milliseconds;
+    RoomLifecycle lifecycle;
+    lifecycle.idleTtl = milliseconds(1000);
+    lifecycle.finishedTtl = milliseconds(100);
+    GameServer server;
+    server.setLifecycle(lifecycle);
+
+    auto start = std::chrono::steady_clock::now();
+    auto sleepUntil = [&](int ms) { std::this_thread::sleep_until(start + milliseconds(ms)); };
+
+    // Play 2-player games; POWER cards can stall a game before it finishes
+    std::vector<std::string> finished, unfinished, idle, active;
+    for (int i = 0; i < 200; i++) {
+        std::string roomId = server.createRoom(2);
+        server.joinRoom(roomId, "player_1", "Stress");
+        server.startGame(roomId);
+        for (int round = 0; round < 5 && server.playCard(roomId, "player_1", 0); round++) {}
+        bool over = server.getRoomState(roomId).find("\"gameOver\":true") != std::string::npos;
+        (over ? finished : unfinished).push_back(roomId);
+    }
+    for (int i = 0; i < 1000; i++) idle.push_back(server.createRoom(4));
+    for (int i = 0; i < 100; i++) active.push_back(server.createRoom(4));
+
+    auto countLive = [&](const std::vector<std::string>& roomIds) {
+        size_t live = 0;
+        for (const auto& roomId : roomIds) {
+            if (server.findRoom(roomId)) live++;
+        }
+        return live;
+    };
+
+    sleepUntil(500);
+    bool ok = countLive(finished) == 0 && countLive(unfinished) == unfinished.size() &&
+              countLive(idle) == idle.size();
+
+    // Keep the active rooms changing past the idle TTL
+    for (int ms = 0; ms < 1200; ms += 100) {
+        for (const auto& roomId : active) {
+            server.joinRoom(roomId, "player_1", "Busy");
+            server.leaveRoom(roomId, "player_1");
+        }
+        sleepUntil(500 + ms + 100);
+    }
+    ok = ok && countLive(unfinished) == 0 && countLive(idle) == 0 && countLive(active) == active.size();
+
+    sleepUntil(3200);
+    ok = ok && server.getRoomCount() == 0 && server.getEvictedRoomCount() == server.getCreatedRoomCount();
+
+    std::cout << "  misfired timers " << misfired << ", " << finished.size() << " finished / "
+              << unfinished.size() << " unfinished games, evicted " << server.getEvictedRoomCount() << "/"
+              << server.getCreatedRoomCount() << " rooms in order: " << (ok ? "yes" : "no") << std::endl;
+    return ok && misfired == 0;
+}
+
+// Rooms whose human never plays: every turn times out and is auto-played,
+// and the AI answers after its think delay. Also checks that a human's
+// PLAY_CARD returns before the AI has moved. Returns false if a room made no
+// progress or the AI answered on the request path.
+bool benchTurns(size_t iterations) {
+    using std::chrono::milliseconds;
+    const int ROOMS = static_cast<int>(std::min<size_t>(1000, std::max<size_t>(10, iterations / 1000)));
+    TurnTiming timing;
+    timing.aiThinkDelay = milliseconds(20);
+    timing.turnTimeout = milliseconds(50);
+    GameServer server;
+    server.setTurnTiming(timing);
+    // Timers are what's measured here; the ai suite covers the search
+    AiSettings randomAi;
+    randomAi.rollouts = 0;
+    server.setAiSettings(randomAi);
+
+    std::string played = server.createRoom(2);
+    server.joinRoom(played, "player_1", "Quick");
+    server.startGame(played);
+    server.playCard(played, "player_1", 0);
+    bool async = stateField(server.getRoomState(played), "currentPlayer") == 1;
+
+    std::vector<std::string> roomIds;
+    report("turns/rooms started, all turns timed out", ROOMS, [&] {
+        for (int i = 0; i < ROOMS; i++) {
+            std::string roomId = server.createRoom(2);
+            server.joinRoom(roomId, "player_1", "Asleep");
+            server.startGame(roomId);
+            roomIds.push_back(roomId);
+        }
+        // Five rounds of timeout plus think delay, with room to spare
+        std::this_thread::sleep_for(milliseconds(1000));
+        return roomIds.size();
+    });
+
+    size_t stalled = 0, finished = 0;
+    for (const auto& roomId : roomIds) {
+        std::string state = server.getRoomState(roomId);
+        if (stateField(state, "roundsPlayed") < 1) stalled++;
+        if (state.find("\"gameOver\":true") != std::string::npos) finished++;
+    }
+
+    Scheduler::LagStats lag = server.getTimerLag();
+    auto lagUs = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    };
+    std::cout << "  AI moved after reply: " << (async ? "yes" : "no") << ", " << finished << "/" << ROOMS
+              << " games finished, " << stalled << " stalled, " << server.getTimedOutTurnCount()
+              << " turns timed out, timer lag avg " << (lag.fired ? lagUs(lag.total) / lag.fired : 0)
+              << "us max " << lagUs(lag.max) << "us over " << lag.fired << " timers" << std::endl;
+    return async && stalled == 0;
+}
+
+// Plays rooms move for move through GameRoom and through a BatchEngine
+// resolving with the given kernel, comparing hands, scores, rounds and
+// game over after every round. Returns the number of rooms that differed.
+size_t crossCheckBatch(size_t rooms, BatchEngine::Kernel kernel) {
+    BatchEngine engine(rooms);
+    std::vector<std::shared_ptr<GameRoom>> gameRooms;
+    std::vector<GameRandom> picks;
+    for (size_t i = 0; i < rooms; i++) {
+        uint64_t seed = 1000 + i;
+        auto room = std::make_shared<GameRoom>("room_batch", 2, seed);
+        room->addPlayer("seat_1", "Seat 1");
+        GameServer::startAndDeal(*room);
+        gameRooms.push_back(room);
+        engine.deal(i, seed);
+        picks.emplace_back(~seed);
+    }
+
+    std::vector<bool> differs(rooms, false);
+    auto compare = [&](size_t i) {
+        const GameRoom& room = *gameRooms[i];
+        Player* seats[2] = { room.getPlayer("seat_1"), room.getPlayer("ai_player") };
+        bool same = room.getRoundsPlayed() == engine.getRoundsPlayed(i) && room.isGameOver() == engine.isGameOver(i);
+        for (int seat = 0; seat < 2; seat++) {
+            const Player::CardList& hand = seats[seat]->getHand();
+            same = same && seats[seat]->getScore() == engine.getScore(i, seat) &&
+                   hand.size() == engine.getHandSize(i, seat);
+            for (size_t c = 0; same && c < hand.size(); c++) {
+                same = hand[c].toByte() == engine.getCard(i, seat, c).toByte();
+            }
+        }
+        if (!same) differs[i] = true;
+    };
+
+    for (int round = 0; round < GameRoom::ROUNDS_PER_GAME; round++) {
+        for (int seat = 0; seat < 2; seat++) {
+            for (size_t i = 0; i < rooms; i++) {
+                GameRoom& room = *gameRooms[i];
+                auto player = room.getCurrentPlayer();
+                if (room.isGameOver() || player->getHand().empty()) continue;
+                int pick = static_cast<int>(picks[i].below(static_cast<uint32_t>(player->getHand().size())));
+                room.chooseCard(player->getId(), pick);
+                engine.play(i, seat, pick);
+            }
+        }
+        engine.resolve(kernel);
+        for (size_t i = 0; i < rooms; i++) {
+            compare(i);
+        }
+    }
+    return std::count(differs.begin(), differs.end(), true);
+}
+
+// Resolving one round in many rooms: GameRoom::resolveRound room by room,
+// then the batch engine's scalar and AVX2 kernels, then a move-for-move
+// cross-check of each kernel against GameRoom. Returns false on any
+// difference.
+bool benchBatch(size_t iterations) {
+    const size_t ROOMS = std::min<size_t>(iterations, 100000);
+    const size_t reps = std::max<size_t>(1, iterations / ROOMS);
+    using Clock = std::chrono::steady_clock;
+    auto print = [&](const std::string& name, Clock::duration elapsed, size_t checksum) {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        std::cout << name << ": " << static_cast<long long>(ROOMS * reps / seconds) << " ops/s"
+                  << " (" << seconds * 1e3 << " ms, checksum " << checksum << ")" << std::endl;
+    };
+
+    // Both seats have played their first card in every room; only the
+    // resolution itself is timed
+    std::vector<std::shared_ptr<GameRoom>> gameRooms;
+    for (size_t i = 0; i < ROOMS; i++) {
+        gameRooms.push_back(std::make_shared<GameRoom>("room_batch", 2, i));
+        gameRooms.back()->addPlayer("seat_1", "Seat 1");
+        GameServer::startAndDeal(*gameRooms.back());
+    }
+    Clock::duration elapsed{};
+    size_t checksum = 0;
+    for (size_t r = 0; r < reps; r++) {
+        for (auto& room : gameRooms) {
+            for (const char* id : { "seat_1", "ai_player" }) {
+                auto player = room->getPlayer(id);
+                player->addPlayedCard(player->getHand()[r % GameServer::CARDS_PER_PLAYER]);
+                player->setChosenCard(static_cast<int>(r % GameServer::CARDS_PER_PLAYER));
+            }
+        }
+        auto start = Clock::now();
+        for (auto& room : gameRooms) {
+            room->resolveRound();
+        }
+        elapsed += Clock::now() - start;
+    }
+    for (auto& room : gameRooms) {
+        checksum += room->getPlayer("seat_1")->getScore();
+    }
+    print("batch/GameRoom::resolveRound per room", elapsed, checksum);
+
+    BatchEngine base(ROOMS);
+    for (size_t i = 0; i < ROOMS; i++) {
+        base.deal(i, i);
+    }
+    for (auto kernel : { BatchEngine::Kernel::SCALAR, BatchEngine::Kernel::AVX2 }) {
+        if (!BatchEngine::isAvailable(kernel)) {
+            std::cout << "batch/" << BatchEngine::kernelName(kernel) << " kernel: not supported on this CPU"
+                      << std::endl;
+            continue;
+        }
+        BatchEngine engine = base;
+        elapsed = Clock::duration{};
+        checksum = 0;
+        for (size_t r = 0; r < reps; r++) {
+            for (size_t i = 0; i < ROOMS; i++) {
+                engine.play(i, 0, 0);
+                engine.play(i, 1, 0);
+            }
+            auto start = Clock::now();
+            engine.resolve(kernel);
+            elapsed += Clock::now() - start;
+            // Hands run out after five rounds; start the games over
+            if (r % GameServer::CARDS_PER_PLAYER == GameServer::CARDS_PER_PLAYER - 1 || r + 1 == reps) {
+                for (size_t i = 0; i < ROOMS; i++) {
+                    checksum += engine.getScore(i, 0);
+                }
+                engine = base;
+            }
+        }
+        print(std::string("batch/") + BatchEngine::kernelName(kernel) + " kernel per room", elapsed, checksum);
+    }
+
+    // An odd room count so the last kernel step is partly padding
+    const size_t CHECKED = 4099;
+    bool ok = true;
+    for (auto kernel : { BatchEngine::Kernel::SCALAR, BatchEngine::Kernel::AVX2 }) {
+        if (!BatchEngine::isAvailable(kernel)) continue;
+        size_t differs = crossCheckBatch(CHECKED, kernel);
+        std::cout << "  " << BatchEngine::kernelName(kernel) << " vs GameRoom: " << CHECKED << " games, " << differs
+                  << " differed" << std::endl;
+        ok = ok && differs == 0;
+    }
+    return ok;
+}
+
+// Plays a two-player room to the end with seat 1 picking at random and the
+// AI seat searching; returns 1 if the AI won, 0 for a tie or loss and -1 if
+// a hand ran out first
+int playSearchGame(uint64_t seed, const AiSettings& settings) {
+    GameRoom room("room_ai", 2, seed);
+    room.addPlayer("seat_1", "Seat 1");
+    GameServer::startAndDeal(room);
+    GameRandom picks(~seed);
+    while (!room.isGameOver()) {
+        auto player = room.getCurrentPlayer();
+        if (player->getHand().empty()) return -1;
+        int choice = static_cast<int>(picks.below(static_cast<uint32_t>(player->getHand().size())));
+        SearchPosition position;
+        if (player->isAI() && makeSearchPosition(room, position)) {
+            choice = AiSearch::searchNow(position, settings, picks.next()).cardIndex;
+        }
+        room.chooseCard(player->getId(), choice);
+    }
+    auto winner = room.getWinner();
+    return winner && winner->isAI() ? 1 : 0;
+}
+
+// Search cost per move on one core, how often the searching AI beats a
+// random player, and a server full of AI games searching on its pool.
+// Returns false if the AI wins no more than a random player would or a
+// server room never gets an AI move.
+bool benchAi(size_t iterations) {
+    AiSettings settings;
+    settings.budget = std::chrono::steady_clock::duration::zero();
+    size_t moves = std::max<size_t>(10, iterations / 1000);
+    std::vector<SearchPosition> positions;
+    for (size_t i = 0; positions.size() < moves; i++) {
+        GameRoom room("room_ai", 2, i);
+        room.addPlayer("seat_1", "Seat 1");
+        GameServer::startAndDeal(room);
+        room.chooseCard("seat_1", static_cast<int>(i % GameServer::CARDS_PER_PLAYER));
+        SearchPosition position;
+        if (makeSearchPosition(room, position)) positions.push_back(position);
+    }
+    report("ai/search move, 2048 rollouts, 1 core", moves, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < moves; i++) {
+            checksum += AiSearch::searchNow(positions[i], settings, i).cardIndex;
+        }
+        return checksum;
+    });
+
+    settings.rollouts = 512;
+    size_t games = std::max<size_t>(100, iterations / 2000);
+    size_t won = 0, finished = 0;
+    report("ai/games against a random player, 512 rollouts", games, [&] {
+        for (size_t g = 0; g < games; g++) {
+            int result = playSearchGame(g, settings);
+            if (result < 0) continue;
+            finished++;
+            won += result;
+        }
+        return won;
+    });
+    double winRate = finished ? 100.0 * won / finished : 0.0;
+    std::cout << "  AI won " << winRate << "% of " << finished << " finished games" << std::endl;
+
+    // Every room's human times out and is played at random; the AI answers
+    // through the server's search pool with the default settings
+    const int ROOMS = static_cast<int>(std::min<size_t>(1000, std::max<size_t>(10, iterations / 1000)));
+    TurnTiming timing;
+    timing.turnTimeout = std::chrono::milliseconds(20);
+    GameServer server;
+    server.setTurnTiming(timing);
+    std::vector<std::string> roomIds;
+    report("ai/server rooms playing out with searching AI", ROOMS, [&] {
+        for (int i = 0; i < ROOMS; i++) {
+            std::string roomId = server.createRoom(2);
+            server.joinRoom(roomId, "player_1", "Asleep");
+            server.startGame(roomId);
+            roomIds.push_back(roomId);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        return roomIds.size();
+    });
+    size_t answered = 0, over = 0;
+    for (const auto& roomId : roomIds) {
+        std::string state = server.getRoomState(roomId);
+        if (stateField(state, "roundsPlayed") >= 1) answered++;
+        if (state.find("\"gameOver\":true") != std::string::npos) over++;
+    }
+    std::cout << "  " << answered << "/" << ROOMS << " rooms got AI moves, " << over << " games finished"
+              << std::endl;
+    return winRate > 60.0 && answered == static_cast<size_t>(ROOMS);
+}
+
+// Plays a room with seat 1 at random until the AI seat is to move in the
+// given round; false if the game ends or stalls first
+bool playToRound(GameRoom& room, int round, GameRandom& picks) {
+    room.addPlayer("seat_1", "Seat 1");
+    GameServer::startAndDeal(room);
+    while (!room.isGameOver()) {
+        auto player = room.getCurrentPlayer();
+        if (player->getHand().empty()) return false;
+        if (player->isAI() && room.getRoundsPlayed() == round) return true;
+        room.chooseCard(player->getId(), static_cast<int>(picks.below(static_cast<uint32_t>(player->getHand().size()))));
+    }
+    return false;
+}
+
+// Exact endgame solves: cost per move by round for the AI seat, and whether
+// the expected scores the solver predicts are borne out. From round 2 the
+// AI solves every move against a random player; its first prediction,
+// averaged over all games, must land within 0.03 of the average outcome
+// (stalled games scored as they stand).
+bool benchEndgame(size_t iterations) {
+    size_t solvesPerRound = std::max<size_t>(10, iterations / 5000);
+    bool ok = true;
+    for (int round = 1; round < GameRoom::ROUNDS_PER_GAME; round++) {
+        std::vector<SearchPosition> positions;
+        for (uint64_t seed = 1; positions.size() < solvesPerRound; seed++) {
+            GameRoom room("room_solve", 2, seed);
+            GameRandom picks(seed);
+            SearchPosition position;
+            if (playToRound(room, round, picks) && makeSearchPosition(room, position)) {
+                positions.push_back(position);
+            }
+        }
+        // One table for the whole round, as a search thread keeps it
+        EndgameSolver solver;
+        uint64_t nodes = 0;
+        std::string name = "endgame/solve second seat, round " + std::to_string(round + 1);
+        report(name.c_str(), positions.size(), [&] {
+            size_t checksum = 0;
+            for (const auto& position : positions) {
+                EndgameSolver::Result result;
+                if (solver.solve(position, result)) {
+                    checksum += result.cardIndex;
+                } else {
+                    ok = false;
+                }
+                nodes += solver.getNodeCount();
+            }
+            return checksum;
+        });
+        std::cout << "  " << nodes / positions.size() << " positions visited per solve" << std::endl;
+    }
+
+    size_t games = std::max<size_t>(3000, iterations / 100);
+    EndgameSolver solver;
+    double predicted = 0, actual = 0;
+    size_t played = 0;
+    report("endgame/games solved from round 3 against a random player", games, [&] {
+        for (uint64_t seed = 1; seed <= games; seed++) {
+            GameRoom room("room_solve", 2, seed);
+            GameRandom picks(~seed);
+            if (!playToRound(room, 2, picks)) continue;
+            bool first = true;
+            while (!room.isGameOver()) {
+                auto player = room.getCurrentPlayer();
+                if (player->getHand().empty()) break;
+                int choice = static_cast<int>(picks.below(static_cast<uint32_t>(player->getHand().size())));
+                SearchPosition position;
+                EndgameSolver::Result result;
+                if (player->isAI() && makeSearchPosition(room, position) && solver.solve(position, result)) {
+                    if (first) predicted += result.expectedScore;
+                    first = false;
+                    choice = result.cardIndex;
+                }
+                room.chooseCard(player->getId(), choice);
+            }
+            int ai = room.getPlayers()[1]->getScore(), human = room.getPlayers()[0]->getScore();
+            actual += ai > human ? 1.0 : ai == human ? 0.5 : 0.0;
+            played++;
+        }
+        return played;
+    });
+    predicted /= played;
+    actual /= played;
+    std::cout << "  predicted expected score " << predicted << ", actual " << actual << std::endl;
+    return ok && std::abs(predicted - actual) <= 0.03;
+}
+
+// selectAICard's score for one card, term by term as the JS writes it
+double referenceScore(const PersonalitySpec& spec, Card card, const PersonalityContext& context) {
+    static const Element COUNTERED[][2] = {
+        { Element::ICE, Element::WATER }, { Element::ELECTRICITY, Element::FIRE },
+        { Element::EARTH, Element::ELECTRICITY }, { Element::EARTH, Element::WATER },
+        { Element::FIRE, Element::ICE }
+    };
+    int element = static_cast<int>(card.getElement());
+    double score = card.getStrength();
+    if (spec.preferredElements & (1u << element)) {
+        score += 3;
+    }
+    if (context.opponentElement != PersonalityContext::NO_ELEMENT && card.getElement() != Element::POWER) {
+        for (Element countered : COUNTERED[element]) {
+            if (static_cast<int>(countered) == context.opponentElement) score += spec.counterPriority * 5;
+        }
+    }
+    if (spec.comboFocus && context.lastElement == element) {
+        score += 4;
+    }
+    if (card.getElement() == Element::POWER) {
+        score += spec.aggressiveness * 3;
+    }
+    if (spec.exploitative) {
+        if (context.margin > 0) score *= 1 - spec.conservativeness;
+        else if (context.margin < 0) score *= 1 + spec.aggressiveness;
+    }
+    if (spec.defensive && context.margin < 0) {
+        score += card.getStrength() * 0.5;
+    }
+    return score;
+}
+
+// The compiled personality tables against a direct transcription of the JS
+// scoring, for every card in every context, then the cost of a choice.
+bool benchPersonalities(size_t iterations) {
+    PersonalityTable table = PersonalityTable::builtin();
+    bool ok = table.all().size() == 9;
+    size_t checked = 0;
+    for (const auto& personality : table.all()) {
+        for (int opponent = 0; opponent <= PersonalityContext::NO_ELEMENT; opponent++) {
+            for (int last = 0; last <= PersonalityContext::NO_ELEMENT; last++) {
+                for (int margin = -2; margin <= 2; margin += 2) {
+                    PersonalityContext context{ opponent, last, margin };
+                    for (const Card& card : ELEMENTAL_DECK) {
+                        double expected = referenceScore(personality.getSpec(), card, context);
+                        if (std::abs(personality.score(card, context) - expected) > 1e-4) {
+                            std::cout << "  " << personality.getKey() << " scores " << card.toString()
+                                      << " as " << personality.score(card, context) << ", expected " << expected << std::endl;
+                            ok = false;
+                        }
+                        checked++;
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "personalities/scores checked against the reference: " << checked
+              << (ok ? " (all match)" : " (MISMATCH)") << std::endl;
+
+    // Random hands in random contexts
+    const size_t HANDS = 1024;
+    std::vector<Player::CardList> hands(HANDS);
+    std::vector<PersonalityContext> contexts(HANDS);
+    GameRandom deal(7);
+    for (size_t i = 0; i < HANDS; i++) {
+        for (int c = 0; c < GameServer::CARDS_PER_PLAYER; c++) {
+            hands[i].push_back(ELEMENTAL_DECK[deal.below(DECK_SIZE)]);
+        }
+        contexts[i] = { static_cast<int>(deal.below(7)), static_cast<int>(deal.below(7)),
+                        static_cast<int>(deal.below(5)) - 2 };
+    }
+    const AiPersonality* nexus = table.find("NEXUS");
+    GameRandom random(11);
+    report("personalities/chooseCard (NEXUS, 5-card hands)", iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            checksum += nexus->chooseCard(hands[i % HANDS], contexts[i % HANDS], random);
+        }
+        return checksum;
+    });
+    report("personalities/reference scoring and sort (NEXUS, 5-card hands)", iterations, [&] {
+        size_t checksum = 0;
+        std::vector<std::pair<double, int>> scores;
+        for (size_t i = 0; i < iterations; i++) {
+            const auto& hand = hands[i % HANDS];
+            scores.clear();
+            for (size_t c = 0; c < hand.size(); c++) {
+                scores.emplace_back(referenceScore(nexus->getSpec(), hand[c], contexts[i % HANDS]), static_cast<int>(c));
+            }
+            std::stable_sort(scores.begin(), scores.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+            checksum += scores[0].second;
+        }
+        return checksum;
+    });
+    return ok;
+}
+
+// Lobby listings among many started games: a page from the lobby snapshot
+// versus the registry scan getAvailableRooms used to do, then concurrent
+// quick-match players. Returns false if the lobby lists the wrong rooms or
+// a quick-match player isn't seated, or is seated with more than one other.
+bool benchLobby(size_t iterations) {
+    const size_t OPEN_ROOMS = 100;
+    size_t startedRooms = std::max<size_t>(10000, iterations / 100);
+    TurnTiming timing;
+    timing.quickMatchWait = std::chrono::milliseconds(50);
+    GameServer server;
+    server.setTurnTiming(timing);
+
+    // The same rooms in a registry of our own, scanned the old way
+    RoomRegistry scanned;
+    for (size_t i = 0; i < startedRooms; i++) {
+        std::string roomId = server.createRoom(2);
+        server.joinRoom(roomId, "player_1", "Lobby");
+        server.startGame(roomId);
+        scanned.insert(roomId, server.findRoom(roomId));
+    }
+    for (size_t i = 0; i < OPEN_ROOMS; i++) {
+        std::string roomId = server.createRoom(4);
+        scanned.insert(roomId, server.findRoom(roomId));
+    }
+    bool ok = server.getOpenRooms()->size() == OPEN_ROOMS;
+
+    std::string name = "lobby/list a page of 20 among " + std::to_string(startedRooms) + " started rooms";
+    report(name.c_str(), iterations, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < iterations; i++) {
+            Lobby::Snapshot rooms = server.getOpenRooms();
+            checksum += std::min<size_t>(DEFAULT_ROOM_LIST_LIMIT, rooms->size());
+        }
+        return checksum;
+    });
+    size_t scans = std::max<size_t>(10, iterations / 10000);
+    report("lobby/old registry scan for open rooms", scans, [&] {
+        size_t checksum = 0;
+        for (size_t i = 0; i < scans; i++) {
+            std::vector<std::string> available;
+            scanned.forEach([&](const std::shared_ptr<GameRoom>& room) {
+                if (!room->isGameStarted()) {
+                    available.push_back(room->getRoomId());
+                }
+            });
+            checksum += available.size();
+        }
+        return checksum;
+    });
+
+    const int THREADS = 8;
+    size_t playersPerThread = std::max<size_t>(100, iterations / 1000);
+    size_t players = THREADS * playersPerThread;
+    std::vector<std::string> seated(players);
+    std::atomic<size_t> answered(0);
+    report("lobby/quick-match players from 8 threads", players, [&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t] {
+                for (size_t p = t * playersPerThread; p < (t + 1) * playersPerThread; p++) {
+                    server.quickMatch("player_" + std::to_string(p), "Quick", [&, p](const std::string& roomId) {
+                        seated[p] = roomId;
+                        answered.fetch_add(1, std::memory_order_release);
+                    });
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (answered.load(std::memory_order_acquire) < players && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        return answered.load();
+    });
+
+    std::map<std::string, int> seats;
+    for (const auto& roomId : seated) {
+        seats[roomId]++;
+    }
+    size_t againstAi = 0;
+    for (const auto& [roomId, count] : seats) {
+        ok = ok && !roomId.empty() && count <= 2;
+        againstAi += count == 1 ? 1 : 0;
+    }
+    ok = ok && answered.load() == players && server.getOpenRooms()->size() == OPEN_ROOMS;
+    std::cout << "  " << answered.load() << "/" << players << " quick-match players seated in " << seats.size()
+              << " rooms, " << againstAi << " against the AI" << std::endl;
+    return ok;
+}
+
+// One room's whole life: created, joined, started, played out and dropped
+template <typename Create>
+size_t churnRoom(Create&& create, uint64_t seed) {
+    std::shared_ptr<GameRoom> room = create(seed);
+    room->addPlayer("player_1", "Alice");
+    GameServer::startAndDeal(*room);
+    while (!room->isGameOver() && room->chooseCard("player_1", 0) && room->autoPlay()) {}
+    return room->getRoundsPlayed();
+}
+
+// Room churn with rooms from the slab pool versus make_shared, then rooms
+// created on one thread and dropped on others, as the server does with
+// rooms it creates on network threads and evicts from room workers: returns
+// false if the two play out differently or the pool doesn't get every block
+// back.
+bool benchPool(size_t iterations) {
+    size_t rooms = std::max<size_t>(1000, iterations / 10);
+    size_t baseline = SlabPool::getStats().blocksInUse;
+    size_t pooledRounds = 0, heapRounds = 0;
+
+    report("pool/room churn, pooled", rooms, [&] {
+        size_t count = 0;
+        for (size_t i = 0; i < rooms; i++) {
+            count += churnRoom([](uint64_t seed) { return GameRoom::create("room_pool", 2, seed); }, i);
+        }
+        pooledRounds = count;
+        return count;
+    });
+    report("pool/room churn, make_shared", rooms, [&] {
+        size_t count = 0;
+        for (size_t i = 0; i < rooms; i++) {
+            count += churnRoom([](uint64_t seed) { return std::make_shared<GameRoom>("room_heap", 2, seed); }, i);
+        }
+        heapRounds = count;
+        return count;
+    });
+    bool ok = pooledRounds == heapRounds && SlabPool::getStats().blocksInUse == baseline;
+
+    // A few slabs' worth alive at once, then all handed to other threads
+    const int THREADS = 4;
+    size_t live = std::max<size_t>(1000, iterations / 100);
+    std::vector<std::shared_ptr<GameRoom>> created;
+    for (size_t i = 0; i < live; i++) {
+        created.push_back(GameRoom::create("room_" + std::to_string(i), 2, i));
+    }
+    SlabPool::Stats full = SlabPool::getStats();
+    ok = ok && full.blocksInUse == baseline + live;
+
+    report("pool/rooms dropped on other threads", live, [&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t] {
+                for (size_t i = t; i < live; i += THREADS) {
+                    created[i].reset();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return live;
+    });
+    // Reused from the return list rather than new slabs
+    for (size_t i = 0; i < live; i++) {
+        created[i] = GameRoom::create("room_" + std::to_string(i), 2, i);
+    }
+    SlabPool::Stats reused = SlabPool::getStats();
+    ok = ok && reused.slabs == full.slabs && reused.blocksInUse == baseline + live;
+    created.clear();
+
+    SlabPool::Stats after = SlabPool::getStats();
+    ok = ok && after.blocksInUse == baseline;
+    std::cout << "  " << rooms << " rooms churned each way; " << after.pools << " pools, "
+              << after.slabs << " slabs (" << after.bytesReserved / 1024 << " KiB), " << after.blocksInUse
+              << " blocks in use, " << after.blocksFree << " free" << std::endl;
+    return ok;
+}
+
+// Plays room to the end, player_1 always playing its first card
+size_t playOut(GameRoom& room) {
+    room.addPlayer("player_1", "Alice");
+    GameServer::startAndDeal(room);
+    while (!room.isGameOver() && room.chooseCard("player_1", 0) && room.autoPlay()) {}
+    return room.getRoundsPlayed();
+}
+
+// Raw appends to a journal with small segments, from one thread and from 8,
+// then what journaling adds to a game, then a GameServer's rooms rebuilt
+// from its journal: returns false if a record is lost or a rebuilt room's
+// state differs from the live room's.
+bool benchJournal(size_t iterations) {
+    auto directory = std::filesystem::temp_directory_path() /
+                     ("card_game_bench_journal_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    JournalSettings settings;
+    settings.directory = (directory / "raw").string();
+    settings.segmentSize = 4 * 1024 * 1024;
+    EventJournal journal;
+    std::string error;
+    if (!journal.open(settings, error)) {
+        std::cout << "  cannot open a journal: " << error << std::endl;
+        return false;
+    }
+
+    auto appendPlay = [&](uint64_t room, size_t i) {
+        journal.append(JournalEvent::CARD_PLAYED, room, [&](std::string& out) {
+            appendVarint(out, i & 1);
+            appendVarint(out, i % 5);
+            out.push_back(static_cast<char>(ELEMENTAL_DECK[i % DECK_SIZE].toByte()));
+            out.push_back(static_cast<char>(0xFF));
+            out.push_back(static_cast<char>(0xFF));
+            out.push_back(0);
+        });
+    };
+    report("journal/append, 1 thread", iterations, [&] {
+        for (size_t i = 0; i < iterations; i++) {
+            appendPlay(1, i);
+        }
+        return iterations;
+    });
+    const int THREADS = 8;
+    size_t perThread = std::max<size_t>(1, iterations / THREADS);
+    report("journal/append, 8 threads", perThread * THREADS, [&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t] {
+                for (size_t i = 0; i < perThread; i++) {
+                    appendPlay(t + 2, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return perThread * THREADS;
+    });
+    journal.sync();
+    EventJournal::Stats written = journal.getStats();
+    journal.close();
+
+    JournalReader::Summary summary;
+    uint64_t expected = 1, outOfOrder = 0;
+    bool ok = JournalReader::read(settings.directory, [&](const JournalRecord& record) {
+        outOfOrder += record.sequence == expected ? 0 : 1;
+        expected = record.sequence + 1;
+    }, summary, error);
+    ok = ok && written.dropped == 0 && summary.records == written.records && outOfOrder == 0 && summary.tornSegments == 0;
+    std::cout << "  " << summary.records << "/" << written.records << " records read back from " << summary.segments
+              << " segments, " << written.flushes << " flushes, " << written.bytes / std::max<uint64_t>(1, written.records)
+              << " bytes per record" << std::endl;
+
+    // A game is about 30 records
+    size_t games = std::max<size_t>(100, iterations / 100);
+    EventJournal gameJournal;
+    settings.directory = (directory / "games").string();
+    ok = gameJournal.open(settings, error) && ok;
+    double plain = 0, journaled = 0;
+    size_t checksum = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t g = 0; g < games; g++) {
+            auto room = GameRoom::create("room_" + std::to_string(g), 2, g);
+            if (pass == 1) {
+                room->setJournal(&gameJournal);
+            }
+            checksum += playOut(*room);
+        }
+        (pass == 0 ? plain : journaled) = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    size_t records = gameJournal.getStats().records - 1;
+    std::cout << "journal/full games: " << static_cast<long long>(games / plain) << " games/s plain, "
+              << static_cast<long long>(games / journaled) << " journaled; " << records / games << " records and "
+              << (journaled - plain) * 1e9 / std::max<size_t>(1, records) << " ns per record (checksum " << checksum
+              << ")" << std::endl;
+    gameJournal.close();
+
+    // A server's rooms, some with personalities, one a player left and one
+    // a player joined twice, rebuilt from its journal
+    size_t rooms = std::max<size_t>(50, iterations / 2000);
+    GameServer server;
+    AiSettings ai;
+    ai.rollouts = 0;
+    server.setAiSettings(ai);
+    settings.directory = (directory / "server").string();
+    ok = server.openJournal(settings, error) && ok;
+    PersonalityTable builtin = PersonalityTable::builtin();
+    std::vector<std::string> roomIds;
+    for (size_t r = 0; r < rooms; r++) {
+        const AiPersonality* personality =
+            r % 3 == 0 ? server.findPersonality(builtin.all()[r % builtin.all().size()].getKey()) : nullptr;
+        std::string roomId = server.createRoom(2, r, personality);
+        server.joinRoom(roomId, "player_1", "Alice");
+        server.startGame(roomId);
+        roomIds.push_back(roomId);
+    }
+    std::string leftId = server.createRoom(4, 99);
+    server.joinRoom(leftId, "player_1", "Alice");
+    server.joinRoom(leftId, "player_2", "Bob");
+    server.leaveRoom(leftId, "player_1");
+    roomIds.push_back(leftId);
+    // The server doesn't turn a repeated player id away, so neither may replay
+    std::string twiceId = server.createRoom(4, 98);
+    server.joinRoom(twiceId, "player_1", "Alice");
+    server.joinRoom(twiceId, "player_1", "Alice");
+    roomIds.push_back(twiceId);
+    for (int move = 0; move < 2 * GameRoom::ROUNDS_PER_GAME; move++) {
+        for (size_t r = 0; r < rooms; r++) {
+            server.playCard(roomIds[r], "player_1", 0);
+        }
+    }
+    server.getJournal()->sync();
+
+    JournalReplay replay;
+    summary = JournalReader::Summary();
+    ok = JournalReader::read(settings.directory, [&](const JournalRecord& record) { replay.apply(record); },
+                             summary, error) && ok;
+    size_t same = 0;
+    for (const auto& roomId : roomIds) {
+        auto rebuilt = replay.find(roomId);
+        same += rebuilt && rebuilt->room->getGameState() == server.getRoomState(roomId) ? 1 : 0;
+    }
+    for (const auto& mismatch : replay.getMismatches()) {
+        std::cout << "  " << mismatch << std::endl;
+    }
+    ok = ok && same == roomIds.size() && replay.getMismatches().empty();
+    std::cout << "  " << same << "/" << roomIds.size() << " rooms rebuilt from " << summary.records
+              << " journal records match the live rooms" << std::endl;
+
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+    return ok;
+}
+
+// A room record with one of its leading fields (0 the room id, then the
+// seed, players, flags, rounds, current player, played-card mask, turn,
+// version, joins, personality key, the four generator words and how far
+// the deck is dealt) set to value
+std::string withRecordField(const std::string& record, int field, uint64_t value) {
+    static const char LAYOUT[] = "svvbvvvvvvsvvvvv";
+    BinaryReader in(record);
+    size_t start = 0;
+    for (int i = 0; i <= field; i++) {
+        start = record.size() - in.remaining().size();
+        if (LAYOUT[i] == 's') {
+            in.readString();
+        } else if (LAYOUT[i] == 'b') {
+            in.readByte();
+        } else {
+            in.readVarint64();
+        }
+    }
+    size_t end = record.size() - in.remaining().size();
+    std::string changed = record.substr(0, start);
+    if (LAYOUT[field] == 'b') {
+        changed.push_back(static_cast<char>(value));
+    } else {
+        appendVarint(changed, value);
+    }
+    return changed + record.substr(end);
+}
+
+// Every one-byte change to a mid-game record either fails to restore or
+// restores a room a game could reach: deck cards only, no more rounds or
+// points than a game has. Then fields set out of step with the rest of
+// the record, which must all be rejected. Returns false if a change
+// slips through.
+bool checkSnapshotRecords() {
+    auto room = GameRoom::create("room_1", 2, 7);
+    room->addPlayer("player_1", "Alice");
+    GameServer::startAndDeal(*room);
+    for (int m = 0; m < 2 && room->chooseCard("player_1", 0) && room->autoPlay(); m++) {}
+    room->chooseCard("player_1", 0);
+    std::string record;
+    room->appendSnapshot(record);
+
+    auto isDeckCard = [](const Card& card) {
+        return std::any_of(ELEMENTAL_DECK.begin(), ELEMENTAL_DECK.end(),
+                           [&](const Card& deckCard) { return deckCard.toByte() == card.toByte(); });
+    };
+    size_t rejected = 0;
+    size_t unreachable = 0;
+    std::string key;
+    for (size_t i = 0; i < record.size(); i++) {
+        std::string changed = record;
+        for (int value = 0; value < 256; value++) {
+            changed[i] = static_cast<char>(value);
+            auto restored = GameRoom::restore(changed, key);
+            if (!restored) {
+                rejected++;
+                continue;
+            }
+            bool reachable = restored->getRoundsPlayed() <= GameRoom::ROUNDS_PER_GAME;
+            for (const Player* player : restored->getPlayers()) {
+                reachable = reachable && player->getScore() <= GameRoom::ROUNDS_PER_GAME;
+                for (const auto* cards : {&player->getHand(), &player->getPlayedCards()}) {
+                    reachable = reachable && std::all_of(cards->begin(), cards->end(), isDeckCard);
+                }
+                for (const Card* card : {player->getChosenCard(), player->getLastChosenCard()}) {
+                    reachable = reachable && (!card || isDeckCard(*card));
+                }
+            }
+            unreachable += reachable ? 0 : 1;
+        }
+    }
+    std::cout << "  " << record.size() * 256 << " changed records: " << rejected << " rejected, " << unreachable
+              << " restored to a state no game reaches" << std::endl;
+
+    // Fields that parse but disagree with the rest of the room: a held
+    // card marked played, no cards marked played, turns the rounds can't
+    // account for, fewer joins than seated players, and hands dealt from
+    // cards still in the deck
+    const Player& first = *room->getPlayers()[0];
+    uint64_t heldBit = uint64_t(1) << deckIndexOf(first.getHand()[0]);
+    const std::pair<int, uint64_t> inconsistent[] = {
+        {6, room->getPlayedCardMask() | heldBit}, {6, 0}, {7, 1000}, {7, 1}, {9, 1}, {15, 2}};
+    size_t caught = 0;
+    for (const auto& [field, value] : inconsistent) {
+        caught += GameRoom::restore(withRecordField(record, field, value), key) ? 0 : 1;
+    }
+    std::cout << "  " << caught << "/" << std::size(inconsistent) << " records out of step with themselves rejected"
+              << std::endl;
+    return unreachable == 0 && caught == std::size(inconsistent) && GameRoom::restore(record, key) != nullptr;
+}
+
+// A snapshot that ends part way through a room, one with a bad last
+// record and one whose rooms are already live are all turned down without
+// restoring a single room. Returns false if any of them gets through.
+bool checkRejectedSnapshots(const std::string& path, GameServer& live) {
+    std::ifstream in(path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string truncated = contents.substr(0, contents.size() - 10);
+    // The last room's last byte is a card; element 7 is no element
+    std::string badCard = contents;
+    badCard.back() = 0x7F;
+
+    bool ok = true;
+    std::string broken = path + ".broken";
+    for (const std::string* variant : {&truncated, &badCard}) {
+        std::ofstream(broken, std::ios::binary | std::ios::trunc) << *variant;
+        GameServer server;
+        size_t count = 0;
+        std::string error;
+        ok = !server.restoreSnapshot(broken, count, error) && count == 0 && server.getRoomCount() == 0 &&
+             server.getCreatedRoomCount() == 0 && ok;
+    }
+    std::filesystem::remove(broken);
+
+    size_t liveRooms = live.getRoomCount();
+    size_t count = 0;
+    std::string error;
+    ok = !live.restoreSnapshot(path, count, error) && count == 0 && live.getRoomCount() == liveRooms && ok;
+    std::cout << "  truncated, corrupt and already restored snapshots " << (ok ? "rejected" : "NOT rejected")
+              << " with no rooms restored" << std::endl;
+    return ok;
+}
+
+// A server's rooms in every state (waiting, mid-game, finished, with
+// personalities and a quick-match player waiting) snapshotted, then the
+// same again with nothing changed, then restored into a fresh server.
+// Returns false if a restored room's state differs from the live one, or
+// plays on differently from it, or if a bad snapshot or record gets in.
+bool benchSnapshot(size_t iterations) {
+    size_t roomCount = std::max<size_t>(100, iterations / 10);
+    AiSettings ai;
+    ai.rollouts = 0;
+    TurnTiming timing;
+    timing.quickMatchWait = std::chrono::minutes(10);
+    GameServer server;
+    server.setAiSettings(ai);
+    server.setTurnTiming(timing);
+    PersonalityTable builtin = PersonalityTable::builtin();
+
+    std::vector<std::string> roomIds;
+    std::atomic<size_t> pending(roomCount);
+    auto setupStart = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < roomCount; r++) {
+        const AiPersonality* personality =
+            r % 3 == 0 ? server.findPersonality(builtin.all()[r % builtin.all().size()].getKey()) : nullptr;
+        std::string roomId = r % 10 == 9 ? server.createRoom(4, r) : server.createRoom(2, r, personality);
+        roomIds.push_back(roomId);
+        // Up to a whole game, so some rooms are finished and some not started
+        int moves = static_cast<int>(r % (GameRoom::ROUNDS_PER_GAME + 2));
+        server.submit(roomId, [moves, &pending](GameRoom& room) {
+            room.addPlayer("player_1", "Alice");
+            if (room.getMaxPlayers() == 4) {
+                room.addPlayer("player_2", "Bob");
+            } else if (moves > 0) {
+                GameServer::startAndDeal(room);
+                for (int m = 1; m < moves && !room.isGameOver() && room.chooseCard("player_1", 0) && room.autoPlay();
+                     m++) {}
+            }
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    std::string waitingId;
+    std::atomic<bool> seated(false);
+    server.quickMatch("player_q", "Quinn", [&](const std::string& roomId) {
+        waitingId = roomId;
+        seated.store(true, std::memory_order_release);
+    });
+    while (pending.load(std::memory_order_acquire) > 0 || !seated.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    roomIds.push_back(waitingId);
+    double setup = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+    std::cout << "snapshot/setup: " << roomIds.size() << " rooms in " << setup * 1000 << " ms" << std::endl;
+
+    auto path = (std::filesystem::temp_directory_path() /
+                 ("card_game_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) +
+                  ".snapshot")).string();
+    std::string error;
+    bool ok = true;
+    for (const char* pass : {"write", "write, nothing changed"}) {
+        auto start = std::chrono::steady_clock::now();
+        ok = server.writeSnapshot(path, error) && ok;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "snapshot/" << pass << ": " << roomIds.size() << " rooms in " << seconds * 1000 << " ms ("
+                  << static_cast<long long>(roomIds.size() / seconds) << " rooms/s)" << std::endl;
+    }
+    if (!ok) {
+        std::cout << "  cannot write the snapshot: " << error << std::endl;
+        return false;
+    }
+
+    GameServer restored;
+    restored.setAiSettings(ai);
+    restored.setTurnTiming(timing);
+    size_t count = 0;
+    auto start = std::chrono::steady_clock::now();
+    ok = restored.restoreSnapshot(path, count, error);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "snapshot/restore: " << count << " rooms in " << seconds * 1000 << " ms ("
+              << static_cast<long long>(count / std::max(seconds, 1e-9)) << " rooms/s), "
+              << std::filesystem::file_size(path) / std::max<size_t>(1, count) << " bytes per room" << std::endl;
+    if (!ok) {
+        std::cout << "  " << error << std::endl;
+    }
+
+    // Same state, and the same game from here on: the restored generator
+    // and deck deal and play exactly what the live ones do
+    size_t same = 0;
+    for (const auto& roomId : roomIds) {
+        bool match = restored.getRoomState(roomId) == server.getRoomState(roomId);
+        server.playCard(roomId, "player_1", 0);
+        restored.playCard(roomId, "player_1", 0);
+        same += match && restored.getRoomState(roomId) == server.getRoomState(roomId) ? 1 : 0;
+    }
+    ok = ok && count == roomIds.size() && same == roomIds.size() &&
+         restored.getCreatedRoomCount() == server.getCreatedRoomCount() &&
+         restored.createRoom(2) == server.createRoom(2);
+    std::cout << "  " << same << "/" << roomIds.size() << " restored rooms match the live ones and play on the same"
+              << std::endl;
+
+    // The quick-match player is still waiting, so the next one is paired with them
+    std::atomic<bool> paired(false);
+    std::string pairedId;
+    restored.quickMatch("player_r", "Rae", [&](const std::string& roomId) {
+        pairedId = roomId;
+        paired.store(true, std::memory_order_release);
+    });
+    while (!paired.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    ok = ok && pairedId == waitingId;
+    ok = checkRejectedSnapshots(path, restored) && ok;
+
+    std::filesystem::remove(path);
+    return checkSnapshotRecords() && ok;
+}
+
+#ifdef __linux__
+int connectTo(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Clients that send a command and hang up (some with a reset) while the
+// reply is still being worked out on another thread, next to clients that
+// wait for theirs. The reply, the hang-up and the fd's reuse by the next
+// accept land in the same epoll batches, which is where a connection
+// freed by one event used to be touched by the next. Then clients that
+// pipeline a few hundred commands in one write, answered out of order by
+// those threads. Returns false if a waiting client doesn't get its reply,
+// a pipelining client gets its replies out of order, or a connection is
+// left open.
+bool benchLoop(size_t iterations) {
+    std::mutex queueMutex;
+    std::condition_variable queued;
+    // Each command is answered with itself
+    std::deque<std::pair<std::string, ReplySink>> pending;
+    bool stopping = false;
+    // Replies come from other threads, a little later, like a room worker's
+    std::vector<std::thread> repliers;
+    for (int t = 0; t < 4; t++) {
+        repliers.emplace_back([&, t] {
+            GameRandom random(t + 1);
+            std::unique_lock<std::mutex> lock(queueMutex);
+            while (true) {
+                queued.wait(lock, [&] { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                auto [command, sink] = std::move(pending.front());
+                pending.pop_front();
+                lock.unlock();
+                auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(random.below(200));
+                while (std::chrono::steady_clock::now() < until) {}
+                sink(std::make_shared<const std::string>(command + "\n"));
+                lock.lock();
+            }
+        });
+    }
+
+    EventLoop loop(0, [&](std::string_view command, const std::shared_ptr<ClientSession>&, ReplySink sink) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.emplace_back(std::string(command), std::move(sink));
+        queued.notify_one();
+    });
+    bool ok = loop.open();
+    sockaddr_in bound{};
+    socklen_t length = sizeof(bound);
+    ok = ok && getsockname(loop.getListenFd(), reinterpret_cast<sockaddr*>(&bound), &length) == 0;
+    int port = ntohs(bound.sin_port);
+    std::thread loopThread([&] { loop.run(); });
+
+    size_t rounds = std::max<size_t>(20, iterations / 1000);
+    const int CLIENTS = 64;
+    size_t answered = 0, expected = 0, abandoned = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; ok && r < rounds; r++) {
+        std::vector<int> fds;
+        for (int c = 0; c < CLIENTS; c++) {
+            int fd = connectTo(port);
+            if (fd < 0 || send(fd, "PING\n", 5, MSG_NOSIGNAL) != 5) {
+                ok = false;
+                break;
+            }
+            fds.push_back(fd);
+        }
+        for (size_t c = 0; c < fds.size(); c++) {
+            if (c % 3 == 2) {
+                continue;
+            }
+            if (c % 3 == 1) {
+                // Reset instead of an orderly close
+                linger hard{1, 0};
+                setsockopt(fds[c], SOL_SOCKET, SO_LINGER, &hard, sizeof(hard));
+            }
+            close(fds[c]);
+            abandoned++;
+        }
+        for (size_t c = 2; c < fds.size(); c += 3) {
+            expected++;
+            char buffer[5];
+            answered += recv(fds[c], buffer, sizeof(buffer), MSG_WAITALL) == 5 ? 1 : 0;
+            close(fds[c]);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // More commands than a connection runs at once, all in one write
+    const int PIPELINED = 300;
+    const int PIPELINERS = 8;
+    std::string commands, replies;
+    for (int i = 0; i < PIPELINED; i++) {
+        commands += "CMD_" + std::to_string(i) + "\n";
+    }
+    size_t inOrder = 0;
+    auto pipelineStart = std::chrono::steady_clock::now();
+    std::vector<int> pipeliners;
+    for (int c = 0; ok && c < PIPELINERS; c++) {
+        int fd = connectTo(port);
+        ssize_t sent = fd >= 0 ? send(fd, commands.data(), commands.size(), MSG_NOSIGNAL) : -1;
+        ok = sent == static_cast<ssize_t>(commands.size());
+        pipeliners.push_back(fd);
+    }
+    for (int fd : pipeliners) {
+        std::string received(commands.size(), '\0');
+        inOrder += fd >= 0 && recv(fd, received.data(), received.size(), MSG_WAITALL) ==
+                                  static_cast<ssize_t>(received.size()) && received == commands ? 1 : 0;
+        close(fd);
+    }
+    double pipelineSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pipelineStart).count();
+
+    // Every connection gone, as the loop sees it
+    size_t open = 0;
+    for (int attempt = 0; attempt < 200; attempt++) {
+        std::promise<size_t> counted;
+        loop.post([&] { counted.set_value(loop.getConnectionCount()); });
+        open = counted.get_future().get();
+        if (open == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    loop.stop();
+    loopThread.join();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (auto& replier : repliers) {
+        replier.join();
+    }
+
+    ok = ok && answered == expected && open == 0 && inOrder == PIPELINERS;
+    std::cout << "loop/hang-ups during async replies: " << abandoned << " abandoned, " << answered << "/" << expected
+              << " answered, " << open << " left open, " << static_cast<long long>((abandoned + expected) / seconds)
+              << " connections/s" << std::endl;
+    std::cout << "loop/pipelined async commands: " << inOrder << "/" << PIPELINERS << " clients got " << PIPELINED
+              << " replies in order, " << static_cast<long long>(PIPELINERS * PIPELINED / pipelineSeconds)
+              << " commands/s" << std::endl;
+    return ok;
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string suite = argc > 1 ? argv[1] : "all";
+    size_t iterations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    bool ok = true;
+
+    if (suite == "parser" || suite == "all") {
+        ok = benchParser(iterations) && ok;
+    }
+    if (suite == "registry" || suite == "all") {
+        ok = benchRegistry(iterations) && ok;
+    }
+    if (suite == "rooms" || suite == "all") {
+        ok = benchRooms(iterations) && ok;
+    }
+    if (suite == "state" || suite == "all") {
+        benchState(iterations);
+    }
+    if (suite == "cards" || suite == "all") {
+        benchCards(iterations);
+    }
+    if (suite == "allocations" || suite == "all") {
+        ok = benchAllocations(iterations) && ok;
+    }
+    if (suite == "random" || suite == "all") {
+        ok = benchRandom(iterations) && ok;
+    }
+    if (suite == "deck" || suite == "all") {
+        benchDeck(iterations);
+    }
+    if (suite == "fanout" || suite == "all") {
+        ok = benchFanout(iterations) && ok;
+    }
+    if (suite == "lifecycle" || suite == "all") {
+        ok = benchLifecycle(iterations) && ok;
+    }
+    if (suite == "turns" || suite == "all") {
+        ok = benchTurns(iterations) && ok;
+    }
+    if (suite == "batch" || suite == "all") {
+        ok = benchBatch(iterations) && ok;
+    }
+    if (suite == "ai" || suite == "all") {
+        ok = benchAi(iterations) && ok;
+    }
+    if (suite == "endgame" || suite == "all") {
+        ok = benchEndgame(iterations) && ok;
+    }
+    if (suite == "personalities" || suite == "all") {
+        ok = benchPersonalities(iterations) && ok;
+    }
+    if (suite == "lobby" || suite == "all") {
+        ok = benchLobby(iterations) && ok;
+    }
+    if (suite == "pool" || suite == "all") {
+        ok = benchPool(iterations) && ok;
+    }
+    if (suite == "journal" || suite == "all") {
+        ok = benchJournal(iterations) && ok;
+    }
+    if (suite == "snapshot" || suite == "all") {
+        ok = benchSnapshot(iterations) && ok;
+    }
+#ifdef __linux__
+    if (suite == "loop" || suite == "all") {
+        ok = benchLoop(iterations) && ok;
+    }
+#endif
+    return ok ? 0 : 1;
+}
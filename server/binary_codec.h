@@ -0,0 +1,85 @@
+#ifndef BINARY_CODEC_H
+#define BINARY_CODEC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Primitive encoders for the binary wire protocol: LEB128 varints and
+// varint-length-prefixed strings, appended to a reusable output string.
+
+inline void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline void appendBinaryString(std::string& out, std::string_view value) {
+    appendVarint(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+// Bounds-checked reader over one frame payload. Any read past the end sets
+// the failed flag and returns zero/empty instead of throwing.
+class BinaryReader {
+private:
+    std::string_view data;
+    size_t pos;
+    bool failed;
+
+public:
+    explicit BinaryReader(std::string_view payload) : data(payload), pos(0), failed(false) {}
+
+    uint8_t readByte() {
+        if (pos >= data.size()) {
+            failed = true;
+            return 0;
+        }
+        return static_cast<uint8_t>(data[pos++]);
+    }
+
+    uint32_t readVarint() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t byte = readByte();
+            if (failed) return 0;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        failed = true;
+        return 0;
+    }
+
+    uint64_t readVarint64() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 70; shift += 7) {
+            uint8_t byte = readByte();
+            if (failed) return 0;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+        failed = true;
+        return 0;
+    }
+
+    std::string_view readString() {
+        uint32_t length = readVarint();
+        if (failed || length > data.size() - pos) {
+            failed = true;
+            return std::string_view();
+        }
+        std::string_view value = data.substr(pos, length);
+        pos += length;
+        return value;
+    }
+
+    bool ok() const { return !failed; }
+    bool atEnd() const { return pos == data.size(); }
+    // What hasn't been read yet
+    std::string_view remaining() const { return data.substr(pos); }
+};
+
+#endif // BINARY_CODEC_H
@@ -1,110 +1,135 @@
 #include "card_game.h"
+#include "binary_codec.h"
 #include <algorithm>
-#include <random>
-#include <sstream>
 #include <ctime>
+#include <stdexcept>
+#include <future>
+#include <iostream>
 
-// Card Implementation
-std::string Card::getElementName() const {
-    switch (element) {
-        case Element::FIRE: return "FIRE";
-        case Element::ICE: return "ICE";
-        case Element::WATER: return "WATER";
-        case Element::ELECTRICITY: return "ELECTRICITY";
-        case Element::EARTH: return "EARTH";
-        case Element::POWER: return "POWER";
-    }
-    return "UNKNOWN";
-}
+#include "wire_protocol.h"
+#include "ai_search.h"
+#include "ai_personality.h"
+#include "slab_pool.h"
+#include "snapshot.h"
 
-std::string Card::toString() const {
-    return getElementName() + "_" + std::to_string(strength);
-}
+namespace {
 
-// Player Implementation
-Player::Player(const std::string& playerId, const std::string& playerName)
-    : id(playerId), name(playerName), score(0), isActive(false) {}
+void appendBool(std::string& out, bool value) {
+    out += value ? "true" : "false";
+}
 
-void Player::addCard(const Card& card) {
-    hand.push_back(card);
+void appendJsonCards(std::string& out, const Player::CardList& cards) {
+    out += '[';
+    for (size_t j = 0; j < cards.size(); j++) {
+        if (j > 0) out += ',';
+        out += "{\"element\":\"";
+        out += cards[j].getElementName();
+        out += "\",\"strength\":";
+        out += std::to_string(cards[j].getStrength());
+        out += '}';
+    }
+    out += ']';
 }
 
-bool Player::removeCard(int cardIndex) {
-    if (cardIndex >= 0 && cardIndex < hand.size()) {
-        hand.erase(hand.begin() + cardIndex);
-        return true;
+void appendBinaryCards(std::string& out, const Player::CardList& cards) {
+    appendVarint(out, static_cast<uint32_t>(cards.size()));
+    for (const auto& card : cards) {
+        out.push_back(static_cast<char>(card.toByte()));
     }
-    return false;
 }
 
-const std::vector<Card>& Player::getHand() const {
+} // namespace
+
+// Card Implementation
+std::string Card::toString() const {
+    return std::string(getElementName()) + "_" + std::to_string(getStrength());
+}
+
 // Player Implementation
 Player::Player(const std::string& playerId, const std::string& playerName, bool isAI)
-    : id(playerId), name(playerName), score(0), isActive(false), isComputer(isAI), chosenCard(nullptr) {}
+    : id(playerId), name(playerName), idHash(FlatStringMap<int>::hashOf(playerId)), score(0), isActive(false), isComputer(isAI),
+      revision(1), jsonCacheRevision(0) {}
 
-void Player::addCard(const Card& card) {
-    hand.push_back(card);
+bool Player::addCard(const Card& card) {
+    if (!hand.push_back(card)) {
+        return false;
+    }
+    revision++;
+    return true;
 }
 
 bool Player::removeCard(int cardIndex) {
-    if (cardIndex >= 0 && cardIndex < hand.size()) {
-        hand.erase(hand.begin() + cardIndex);
+    if (cardIndex >= 0 && cardIndex < static_cast<int>(hand.size())) {
+        hand.erase(cardIndex);
+        revision++;
         return true;
     }
     return false;
 }
 
-const std::vector<Card>& Player::getHand() const {
+const Player::CardList& Player::getHand() const {
     return hand;
 }
 
 void Player::clearHand() {
     hand.clear();
+    revision++;
+}
+
+void Player::setHand(const CardList& cards) {
+    hand = cards;
+    lastChosenCard.reset();
+    revision++;
 }
 
 void Player::setChosenCard(int cardIndex) {
-    if (cardIndex >= 0 && cardIndex < hand.size()) {
-        chosenCard = new Card(hand[cardIndex].element, hand[cardIndex].strength);
+    if (cardIndex >= 0 && cardIndex < static_cast<int>(hand.size())) {
+        chosenCard = hand[cardIndex];
+        lastChosenCard = chosenCard;
     }
 }
 
-Card* Player::getChosenCard() {
-// Deck Implementation
-Deck::Deck() {
-    createElementalDeck();
+const Card* Player::getChosenCard() const {
+    return chosenCard ? &*chosenCard : nullptr;
 }
 
-void Deck::reset() {
-    cards.clear();
-    createElementalDeck();
+void Player::clearChosenCard() {
+    chosenCard.reset();
 }
 
-void Deck::createElementalDeck() {
-    // Create elemental cards with strength 1-10 for each element
-    Element elements[] = {Element::FIRE, Element::ICE, Element::WATER, 
-                         Element::ELECTRICITY, Element::EARTH, Element::POWER};
-    
-    for (const auto& elem : elements) {
-        for (int strength = 1; strength <= 10; strength++) {
-            cards.emplace_back(elem, strength);
-        }
-    }
+const Card* Player::getLastChosenCard() const {
+    return lastChosenCard ? &*lastChosenCard : nullptr;
 }
 
 int Player::getScore() const {
     return score;
 }
 
-std::string Player::getId() const {
+const std::string& Player::getId() const {
     return id;
 }
 
-std::string Player::getName() const {
+uint64_t Player::getIdHash() const {
+    return idHash;
+}
+
+const std::string& Player::getName() const {
     return name;
 }
 
+PlayerHandle Player::getHandle() const {
+    return handle;
+}
+
+void Player::setHandle(PlayerHandle playerHandle) {
+    handle = playerHandle;
+}
+
 void Player::setActive(bool active) {
-    isActive = active;
+    if (isActive != active) {
+        isActive = active;
+        revision++;
+    }
 }
 
 bool Player::getActive() const {
@@ -115,84 +140,369 @@ bool Player::isAI() const {
     return isComputer;
 }
 
-int Player::makeAIChoice() {
+int Player::makeAIChoice(GameRandom& random) {
     // Simple AI: choose random card
     if (hand.empty()) return -1;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, hand.size() - 1);
-    return dis(gen);
+    return static_cast<int>(random.below(static_cast<uint32_t>(hand.size())));
 }
 
 void Player::addPlayedCard(const Card& card) {
-    playedCards.push_back(card);
+    if (playedCards.push_back(card)) {
+        revision++;
+    }
 }
 
-const std::vector<Card>& Player::getPlayedCards() const {
+const Player::CardList& Player::getPlayedCards() const {
     return playedCards;
 }
 
 void Player::clearPlayedCards() {
-    playedCards.clear();
+    if (!playedCards.empty()) {
+        playedCards.clear();
+        revision++;
+    }
 }
 
 void Player::addScore(int points) {
     score += points;
+    revision++;
+}
+
+void Player::appendJson(std::string& out) const {
+    if (jsonCacheRevision != revision) {
+        jsonCache.clear();
+        jsonCache += "{\"id\":\"";
+        jsonCache += id;
+        jsonCache += "\",\"name\":\"";
+        jsonCache += name;
+        jsonCache += "\",\"score\":";
+        jsonCache += std::to_string(score);
+        jsonCache += ",\"active\":";
+        appendBool(jsonCache, isActive);
+        jsonCache += ",\"isAI\":";
+        appendBool(jsonCache, isComputer);
+        jsonCache += ",\"hand\":";
+        appendJsonCards(jsonCache, hand);
+        jsonCache += ",\"playedCards\":";
+        appendJsonCards(jsonCache, playedCards);
+        jsonCache += '}';
+        jsonCacheRevision = revision;
+    }
+    out += jsonCache;
+}
+
+namespace {
+
+const uint8_t NO_CARD_BYTE = 0xFF;
+
+void appendOptionalCard(std::string& out, const std::optional<Card>& card) {
+    out.push_back(static_cast<char>(card ? card->toByte() : NO_CARD_BYTE));
+}
+
+// True if byte is the wire form of a card in ELEMENTAL_DECK
+bool isDeckCardByte(uint8_t byte) {
+    for (const Card& card : ELEMENTAL_DECK) {
+        if (card.toByte() == byte) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readOptionalCard(BinaryReader& in, std::optional<Card>& card) {
+    uint8_t byte = in.readByte();
+    if (!in.ok() || (byte != NO_CARD_BYTE && !isDeckCardByte(byte))) {
+        return false;
+    }
+    card = byte == NO_CARD_BYTE ? std::nullopt : std::optional<Card>(Card::fromByte(byte));
+    return true;
+}
+
+bool readCards(BinaryReader& in, Player::CardList& cards) {
+    uint32_t count = in.readVarint();
+    if (!in.ok() || count > Player::MAX_CARDS) {
+        return false;
+    }
+    cards.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t byte = in.readByte();
+        if (!in.ok() || !isDeckCardByte(byte)) {
+            return false;
+        }
+        cards.push_back(Card::fromByte(byte));
+    }
+    return true;
+}
+
+} // namespace
+
+void Player::appendSnapshot(std::string& out) const {
+    // score, flags, hand, played cards, then the chosen and last chosen
+    // cards (0xFF for none)
+    appendVarint(out, static_cast<uint32_t>(score));
+    uint8_t flags = (isActive ? 0x01 : 0) | (isComputer ? 0x02 : 0);
+    out.push_back(static_cast<char>(flags));
+    appendBinaryCards(out, hand);
+    appendBinaryCards(out, playedCards);
+    appendOptionalCard(out, chosenCard);
+    appendOptionalCard(out, lastChosenCard);
+}
+
+bool Player::restoreSnapshot(BinaryReader& in) {
+    // A round is worth one point, so no score passes the game's length
+    uint32_t restoredScore = in.readVarint();
+    uint8_t flags = in.readByte();
+    if (!in.ok() || restoredScore > static_cast<uint32_t>(GameRoom::ROUNDS_PER_GAME)) {
+        return false;
+    }
+    score = static_cast<int>(restoredScore);
+    isActive = (flags & 0x01) != 0;
+    isComputer = (flags & 0x02) != 0;
+    if (!readCards(in, hand) || !readCards(in, playedCards) || !readOptionalCard(in, chosenCard) ||
+        !readOptionalCard(in, lastChosenCard)) {
+        return false;
+    }
+    revision++;
+    return true;
 }
 
 // Deck Implementation
-void Deck::shuffle() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::shuffle(cards.begin(), cards.end(), gen);
+Deck::Deck() {
+    reset();
+}
+
+void Deck::reset() {
+    for (size_t i = 0; i < DECK_SIZE; i++) {
+        order[i] = static_cast<uint8_t>(i);
+    }
+    next = 0;
+}
+
+void Deck::shuffle(GameRandom& random) {
+    // Fisher-Yates over the undealt indices with the room's generator, so a
+    // seed fixes the order
+    for (size_t i = DECK_SIZE; i > next + 1; i--) {
+        size_t j = next + random.below(static_cast<uint32_t>(i - next));
+        std::swap(order[i - 1], order[j]);
+    }
 }
 
 Card Deck::draw() {
-    if (cards.empty()) {
+    if (next >= DECK_SIZE) {
         throw std::runtime_error("Deck is empty");
     }
-    Card card = cards.back();
-    cards.pop_back();
-    return card;
+    return ELEMENTAL_DECK[order[next++]];
+}
+
+void Deck::deal(size_t count, Player::CardList& hand) {
+    count = std::min(count, DECK_SIZE - next);
+    for (size_t i = 0; i < count && hand.push_back(ELEMENTAL_DECK[order[next]]); i++) {
+        next++;
+    }
 }
 
 bool Deck::isEmpty() const {
-    return cards.empty();
+    return next >= DECK_SIZE;
 }
 
 int Deck::size() const {
-    return cards.size();
+    return static_cast<int>(DECK_SIZE - next);
+}
+
+uint64_t Deck::getDealtMask() const {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < next; i++) {
+        mask |= uint64_t(1) << order[i];
+    }
+    return mask;
+}
+
+void Deck::appendSnapshot(std::string& out) const {
+    appendVarint(out, static_cast<uint32_t>(next));
+    out.append(reinterpret_cast<const char*>(order.data()), order.size());
+}
+
+bool Deck::restoreSnapshot(BinaryReader& in) {
+    uint32_t dealt = in.readVarint();
+    if (!in.ok() || dealt > DECK_SIZE) {
+        return false;
+    }
+    // Each index must appear exactly once, or draw() could run off the deck
+    uint64_t seen = 0;
+    for (size_t i = 0; i < DECK_SIZE; i++) {
+        uint8_t index = in.readByte();
+        if (index >= DECK_SIZE || (seen & (1ull << index))) {
+            return false;
+        }
+        seen |= 1ull << index;
+        order[i] = index;
+    }
+    next = dealt;
+    return in.ok();
 }
 
 // GameRoom Implementation
-GameRoom::GameRoom(const std::string& id, int maxP)
-    : roomId(id), maxPlayers(maxP), currentPlayerIndex(0), gameStarted(false), gameOver(false), roundsPlayed(0) {}
+const int GameRoom::MAX_PLAYERS;
+
+GameRoom::GameRoom(const std::string& id, int maxP, uint64_t roomSeed)
+    : roomId(id), joins(0), seed(roomSeed), random(roomSeed), maxPlayers(std::min(maxP, MAX_PLAYERS)), currentPlayerIndex(0), gameStarted(false), gameOver(false), roundsPlayed(0),
+      playedCardMask(0), personality(nullptr), matchmaking(false), journal(nullptr), turnNumber(0), version(0), changed(false), lastActivity(std::chrono::steady_clock::now()) {}
 
-bool GameRoom::addPlayer(std::shared_ptr<Player> player) {
-    if (players.size() >= maxPlayers || gameStarted) {
+std::shared_ptr<GameRoom> GameRoom::create(const std::string& id, int maxP, uint64_t seed) {
+    return std::allocate_shared<GameRoom>(PoolAllocator<GameRoom>(), id, maxP, seed);
+}
+
+void GameRoom::markChanged() {
+    changed = true;
+}
+
+bool GameRoom::addPlayer(std::string_view playerId, std::string_view playerName) {
+    if (!seat(playerId, playerName, false)) {
         return false;
     }
-    players.push_back(player);
     
     // Auto-add AI player when human joins
-    if (players.size() == 1 && maxPlayers == 2) {
-        auto aiPlayer = std::make_shared<Player>("ai_player", "Computer", true);
-        players.push_back(aiPlayer);
+    if (players.size() == 1 && maxPlayers == 2 && !matchmaking) {
+        addAiOpponent();
     }
     
+    markChanged();
     return true;
 }
 
-bool GameRoom::removePlayer(const std::string& playerId) {
-    for (auto it = players.begin(); it != players.end(); ++it) {
-        if ((*it)->getId() == playerId) {
-            players.erase(it);
+bool GameRoom::addAiOpponent() {
+    if (!seat("ai_player", personality ? personality->getName() : "Computer", true)) {
+        return false;
+    }
+    markChanged();
+    return true;
+}
+
+// The one check on who may sit down, shared by live joins and replay so a
+// journal replays exactly what the server accepted
+bool GameRoom::seat(std::string_view playerId, std::string_view playerName, bool isAI) {
+    if (static_cast<int>(players.size()) >= maxPlayers || gameStarted) {
+        return false;
+    }
+    for (auto& slot : playerStorage) {
+        if (!slot) {
+            Player& player = slot.emplace(std::string(playerId), std::string(playerName), isAI);
+            player.setHandle(PlayerHandle(static_cast<uint32_t>(players.size()), ++joins));
+            players.push_back(&player);
+            journalEvent(JournalEvent::PLAYER_JOINED, [&](std::string& out) {
+                appendBinaryString(out, playerId);
+                appendBinaryString(out, playerName);
+                out.push_back(isAI ? 1 : 0);
+            });
             return true;
         }
     }
     return false;
 }
 
+bool GameRoom::isReachable() const {
+    auto bitOf = [](const Card& card) { return uint64_t(1) << deckIndexOf(card); };
+    uint64_t held = 0;    // in a hand
+    uint64_t onTable = 0; // played this round
+    uint32_t lastGeneration = 0;
+    for (const Player* player : players) {
+        uint64_t mine = 0;
+        for (const Card& card : player->getHand()) {
+            if (held & bitOf(card)) {
+                return false;
+            }
+            held |= bitOf(card);
+        }
+        for (const Card& card : player->getPlayedCards()) {
+            if (onTable & bitOf(card)) {
+                return false;
+            }
+            mine |= bitOf(card);
+            onTable |= bitOf(card);
+        }
+        // The chosen card went on the table with the player's play; the
+        // last one chosen was played some time this game
+        const Card* chosen = player->getChosenCard();
+        const Card* lastChosen = player->getLastChosenCard();
+        if ((chosen && !(mine & bitOf(*chosen))) || (lastChosen && !(playedCardMask & bitOf(*lastChosen)))) {
+            return false;
+        }
+        // Seats are in joining order and each join takes the next generation
+        uint32_t generation = player->getHandle().generation();
+        if (generation <= lastGeneration || generation > joins || player->getScore() > roundsPlayed) {
+            return false;
+        }
+        lastGeneration = generation;
+    }
+
+    // Every card held or played was dealt, and a card is held, on the
+    // table or played earlier, never two of those
+    uint64_t dealt = deck.getDealtMask();
+    if ((held & (onTable | playedCardMask)) || (onTable & ~playedCardMask) || ((held | playedCardMask) & ~dealt)) {
+        return false;
+    }
+    if (!gameStarted) {
+        return !gameOver && roundsPlayed == 0 && turnNumber == 0 && dealt == 0 && held == 0 && playedCardMask == 0;
+    }
+    // The start is a turn and so is every play, at least two a round and
+    // at most one a dealt card, and every round that doesn't end the game
+    uint64_t plays = static_cast<uint64_t>(DECK_SIZE - deck.size());
+    uint64_t rounds = static_cast<uint64_t>(roundsPlayed);
+    return gameOver == (roundsPlayed == ROUNDS_PER_GAME) && turnNumber >= 1 + 2 * rounds &&
+           turnNumber <= 1 + plays + rounds;
+}
+
+void GameRoom::setJournal(EventJournal* eventJournal) {
+    journal = eventJournal;
+}
+
+bool GameRoom::restorePlayer(std::string_view playerId, std::string_view playerName, bool isAI) {
+    if (!seat(playerId, playerName, isAI)) {
+        return false;
+    }
+    markChanged();
+    return true;
+}
+
+bool GameRoom::replayCard(PlayerHandle player, int cardIndex, int powerIndex) {
+    if (powerIndex < NO_POWER_CARD) {
+        return false;
+    }
+    return play(player, cardIndex, powerIndex, false);
+}
+
+RoomHandle GameRoom::getHandle() const {
+    return handle;
+}
+
+void GameRoom::setHandle(RoomHandle roomHandle) {
+    handle = roomHandle;
+}
+
+bool GameRoom::removePlayer(std::string_view playerId) {
+    return removePlayer(findPlayer(playerId));
+}
+
+bool GameRoom::removePlayer(PlayerHandle player) {
+    if (!getPlayer(player)) {
+        return false;
+    }
+    Player* leaving = players[player.index()];
+    journalEvent(JournalEvent::PLAYER_LEFT, [&](std::string& out) { appendBinaryString(out, leaving->getId()); });
+    players.erase(player.index());
+    for (auto& slot : playerStorage) {
+        if (slot && &*slot == leaving) {
+            slot.reset();
+        }
+    }
+    // Later players move up a seat; their generations stay theirs
+    for (size_t i = player.index(); i < players.size(); i++) {
+        players[i]->setHandle(PlayerHandle(static_cast<uint32_t>(i), players[i]->getHandle().generation()));
+    }
+    markChanged();
+    return true;
+}
+
 bool GameRoom::startGame() {
     if (players.size() < 2 || gameStarted) {
         return false;
@@ -200,117 +510,138 @@ bool GameRoom::startGame() {
     
     gameStarted = true;
     deck.reset();
-    deck.shuffle();
+    deck.shuffle(random);
     currentPlayerIndex = 0;
     roundsPlayed = 0;
+    playedCardMask = 0;
     
     if (!players.empty()) {
         players[0]->setActive(true);
     }
     
+    turnNumber++;
+    markChanged();
+    journalEvent(JournalEvent::GAME_STARTED, [&](std::string& out) { appendVarint(out, seed); });
     return true;
 }
 
 void GameRoom::dealCards(int cardsPerPlayer) {
+    // Each hand is the next slice of the shuffled deck
     for (auto& player : players) {
-        player->clearHand();
-        for (int i = 0; i < cardsPerPlayer && !deck.isEmpty(); i++) {
-            player->addCard(deck.draw());
-        }
+        Player::CardList hand;
+        deck.deal(std::max(cardsPerPlayer, 0), hand);
+        player->setHand(hand);
     }
+    markChanged();
+    journalEvent(JournalEvent::CARDS_DEALT, [&](std::string& out) {
+        appendVarint(out, players.size());
+        for (const auto& player : players) {
+            const auto& hand = player->getHand();
+            appendVarint(out, hand.size());
+            for (const auto& card : hand) {
+                out.push_back(static_cast<char>(card.toByte()));
+            }
+        }
+    });
+}
+
+bool GameRoom::chooseCard(std::string_view playerId, int cardIndex) {
+    return chooseCard(findPlayer(playerId), cardIndex);
 }
 
-bool GameRoom::chooseCard(const std::string& playerId, int cardIndex) {
+bool GameRoom::chooseCard(PlayerHandle playerHandle, int cardIndex) {
+    return play(playerHandle, cardIndex, RANDOM_POWER_CARD, false);
+}
+
+bool GameRoom::play(PlayerHandle playerHandle, int cardIndex, int powerIndex, bool automatic) {
     if (!gameStarted || gameOver) return false;
     
-    auto player = getPlayer(playerId);
+    Player* player = getPlayer(playerHandle);
     if (!player || !player->getActive()) {
         return false;
     }
     
     const auto& hand = player->getHand();
-    if (cardIndex < 0 || cardIndex >= hand.size()) {
+    if (cardIndex < 0 || cardIndex >= static_cast<int>(hand.size())) {
         return false;
     }
     
     // Get the card that's about to be played
     Card playedCard = hand[cardIndex];
     
+    // A POWER (star) card brings another POWER card from the hand with it,
+    // a random one; positions are in the hand once playedCard has left it
+    if (playedCard.getElement() == Element::POWER) {
+        InlineVector<uint8_t, Player::MAX_CARDS> powerCardIndices;
+        for (int i = 0; i < static_cast<int>(hand.size()); i++) {
+            if (i != cardIndex && hand[i].getElement() == Element::POWER) {
+                powerCardIndices.push_back(static_cast<uint8_t>(i < cardIndex ? i : i - 1));
+            }
+        }
+        if (powerIndex == RANDOM_POWER_CARD) {
+            powerIndex = powerCardIndices.empty()
+                ? NO_POWER_CARD
+                : powerCardIndices[random.below(static_cast<uint32_t>(powerCardIndices.size()))];
+        } else if (powerCardIndices.empty()
+                       ? powerIndex != NO_POWER_CARD
+                       : std::find(powerCardIndices.begin(), powerCardIndices.end(), powerIndex) == powerCardIndices.end()) {
+            return false;
+        }
+    } else if (powerIndex == RANDOM_POWER_CARD) {
+        powerIndex = NO_POWER_CARD;
+    } else if (powerIndex != NO_POWER_CARD) {
+        return false;
+    }
+    
     // Add the main card to played cards
     player->addPlayedCard(playedCard);
+    playedCardMask |= uint64_t(1) << deckIndexOf(playedCard);
     player->setChosenCard(cardIndex);
     player->removeCard(cardIndex);
     
-    // Check if a POWER (star) card was played
-    if (playedCard.element == Element::POWER) {
-        // Find all POWER cards remaining in hand
-        const auto& updatedHand = player->getHand();
-        std::vector<int> powerCardIndices;
-        for (int i = 0; i < updatedHand.size(); i++) {
-            if (updatedHand[i].element == Element::POWER) {
-                powerCardIndices.push_back(i);
-            }
-        }
-        
-        // If there are POWER cards left, play a random one
-        if (!powerCardIndices.empty()) {
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_int_distribution<> dis(0, powerCardIndices.size() - 1);
-            int randomPowerIndex = powerCardIndices[dis(gen)];
-            
-            // Add the additional POWER card to played cards
-            player->addPlayedCard(updatedHand[randomPowerIndex]);
-            player->removeCard(randomPowerIndex);
-        }
+    std::optional<Card> powerCard;
+    if (powerIndex != NO_POWER_CARD) {
+        // Add the additional POWER card to played cards
+        powerCard = player->getHand()[powerIndex];
+        player->addPlayedCard(*powerCard);
+        playedCardMask |= uint64_t(1) << deckIndexOf(*powerCard);
+        player->removeCard(powerIndex);
     }
     
-    // If AI turn next, make AI choose
-    nextTurn();
-    if (getCurrentPlayer() && getCurrentPlayer()->isAI()) {
-        int aiChoice = getCurrentPlayer()->makeAIChoice();
-        if (aiChoice >= 0) {
-            const auto& aiHand = getCurrentPlayer()->getHand();
-            Card aiPlayedCard = aiHand[aiChoice];
-            
-            // Add AI's main card to played cards
-            getCurrentPlayer()->addPlayedCard(aiPlayedCard);
-            getCurrentPlayer()->setChosenCard(aiChoice);
-            getCurrentPlayer()->removeCard(aiChoice);
-            
-            // Check if AI played a POWER card
-            if (aiPlayedCard.element == Element::POWER) {
-                const auto& aiUpdatedHand = getCurrentPlayer()->getHand();
-                std::vector<int> aiPowerCardIndices;
-                for (int i = 0; i < aiUpdatedHand.size(); i++) {
-                    if (aiUpdatedHand[i].element == Element::POWER) {
-                        aiPowerCardIndices.push_back(i);
-                    }
-                }
-                
-                if (!aiPowerCardIndices.empty()) {
-                    std::random_device rd;
-                    std::mt19937 gen(rd());
-                    std::uniform_int_distribution<> dis(0, aiPowerCardIndices.size() - 1);
-                    int randomPowerIndex = aiPowerCardIndices[dis(gen)];
-                    
-                    getCurrentPlayer()->addPlayedCard(aiUpdatedHand[randomPowerIndex]);
-                    getCurrentPlayer()->removeCard(randomPowerIndex);
-                }
-            }
-            
-            resolveRound();
-        }
-    }
+    journalEvent(JournalEvent::CARD_PLAYED, [&](std::string& out) {
+        appendVarint(out, playerHandle.index());
+        appendVarint(out, static_cast<uint32_t>(cardIndex));
+        out.push_back(static_cast<char>(playedCard.toByte()));
+        out.push_back(static_cast<char>(powerCard ? powerIndex : 0xFF));
+        out.push_back(static_cast<char>(powerCard ? powerCard->toByte() : 0xFF));
+        out.push_back(automatic ? 1 : 0);
+    });
     
+    // An AI opponent's answer is scheduled by the GameServer once this
+    // command has been replied to
+    nextTurn();
+    markChanged();
     return true;
 }
 
+bool GameRoom::autoPlay() {
+    auto player = getCurrentPlayer();
+    if (!player) return false;
+    
+    int choice = player->isAI() && personality
+        ? personality->chooseCard(player->getHand(), makePersonalityContext(*this, *player), random)
+        : player->makeAIChoice(random);
+    if (choice < 0) {
+        return false;
+    }
+    return play(player->getHandle(), choice, RANDOM_POWER_CARD, true);
+}
+
 void GameRoom::resolveRound() {
     if (players.size() != 2) return;
     
-    Card* card1 = players[0]->getChosenCard();
-    Card* card2 = players[1]->getChosenCard();
+    const Card* card1 = players[0]->getChosenCard();
+    const Card* card2 = players[1]->getChosenCard();
     
     if (!card1 || !card2) return;
     
@@ -318,13 +649,13 @@ void GameRoom::resolveRound() {
     int player1TotalStrength = 0;
     const auto& player1Cards = players[0]->getPlayedCards();
     for (const auto& card : player1Cards) {
-        player1TotalStrength += card.strength;
+        player1TotalStrength += card.getStrength();
     }
     
     int player2TotalStrength = 0;
     const auto& player2Cards = players[1]->getPlayedCards();
     for (const auto& card : player2Cards) {
-        player2TotalStrength += card.strength;
+        player2TotalStrength += card.getStrength();
     }
     
     // Compare total strength
@@ -341,16 +672,27 @@ void GameRoom::resolveRound() {
     players[1]->clearPlayedCards();
     
     roundsPlayed++;
+    markChanged();
     
-    // Check if game is over (all 5 rounds played)
-    if (roundsPlayed >= 5) {
+    // Check if game is over (all rounds played)
+    if (roundsPlayed >= ROUNDS_PER_GAME) {
         gameOver = true;
     } else {
         // Next round
         currentPlayerIndex = 0;
         players[0]->setActive(true);
         players[1]->setActive(false);
+        turnNumber++;
     }
+    
+    journalEvent(JournalEvent::ROUND_RESOLVED, [&](std::string& out) {
+        appendVarint(out, static_cast<uint32_t>(roundsPlayed));
+        out.push_back(gameOver ? 1 : 0);
+        appendVarint(out, players.size());
+        for (const auto& player : players) {
+            appendVarint(out, static_cast<uint32_t>(player->getScore()));
+        }
+    });
 }
 
 void GameRoom::nextTurn() {
@@ -359,6 +701,8 @@ void GameRoom::nextTurn() {
     players[currentPlayerIndex]->setActive(false);
     currentPlayerIndex = (currentPlayerIndex + 1) % players.size();
     players[currentPlayerIndex]->setActive(true);
+    turnNumber++;
+    markChanged();
     
     // If both players have chosen, resolve
     if (players[0]->getChosenCard() && players[1]->getChosenCard()) {
@@ -366,23 +710,40 @@ void GameRoom::nextTurn() {
     }
 }
 
-std::shared_ptr<Player> GameRoom::getCurrentPlayer() const {
-    if (players.empty() || currentPlayerIndex >= players.size()) {
+const GameRoom::PlayerList& GameRoom::getPlayers() const {
+    return players;
+}
+
+Player* GameRoom::getCurrentPlayer() const {
+    if (players.empty() || currentPlayerIndex >= static_cast<int>(players.size())) {
         return nullptr;
     }
     return players[currentPlayerIndex];
 }
 
-std::shared_ptr<Player> GameRoom::getPlayer(const std::string& playerId) const {
+Player* GameRoom::getPlayer(std::string_view playerId) const {
+    PlayerHandle player = findPlayer(playerId);
+    return player.valid() ? players[player.index()] : nullptr;
+}
+
+Player* GameRoom::getPlayer(PlayerHandle player) const {
+    if (player.index() >= players.size() || players[player.index()]->getHandle() != player) {
+        return nullptr;
+    }
+    return players[player.index()];
+}
+
+PlayerHandle GameRoom::findPlayer(std::string_view playerId) const {
+    uint64_t hash = FlatStringMap<int>::hashOf(playerId);
     for (const auto& player : players) {
-        if (player->getId() == playerId) {
-            return player;
+        if (player->getIdHash() == hash && player->getId() == playerId) {
+            return player->getHandle();
         }
     }
-    return nullptr;
+    return PlayerHandle();
 }
 
-std::shared_ptr<Player> GameRoom::getWinner() const {
+Player* GameRoom::getWinner() const {
     if (!gameOver || players.size() != 2) return nullptr;
     
     if (players[0]->getScore() > players[1]->getScore()) {
@@ -393,14 +754,46 @@ std::shared_ptr<Player> GameRoom::getWinner() const {
     return nullptr; // Tie
 }
 
-std::string GameRoom::getRoomId() const {
+void GameRoom::setPersonality(const AiPersonality* aiPersonality) {
+    personality = aiPersonality;
+}
+
+const AiPersonality* GameRoom::getPersonality() const {
+    return personality;
+}
+
+void GameRoom::setMatchmaking(bool enabled) {
+    matchmaking = enabled;
+}
+
+bool GameRoom::isMatchmaking() const {
+    return matchmaking;
+}
+
+LobbySlot& GameRoom::getLobbySlot() {
+    return lobbySlot;
+}
+
+RoomMailbox& GameRoom::getMailbox() {
+    return mailbox;
+}
+
+const std::string& GameRoom::getRoomId() const {
     return roomId;
 }
 
+uint64_t GameRoom::getSeed() const {
+    return seed;
+}
+
 int GameRoom::getPlayerCount() const {
     return players.size();
 }
 
+int GameRoom::getMaxPlayers() const {
+    return maxPlayers;
+}
+
 bool GameRoom::isGameStarted() const {
     return gameStarted;
 }
@@ -409,127 +802,776 @@ bool GameRoom::isGameOver() const {
     return gameOver;
 }
 
-std::string GameRoom::getGameState() const {
-    std::ostringstream oss;
-    oss << "{\"roomId\":\"" << roomId << "\",";
-    oss << "\"gameStarted\":" << (gameStarted ? "true" : "false") << ",";
-    oss << "\"gameOver\":" << (gameOver ? "true" : "false") << ",";
-// GameServer Implementation
-GameServer::GameServer() : nextRoomId(1) {}
+int GameRoom::getRoundsPlayed() const {
+    return roundsPlayed;
+}
 
-std::string GameServer::createRoom(int maxPlayers) {
-    std::string roomId = "room_" + std::to_string(nextRoomId++);
-    rooms[roomId] = std::make_shared<GameRoom>(roomId, maxPlayers);
-    return roomId;
+uint64_t GameRoom::getPlayedCardMask() const {
+    return playedCardMask;
 }
 
-bool GameServer::joinRoom(const std::string& roomId, const std::string& playerId, const std::string& playerName) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return false;
+uint64_t GameRoom::getTurnNumber() const {
+    return turnNumber;
+}
+
+uint64_t GameRoom::getVersion() const {
+    return version;
+}
+
+void GameRoom::publishChanges() {
+    if (!changed) {
+        return;
     }
-    
-    auto player = std::make_shared<Player>(playerId, playerName, false);
-    return it->second->addPlayer(player);
+    changed = false;
+    version++;
+    lastActivity = std::chrono::steady_clock::now();
+    broadcast(subscribers);
+    broadcast(spectators);
 }
 
-bool GameServer::leaveRoom(const std::string& roomId, const std::string& playerId) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return false;
+std::chrono::steady_clock::time_point GameRoom::getLastActivity() const {
+    return lastActivity;
+}
+
+void GameRoom::detachSessions() {
+    subscribers.clear();
+    spectators.clear();
+}
+
+void GameRoom::broadcast(std::vector<std::shared_ptr<ClientSession>>& sessions) {
+    // Every session gets the same buffer; closed connections are forgotten
+    size_t kept = 0;
+    for (auto& session : sessions) {
+        if (session->push(getStateUpdate(session->getFormat()), this)) {
+            sessions[kept++] = std::move(session);
+        }
+    }
+    sessions.resize(kept);
+}
+
+void GameRoom::subscribe(std::shared_ptr<ClientSession> session) {
+    if (!session->push(getStateUpdate(session->getFormat()), this)) {
+        return;
+    }
+    for (const auto& existing : subscribers) {
+        if (existing == session) {
+            return;
+        }
+    }
+    subscribers.push_back(std::move(session));
+}
+
+size_t GameRoom::getSubscriberCount() const {
+    return subscribers.size();
+}
+
+void GameRoom::addSpectator(std::shared_ptr<ClientSession> session) {
+    if (!session->push(getStateUpdate(session->getFormat()), this)) {
+        return;
+    }
+    for (const auto& existing : spectators) {
+        if (existing == session) {
+            return;
+        }
+    }
+    spectators.push_back(std::move(session));
+}
+
+size_t GameRoom::getSpectatorCount() const {
+    return spectators.size();
+}
+
+SharedBuffer GameRoom::getEncoded(EncodedState& cache, WireFormat format, bool update) const {
+    // Changes made earlier in the running task aren't versioned yet, so
+    // anything encoded now must not be cached
+    if (cache.buffer && cache.version == version && !changed) {
+        return cache.buffer;
     }
     
-    return it->second->removePlayer(playerId);
+    auto encoded = std::make_shared<std::string>();
+    if (update) {
+        encodeStateUpdate(*this, format, *encoded);
+    } else {
+        Reply reply;
+        reply.type = ReplyType::GAME_STATE;
+        reply.room = shared_from_this();
+        encodeReply(reply, format, *encoded);
+    }
+    if (!changed) {
+        cache.buffer = encoded;
+        cache.version = version;
+    }
+    return encoded;
 }
 
-bool GameServer::startGame(const std::string& roomId) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return false;
+SharedBuffer GameRoom::getStateReply(WireFormat format) const {
+    return getEncoded(stateReplies[static_cast<size_t>(format)], format, false);
+}
+
+SharedBuffer GameRoom::getStateUpdate(WireFormat format) const {
+    return getEncoded(stateUpdates[static_cast<size_t>(format)], format, true);
+}
+
+std::string GameRoom::getGameState() const {
+    std::string state;
+    appendGameState(state);
+    return state;
+}
+
+void GameRoom::appendGameState(std::string& out) const {
+    out += "{\"roomId\":\"";
+    out += roomId;
+    out += "\",\"gameStarted\":";
+    appendBool(out, gameStarted);
+    out += ",\"gameOver\":";
+    appendBool(out, gameOver);
+    out += ",\"roundsPlayed\":";
+    out += std::to_string(roundsPlayed);
+    out += ",\"currentPlayer\":";
+    out += std::to_string(currentPlayerIndex);
+    out += ",\"players\":[";
+    
+    for (size_t i = 0; i < players.size(); i++) {
+        if (i > 0) out += ',';
+        players[i]->appendJson(out);
     }
     
-    if (it->second->startGame()) {
-        it->second->dealCards(5); // Deal 5 cards per player
-        return true;
+    out += "]}";
+}
+
+void GameRoom::appendBinaryState(std::string& out) const {
+    // flags, rounds played, current player, then per player: id, name, score,
+    // flags, hand and played cards at one byte per card
+    uint8_t flags = (gameStarted ? 0x01 : 0) | (gameOver ? 0x02 : 0);
+    out.push_back(static_cast<char>(flags));
+    appendVarint(out, static_cast<uint32_t>(roundsPlayed));
+    appendVarint(out, static_cast<uint32_t>(currentPlayerIndex));
+    appendVarint(out, static_cast<uint32_t>(players.size()));
+    
+    for (const auto& player : players) {
+        appendBinaryString(out, player->getId());
+        appendBinaryString(out, player->getName());
+        appendVarint(out, static_cast<uint32_t>(player->getScore()));
+        uint8_t playerFlags = (player->getActive() ? 0x01 : 0) | (player->isAI() ? 0x02 : 0);
+        out.push_back(static_cast<char>(playerFlags));
+        appendBinaryCards(out, player->getHand());
+        appendBinaryCards(out, player->getPlayedCards());
     }
-    return false;
 }
 
-bool GameServer::chooseCard(const std::string& roomId, const std::string& playerId, int cardIndex) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return false;
+SharedBuffer GameRoom::getSnapshot() const {
+    // Cached like the encoded states: only once the version covers every change
+    if (snapshotRecord.buffer && snapshotRecord.version == version && !changed) {
+        return snapshotRecord.buffer;
+    }
+    auto record = std::make_shared<std::string>();
+    appendSnapshot(*record);
+    if (!changed) {
+        snapshotRecord.buffer = record;
+        snapshotRecord.version = version;
+    }
+    return record;
+}
+
+void GameRoom::appendSnapshot(std::string& out) const {
+    // roomId, seed, max players, flags, rounds played, current player,
+    // played-card mask, turn number, version, joins, personality key, the
+    // generator's four state words, the deck, then per player: id, name,
+    // handle generation and Player::appendSnapshot
+    appendBinaryString(out, roomId);
+    appendVarint(out, seed);
+    appendVarint(out, static_cast<uint32_t>(maxPlayers));
+    uint8_t flags = (gameStarted ? 0x01 : 0) | (gameOver ? 0x02 : 0) | (matchmaking ? 0x04 : 0);
+    out.push_back(static_cast<char>(flags));
+    appendVarint(out, static_cast<uint32_t>(roundsPlayed));
+    appendVarint(out, static_cast<uint32_t>(currentPlayerIndex));
+    appendVarint(out, playedCardMask);
+    appendVarint(out, turnNumber);
+    appendVarint(out, version);
+    appendVarint(out, joins);
+    appendBinaryString(out, personality ? std::string_view(personality->getKey()) : std::string_view());
+    for (uint64_t word : random.getState()) {
+        appendVarint(out, word);
+    }
+    deck.appendSnapshot(out);
+    appendVarint(out, static_cast<uint32_t>(players.size()));
+    for (const auto& player : players) {
+        appendBinaryString(out, player->getId());
+        appendBinaryString(out, player->getName());
+        appendVarint(out, player->getHandle().generation());
+        player->appendSnapshot(out);
+    }
+}
+
+std::shared_ptr<GameRoom> GameRoom::restore(std::string_view record, std::string& personalityKey) {
+    BinaryReader in(record);
+    std::string id(in.readString());
+    uint64_t roomSeed = in.readVarint64();
+    uint32_t maxP = in.readVarint();
+    if (!in.ok() || id.empty() || maxP < 2 || maxP > MAX_PLAYERS) {
+        return nullptr;
+    }
+    auto room = create(id, static_cast<int>(maxP), roomSeed);
+    uint8_t flags = in.readByte();
+    room->gameStarted = (flags & 0x01) != 0;
+    room->gameOver = (flags & 0x02) != 0;
+    room->matchmaking = (flags & 0x04) != 0;
+    uint32_t rounds = in.readVarint();
+    uint32_t current = in.readVarint();
+    if (!in.ok() || rounds > static_cast<uint32_t>(ROUNDS_PER_GAME) || current >= maxP) {
+        return nullptr;
+    }
+    room->roundsPlayed = static_cast<int>(rounds);
+    room->currentPlayerIndex = static_cast<int>(current);
+    room->playedCardMask = in.readVarint64();
+    room->turnNumber = in.readVarint64();
+    room->version = in.readVarint64();
+    room->joins = in.readVarint();
+    personalityKey = std::string(in.readString());
+    std::array<uint64_t, 4> state;
+    for (auto& word : state) {
+        word = in.readVarint64();
+    }
+    if (!in.ok()) {
+        return nullptr;
+    }
+    room->random.setState(state);
+    if (!room->deck.restoreSnapshot(in)) {
+        return nullptr;
     }
     
-    return it->second->chooseCard(playerId, cardIndex);
-}ameServer::GameServer() : nextRoomId(1) {}
+    uint32_t count = in.readVarint();
+    if (!in.ok() || count > maxP) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        std::string playerId(in.readString());
+        std::string playerName(in.readString());
+        uint32_t generation = in.readVarint();
+        if (!in.ok()) {
+            return nullptr;
+        }
+        Player& player = room->playerStorage[i].emplace(playerId, playerName);
+        player.setHandle(PlayerHandle(i, generation));
+        if (!player.restoreSnapshot(in)) {
+            return nullptr;
+        }
+        room->players.push_back(&player);
+    }
+    if (!in.atEnd() || (count > 0 && room->currentPlayerIndex >= static_cast<int>(count)) || !room->isReachable()) {
+        return nullptr;
+    }
+    return room;
+}
 
-std::string GameServer::createRoom(int maxPlayers) {
-    std::string roomId = "room_" + std::to_string(nextRoomId++);
-    rooms[roomId] = std::make_shared<GameRoom>(roomId, maxPlayers);
-    return roomId;
+// GameServer Implementation
+GameServer::GameServer(size_t workerThreads)
+    : nextRoomId(1), evictedRooms(0), timedOutTurns(0), aiSearch(std::make_unique<AiSearch>()),
+      personalities(std::make_unique<PersonalityTable>(PersonalityTable::builtin())), executor(workerThreads),
+      snapshotsStopping(false) {}
+
+GameServer::~GameServer() {
+    stopSnapshots();
+    // Timer callbacks and finished searches submit to the executor, so they
+    // stop first
+    scheduler.stop();
+    aiSearch->stop();
+}
+
+void GameServer::setLifecycle(const RoomLifecycle& settings) {
+    lifecycle = settings;
+}
+
+void GameServer::setTurnTiming(const TurnTiming& settings) {
+    turnTiming = settings;
+}
+
+void GameServer::setAiSettings(const AiSettings& settings) {
+    if (settings.threads != aiSettings.threads) {
+        aiSearch = std::make_unique<AiSearch>(settings.threads);
+    }
+    aiSettings = settings;
+}
+
+void GameServer::setPersonalities(const PersonalityTable& table) {
+    personalities = std::make_unique<PersonalityTable>(table);
+}
+
+const AiPersonality* GameServer::findPersonality(std::string_view key) const {
+    return personalities->find(key);
 }
 
-bool GameServer::joinRoom(const std::string& roomId, const std::string& playerId, const std::string& playerName) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
+bool GameServer::openJournal(const JournalSettings& settings, std::string& error) {
+    auto opened = std::make_unique<EventJournal>();
+    if (!opened->open(settings, error)) {
         return false;
     }
+    journal = std::move(opened);
+    return true;
+}
+
+EventJournal* GameServer::getJournal() const {
+    return journal.get();
+}
+
+bool GameServer::writeSnapshot(const std::string& path, std::string& error) {
+    std::lock_guard<std::mutex> writing(snapshotWriteMutex);
+    std::vector<std::shared_ptr<GameRoom>> live;
+    rooms.forEach([&](const std::shared_ptr<GameRoom>& room) { live.push_back(room); });
+    // Read after the rooms, so it covers every one of them
+    uint64_t created = getCreatedRoomCount();
     
-    auto player = std::make_shared<Player>(playerId, playerName);
-    return it->second->addPlayer(player);
+    std::vector<SharedBuffer> records(live.size());
+    std::mutex doneMutex;
+    std::condition_variable done;
+    size_t pending = live.size();
+    for (size_t i = 0; i < live.size(); i++) {
+        executor.submit(live[i], live[i]->getMailbox(), [&, i](GameRoom& room) {
+            // Evicted since it was listed: it isn't live any more
+            if (rooms.find(room.getHandle()).get() == &room) {
+                records[i] = room.getSnapshot();
+            }
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&] { return pending == 0; });
+    }
+    records.erase(std::remove(records.begin(), records.end(), nullptr), records.end());
+    return SnapshotFile::write(path, created, records, error);
 }
 
-bool GameServer::leaveRoom(const std::string& roomId, const std::string& playerId) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
+bool GameServer::restoreSnapshot(const std::string& path, size_t& restored, std::string& error) {
+    restored = 0;
+    SnapshotFile file;
+    if (!file.open(path, error)) {
+        return false;
+    }
+    // Every record is parsed and checked before any room is registered, so
+    // a bad file leaves the server as it was
+    struct Restored {
+        std::shared_ptr<GameRoom> room;
+        std::string_view record;
+    };
+    std::vector<Restored> parsed;
+    // Each record takes at least its length word, whatever the header claims
+    parsed.reserve(static_cast<size_t>(std::min<uint64_t>(file.getRoomCount(), file.getSize() / sizeof(uint32_t))));
+    size_t bad = 0;
+    bool complete = file.forEach([&](std::string_view record) {
+        std::string personalityKey;
+        auto room = GameRoom::restore(record, personalityKey);
+        if (!room) {
+            bad++;
+            return;
+        }
+        room->setPersonality(personalityKey.empty() ? nullptr : findPersonality(personalityKey));
+        parsed.push_back({std::move(room), record});
+    });
+    if (!complete) {
+        error = path + " ends part way through a room";
         return false;
     }
+    // Claiming every id up front finds repeated and taken ones
+    for (const auto& entry : parsed) {
+        RoomHandle handle = rooms.reserve(entry.room->getRoomId());
+        bad += handle.valid() ? 0 : 1;
+        entry.room->setHandle(handle);
+    }
+    if (bad > 0) {
+        for (const auto& entry : parsed) {
+            if (entry.room->getHandle().valid()) {
+                rooms.release(entry.room->getHandle(), entry.room->getRoomId());
+            }
+        }
+        error = std::to_string(bad) + " room records in " + path + " could not be restored";
+        return false;
+    }
+
+    uint64_t created = file.getCreatedRoomCount();
+    if (nextRoomId.load(std::memory_order_relaxed) <= created) {
+        nextRoomId.store(created + 1, std::memory_order_relaxed);
+    }
+    for (const auto& entry : parsed) {
+        const auto& room = entry.room;
+        std::string_view record = entry.record;
+        // Journaled and listed before it is published, as in makeRoom
+        RoomHandle handle = room->getHandle();
+        if (journal) {
+            journal->append(JournalEvent::ROOM_RESTORED, handle.raw(),
+                            [&](std::string& out) { out.append(record.data(), record.size()); });
+            room->setJournal(journal.get());
+        }
+        lobby.update(*room);
+        rooms.publish(handle, room);
+        scheduleExpiry(room, room->isGameOver() ? lifecycle.finishedTtl : lifecycle.idleTtl);
+        if (room->isGameStarted() && !room->isGameOver()) {
+            executor.submit(room, room->getMailbox(), [this](GameRoom& target) { scheduleTurn(target); });
+        } else if (room->isMatchmaking() && !room->isGameStarted() && room->getPlayerCount() == 1) {
+            std::lock_guard<std::mutex> lock(matchMutex);
+            if (!waitingRoom) {
+                waitingRoom = room;
+                scheduleMatchFallback(room);
+            }
+        }
+        restored++;
+    }
+    return true;
+}
+
+void GameServer::startSnapshots(const std::string& path, std::chrono::steady_clock::duration interval) {
+    stopSnapshots();
+    snapshotsStopping = false;
+    snapshotThread = std::thread([this, path, interval] {
+        std::unique_lock<std::mutex> lock(snapshotMutex);
+        while (!snapshotWake.wait_for(lock, interval, [this] { return snapshotsStopping; })) {
+            lock.unlock();
+            std::string error;
+            if (!writeSnapshot(path, error)) {
+                std::cerr << "Snapshot: " << error << std::endl;
+            }
+            lock.lock();
+        }
+    });
+}
+
+void GameServer::stopSnapshots() {
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshotsStopping = true;
+    }
+    snapshotWake.notify_all();
+    if (snapshotThread.joinable()) {
+        snapshotThread.join();
+    }
+}
+
+void GameServer::scheduleExpiry(const std::shared_ptr<GameRoom>& room, std::chrono::steady_clock::duration delay) {
+    std::weak_ptr<GameRoom> weak = room;
+    scheduler.schedule(delay, [this, weak] {
+        if (auto target = weak.lock()) {
+            executor.submit(target, target->getMailbox(), [this](GameRoom& expiring) {
+                checkExpiry(expiring);
+            });
+        }
+    });
+}
+
+void GameServer::scheduleTurn(GameRoom& room) {
+    auto player = room.getCurrentPlayer();
+    if (!player) {
+        return;
+    }
+    bool ai = player->isAI();
+    auto delay = ai ? turnTiming.aiThinkDelay : turnTiming.turnTimeout;
+    if (!ai && delay == std::chrono::steady_clock::duration::zero()) {
+        return;
+    }
     
-    return it->second->removePlayer(playerId);
+    uint64_t turn = room.getTurnNumber();
+    bool search = ai && aiSettings.rollouts > 0 && !room.getPersonality();
+    auto move = [this, turn, ai, search](GameRoom& target) {
+        if (target.getTurnNumber() != turn) {
+            return;
+        }
+        if (search) {
+            startSearch(target);
+        } else if (target.autoPlay() && !ai) {
+            timedOutTurns.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    if (delay == std::chrono::steady_clock::duration::zero()) {
+        // The human's reply has already been sent, so answer within the same
+        // task; nothing the client sends next can get in between
+        runStep(room, move);
+        return;
+    }
+    std::weak_ptr<GameRoom> weak = room.shared_from_this();
+    scheduler.schedule(delay, [this, weak, move] {
+        if (auto target = weak.lock()) {
+            post(target, move);
+        }
+    });
 }
 
-bool GameServer::startGame(const std::string& roomId) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return false;
+void GameServer::startSearch(GameRoom& room) {
+    SearchPosition position;
+    if (!makeSearchPosition(room, position)) {
+        return;
+    }
+    // Derived from the room's seed rather than drawn from its generator, so
+    // searching doesn't change the rest of a seeded game
+    uint64_t turn = room.getTurnNumber();
+    uint64_t seed = room.getSeed() ^ (turn * 0x9E3779B97F4A7C15ull);
+    std::weak_ptr<GameRoom> weak = room.shared_from_this();
+    aiSearch->search(position, aiSettings, seed, [this, weak, turn](const AiChoice& choice) {
+        if (auto target = weak.lock()) {
+            int card = choice.cardIndex;
+            post(target, [turn, card](GameRoom& playing) {
+                auto player = playing.getCurrentPlayer();
+                if (playing.getTurnNumber() == turn && player) {
+                    playing.chooseCard(player->getHandle(), card);
+                }
+            });
+        }
+    });
+}
+
+AiSettings GameServer::hintSettings() const {
+    AiSettings settings = aiSettings;
+    settings.endgameRounds = AiSettings::HARD_ENDGAME_ROUNDS;
+    if (settings.rollouts == 0) {
+        settings.rollouts = AiSettings().rollouts;
+    }
+    return settings;
+}
+
+void GameServer::requestHint(GameRoom& room, std::string_view playerId, std::function<void(const AiChoice&)> onDone) {
+    auto player = room.getCurrentPlayer();
+    SearchPosition position;
+    if (!player || player->getId() != playerId || !makeSearchPosition(room, position)) {
+        onDone(AiChoice());
+        return;
+    }
+    // Seeded like the AI's own search, but apart from it
+    uint64_t seed = room.getSeed() ^ (room.getTurnNumber() * 0xC2B2AE3D27D4EB4Full);
+    aiSearch->search(position, hintSettings(), seed, std::move(onDone));
+}
+
+void GameServer::afterTask(GameRoom& room, bool wasOver, uint64_t turnBefore) {
+    if (room.isGameOver()) {
+        if (!wasOver) {
+            // The pending expiry check is still set for the idle TTL
+            scheduleExpiry(room.shared_from_this(), lifecycle.finishedTtl);
+        }
+        return;
+    }
+    if (room.getTurnNumber() != turnBefore) {
+        scheduleTurn(room);
+    }
+}
+
+void GameServer::checkExpiry(GameRoom& room) {
+    auto ttl = room.isGameOver() ? lifecycle.finishedTtl : lifecycle.idleTtl;
+    auto deadline = room.getLastActivity() + ttl;
+    auto now = std::chrono::steady_clock::now();
+    if (now < deadline) {
+        scheduleExpiry(room.shared_from_this(), deadline - now);
+        return;
     }
     
-    if (it->second->startGame()) {
-        it->second->dealCards(5); // Deal 5 cards per player
-        return true;
+    // Commands already queued still run, but nothing new can find the room.
+    // A room whose game ended has two checks pending; only one evicts it.
+    if (rooms.erase(room.getHandle(), room.getRoomId())) {
+        lobby.remove(room);
+        {
+            std::lock_guard<std::mutex> lock(matchMutex);
+            if (waitingRoom.get() == &room) {
+                waitingRoom.reset();
+            }
+        }
+        room.detachSessions();
+        if (journal) {
+            // Whatever queued commands still do to it happens to nobody
+            journal->append(JournalEvent::ROOM_CLOSED, room.getHandle().raw());
+            room.setJournal(nullptr);
+        }
+        evictedRooms.fetch_add(1, std::memory_order_relaxed);
     }
-    return false;
 }
 
-bool GameServer::playCard(const std::string& roomId, const std::string& playerId, int cardIndex) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
+bool GameServer::runAndWait(std::string_view roomId, const std::function<void(GameRoom&)>& work) {
+    auto done = std::make_shared<std::promise<void>>();
+    std::future<void> finished = done->get_future();
+    
+    if (!submit(roomId, [&work, done](GameRoom& room) {
+            work(room);
+            done->set_value();
+        })) {
         return false;
     }
     
-    if (it->second->playCard(playerId, cardIndex)) {
-        it->second->nextTurn();
+    finished.wait();
+    return true;
+}
+
+bool GameServer::startAndDeal(GameRoom& room) {
+    if (room.startGame()) {
+        room.dealCards(CARDS_PER_PLAYER);
         return true;
     }
     return false;
 }
 
-std::string GameServer::getRoomState(const std::string& roomId) {
-    auto it = rooms.find(roomId);
-    if (it == rooms.end()) {
-        return "{\"error\":\"Room not found\"}";
+std::string GameServer::createRoom(int maxPlayers) {
+    return createRoom(maxPlayers, GameRandom::freshSeed());
+}
+
+std::string GameServer::createRoom(int maxPlayers, uint64_t seed, const AiPersonality* personality) {
+    return makeRoom(maxPlayers, seed, personality)->getRoomId();
+}
+
+std::shared_ptr<GameRoom> GameServer::makeRoom(int maxPlayers, uint64_t seed, const AiPersonality* personality,
+                                               bool matchmaking) {
+    std::string roomId = "room_" + std::to_string(nextRoomId.fetch_add(1, std::memory_order_relaxed));
+    auto room = GameRoom::create(roomId, maxPlayers, seed);
+    room->setPersonality(personality);
+    room->setMatchmaking(matchmaking);
+    // Named, journaled and listed while no other thread can reach the room:
+    // once it is published a command for it may already be running on its
+    // worker, and what that command journals must follow ROOM_CREATED
+    RoomHandle handle = rooms.reserve(roomId);
+    room->setHandle(handle);
+    if (journal) {
+        journal->append(JournalEvent::ROOM_CREATED, handle.raw(), [&](std::string& out) {
+            appendBinaryString(out, roomId);
+            appendVarint(out, seed);
+            appendVarint(out, static_cast<uint32_t>(room->getMaxPlayers()));
+            out.push_back(matchmaking ? 1 : 0);
+            appendBinaryString(out, personality ? std::string_view(personality->getKey()) : std::string_view());
+        });
+        room->setJournal(journal.get());
     }
+    lobby.update(*room);
+    rooms.publish(handle, room);
+    scheduleExpiry(room, lifecycle.idleTtl);
+    return room;
+}
+
+void GameServer::quickMatch(std::string_view playerId, std::string_view playerName,
+                            std::function<void(const std::string&)> onDone) {
+    auto join = [id = std::string(playerId), name = std::string(playerName),
+                 onDone = std::move(onDone)](GameRoom& target, bool paired) {
+        if (!target.addPlayer(id, name)) {
+            onDone(std::string());
+            return;
+        }
+        if (paired) {
+            // The waiting player may have left since
+            if (target.getPlayerCount() < 2) {
+                target.addAiOpponent();
+            }
+            startAndDeal(target);
+        }
+        onDone(target.getRoomId());
+    };
     
-    return it->second->getGameState();
+    // Joins are queued under the lock, so a waiting room's first player
+    // always joins before the player paired with them
+    std::lock_guard<std::mutex> lock(matchMutex);
+    if (waitingRoom) {
+        auto room = std::move(waitingRoom);
+        waitingRoom.reset();
+        post(room, [join = std::move(join)](GameRoom& target) { join(target, true); });
+        return;
+    }
+    auto room = makeRoom(2, GameRandom::freshSeed(), nullptr, true);
+    bool wait = turnTiming.quickMatchWait > std::chrono::steady_clock::duration::zero();
+    post(room, [join = std::move(join), wait](GameRoom& target) {
+        // With no wait the AI takes the second seat straight away
+        join(target, !wait);
+    });
+    if (wait) {
+        waitingRoom = room;
+        scheduleMatchFallback(room);
+    }
 }
 
-std::vector<std::string> GameServer::getAvailableRooms() {
-    std::vector<std::string> available;
-    for (const auto& pair : rooms) {
-        if (!pair.second->isGameStarted()) {
-            available.push_back(pair.first);
+void GameServer::scheduleMatchFallback(const std::shared_ptr<GameRoom>& room) {
+    std::weak_ptr<GameRoom> weak = room;
+    scheduler.schedule(turnTiming.quickMatchWait, [this, weak] {
+        if (auto target = weak.lock()) {
+            post(target, [this](GameRoom& waiting) {
+                {
+                    // Whoever takes the room out of the slot seats its opponent
+                    std::lock_guard<std::mutex> lock(matchMutex);
+                    if (waitingRoom.get() != &waiting) {
+                        return;
+                    }
+                    waitingRoom.reset();
+                }
+                waiting.addAiOpponent();
+                startAndDeal(waiting);
+            });
         }
+    });
+}
+
+Lobby::Snapshot GameServer::getOpenRooms() {
+    return lobby.getSnapshot();
+}
+
+bool GameServer::joinRoom(std::string_view roomId, std::string_view playerId, std::string_view playerName) {
+    bool success = false;
+    runAndWait(roomId, [&](GameRoom& room) {
+        success = room.addPlayer(playerId, playerName);
+    });
+    return success;
+}
+
+bool GameServer::leaveRoom(std::string_view roomId, std::string_view playerId) {
+    bool success = false;
+    runAndWait(roomId, [&](GameRoom& room) {
+        success = room.removePlayer(playerId);
+    });
+    return success;
+}
+
+bool GameServer::startGame(std::string_view roomId) {
+    bool success = false;
+    runAndWait(roomId, [&](GameRoom& room) {
+        success = startAndDeal(room);
+    });
+    return success;
+}
+
+bool GameServer::playCard(std::string_view roomId, std::string_view playerId, int cardIndex) {
+    bool success = false;
+    runAndWait(roomId, [&](GameRoom& room) {
+        success = room.chooseCard(playerId, cardIndex);
+    });
+    return success;
+}
+
+std::shared_ptr<GameRoom> GameServer::findRoom(std::string_view roomId) {
+    return rooms.find(roomId);
+}
+
+std::shared_ptr<GameRoom> GameServer::findRoom(RoomHandle handle) {
+    return rooms.find(handle);
+}
+
+RoomHandle GameServer::lookupRoom(std::string_view roomId) const {
+    return rooms.lookup(roomId);
+}
+
+std::string GameServer::getRoomState(std::string_view roomId) {
+    std::string state;
+    if (!runAndWait(roomId, [&](GameRoom& room) { room.appendGameState(state); })) {
+        return "{\"error\":\"Room not found\"}";
     }
-    return available;
+    return state;
+}
+
+size_t GameServer::getRoomCount() const {
+    return rooms.size();
+}
+
+uint64_t GameServer::getCreatedRoomCount() const {
+    return nextRoomId.load(std::memory_order_relaxed) - 1;
+}
+
+uint64_t GameServer::getEvictedRoomCount() const {
+    return evictedRooms.load(std::memory_order_relaxed);
+}
+
+uint64_t GameServer::getTimedOutTurnCount() const {
+    return timedOutTurns.load(std::memory_order_relaxed);
+}
+
+Scheduler::LagStats GameServer::getTimerLag() const {
+    return scheduler.getLagStats();
 }
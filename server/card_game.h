@@ -2,11 +2,32 @@
 #define CARD_GAME_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <array>
+#include <utility>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
 
-enum class Element {
+#include "game_random.h"
+#include "inline_vector.h"
+#include "handle.h"
+#include "room_registry.h"
+#include "room_executor.h"
+#include "lobby.h"
+#include "journal.h"
+#include "client_session.h"
+#include "scheduler.h"
+
+enum class Element : uint8_t {
     FIRE,
     ICE,
     WATER,
@@ -15,123 +36,568 @@ enum class Element {
     POWER
 };
 
-struct Card {
-    Element element;
-    int strength;
+constexpr std::string_view ELEMENT_NAMES[] = {
+    "FIRE", "ICE", "WATER", "ELECTRICITY", "EARTH", "POWER"
+};
+
+// One byte: element in bits 4-6, strength (1-10) in bits 0-3. This is also
+// the wire encoding, so toByte() is free.
+class Card {
+private:
+    uint8_t bits;
+
+public:
+    constexpr Card(Element e, int s)
+        : bits(static_cast<uint8_t>((static_cast<unsigned>(e) << 4) | (s & 0x0F))) {}
     
-    Card(Element e, int s) : element(e), strength(s) {}
+    constexpr Element getElement() const { return static_cast<Element>((bits >> 4) & 0x07); }
+    constexpr int getStrength() const { return bits & 0x0F; }
     
     std::string toString() const;
-    std::string getElementName() const;
+    constexpr std::string_view getElementName() const { return ELEMENT_NAMES[(bits >> 4) & 0x07]; }
+    
+    constexpr uint8_t toByte() const { return bits; }
+    static constexpr Card fromByte(uint8_t byte) { return Card(static_cast<Element>((byte >> 4) & 0x07), byte & 0x0F); }
 };
 
+static_assert(sizeof(Card) == 1, "Cards are packed into one byte");
+
+class BinaryReader;
+
 class Player {
-private:
-    std::string id;
-class Player {
+public:
+    // A hand is dealt five cards and a round plays at most two, so both
+    // live inline in the Player
+    static const size_t MAX_CARDS = 10;
+    using CardList = InlineVector<Card, MAX_CARDS>;
+
 private:
     std::string id;
     std::string name;
-    std::vector<Card> hand;
-    std::vector<Card> playedCards;
+    // Hash of id, compared before the string when a room looks a player up
+    uint64_t idHash;
+    PlayerHandle handle;
+    CardList hand;
+    CardList playedCards;
     int score;
     bool isActive;
     bool isComputer;
-    Card* chosenCard;
+    std::optional<Card> chosenCard;
+    // The card chosen before, kept after the round; cleared by a new hand
+    std::optional<Card> lastChosenCard;
+    
+    // Bumped by every change that shows up in the game state, so the JSON
+    // for this player is only rebuilt when it actually changed
+    uint32_t revision;
+    mutable std::string jsonCache;
+    mutable uint32_t jsonCacheRevision;
 
 public:
     Player(const std::string& playerId, const std::string& playerName, bool isAI = false);
     
-    void addCard(const Card& card);
+    // False if the hand is already full
+    bool addCard(const Card& card);
     bool removeCard(int cardIndex);
-    const std::vector<Card>& getHand() const;
+    const CardList& getHand() const;
     void clearHand();
+    void setHand(const CardList& cards);
     
+    // The chosen card is a copy held by value; getChosenCard() is null while
+    // nothing is chosen and stays valid until the choice is cleared
     void setChosenCard(int cardIndex);
-    Card* getChosenCard();
+    const Card* getChosenCard() const;
     void clearChosenCard();
+    const Card* getLastChosenCard() const;
     
     void addPlayedCard(const Card& card);
-    const std::vector<Card>& getPlayedCards() const;
+    const CardList& getPlayedCards() const;
     void clearPlayedCards();
     
     void addScore(int points);
     int getScore() const;
     
-    std::string getId() const;
+    const std::string& getId() const;
+    uint64_t getIdHash() const;
+    const std::string& getName() const;
+    // Given by the room the player joins
+    PlayerHandle getHandle() const;
+    void setHandle(PlayerHandle playerHandle);
+    void setActive(bool active);
+    bool getActive() const;
+    bool isAI() const;
+    
+    void appendJson(std::string& out) const;
+    
+    // Score, flags and cards for a room snapshot, and back; id, name and
+    // handle are the room's to write
+    void appendSnapshot(std::string& out) const;
+    bool restoreSnapshot(BinaryReader& in);
+    
+    int makeAIChoice(GameRandom& random);
+};
+
+const int DECK_STRENGTHS = 10;
+const size_t DECK_SIZE = 6 * DECK_STRENGTHS;
+
+template <size_t... Index>
+constexpr std::array<Card, DECK_SIZE> buildElementalDeck(std::index_sequence<Index...>) {
+    return {{ Card(static_cast<Element>(Index / DECK_STRENGTHS), static_cast<int>(Index % DECK_STRENGTHS) + 1)... }};
+}
+
+// Strengths 1-10 of each element, built at compile time
+constexpr std::array<Card, DECK_SIZE> ELEMENTAL_DECK = buildElementalDeck(std::make_index_sequence<DECK_SIZE>());
+static_assert(ELEMENTAL_DECK[DECK_SIZE - 1].getElement() == Element::POWER &&
+              ELEMENTAL_DECK[DECK_SIZE - 1].getStrength() == DECK_STRENGTHS, "Deck layout");
+
+// Where a card sits in ELEMENTAL_DECK; no two cards in the deck are alike
+constexpr size_t deckIndexOf(Card card) {
+    return static_cast<size_t>(card.getElement()) * DECK_STRENGTHS + card.getStrength() - 1;
+}
+static_assert(deckIndexOf(ELEMENTAL_DECK[37]) == 37, "Deck index");
+
+// A game's deck is just an order over ELEMENTAL_DECK's indices, shuffled in
+// place and dealt from the front. Nothing here allocates.
 class Deck {
 private:
-    std::vector<Card> cards;
+    std::array<uint8_t, DECK_SIZE> order;
+    size_t next;
 
 public:
     Deck();
-    void shuffle();
+    void reset();
+    void shuffle(GameRandom& random);
     Card draw();
+    // Deals the next count cards (fewer if the deck runs out) into hand
+    void deal(size_t count, Player::CardList& hand);
     bool isEmpty() const;
     int size() const;
-class GameRoom {
+    // The cards dealt so far, one bit per ELEMENTAL_DECK index
+    uint64_t getDealtMask() const;
+    
+    // The order and how far it has been dealt, for room snapshots
+    void appendSnapshot(std::string& out) const;
+    bool restoreSnapshot(BinaryReader& in);
+};
+
+class AiPersonality;
+
+class GameRoom : public std::enable_shared_from_this<GameRoom> {
+public:
+    static const int MAX_PLAYERS = 4;
+    // Seated players in turn order; they live in the room's own storage
+    using PlayerList = InlineVector<Player*, MAX_PLAYERS>;
+
 private:
     std::string roomId;
-    std::vector<std::shared_ptr<Player>> players;
+    RoomHandle handle;
+    // Players are constructed in place here, so a room and its players are
+    // one allocation; a seat is emptied when its player leaves
+    std::array<std::optional<Player>, MAX_PLAYERS> playerStorage;
+    PlayerList players;
+    // Players who have ever joined; the generation of the next one's handle
+    uint32_t joins;
     Deck deck;
-    int currentPlayerIndex;
+    uint64_t seed;
+    GameRandom random;
     int maxPlayers;
+    int currentPlayerIndex;
     bool gameStarted;
     bool gameOver;
     int roundsPlayed;
+    uint64_t playedCardMask;
+    const AiPersonality* personality;
+    bool matchmaking;
+    EventJournal* journal;
+    uint64_t turnNumber;
+    RoomMailbox mailbox;
+    LobbySlot lobbySlot;
+    uint64_t version;
+    bool changed;
+    std::chrono::steady_clock::time_point lastActivity;
+    std::vector<std::shared_ptr<ClientSession>> subscribers;
+    std::vector<std::shared_ptr<ClientSession>> spectators;
+    
+    // An encoded message and the room version it was built from
+    struct EncodedState {
+        SharedBuffer buffer;
+        uint64_t version = 0;
+    };
+    // GAME_STATE replies and STATE_UPDATE pushes, one of each per WireFormat
+    mutable EncodedState stateReplies[2];
+    mutable EncodedState stateUpdates[2];
+    mutable EncodedState snapshotRecord;
+    
+    SharedBuffer getEncoded(EncodedState& cache, WireFormat format, bool update) const;
+    void broadcast(std::vector<std::shared_ptr<ClientSession>>& sessions);
+    
+    void markChanged();
+    bool seat(std::string_view playerId, std::string_view playerName, bool isAI);
+    // Whether a restored room agrees with itself the way a played one does
+    bool isReachable() const;
+    
+    // powerIndex is RANDOM_POWER_CARD or where the POWER follow-up is in the
+    // hand once the card itself is gone (NO_POWER_CARD for none)
+    static const int RANDOM_POWER_CARD = -2;
+    bool play(PlayerHandle playerHandle, int cardIndex, int powerIndex, bool automatic);
+    
+    template <typename Fill>
+    void journalEvent(JournalEvent type, Fill&& fill) {
+        if (journal) {
+            journal->append(type, handle.raw(), std::forward<Fill>(fill));
+        }
+    }
 
 public:
-    GameRoom(const std::string& id, int maxP = 2);
+    static const int ROUNDS_PER_GAME = 5;
+    
+    // Every random choice in the room (shuffles, AI moves, extra POWER
+    // cards) comes from one generator seeded here, so two rooms with the
+    // same seed that receive the same commands play out identically. Rooms
+    // hold at most MAX_PLAYERS.
+    GameRoom(const std::string& id, int maxP = 2, uint64_t seed = GameRandom::freshSeed());
+    
+    // A room allocated from the calling thread's slab pool (see SlabPool)
+    // rather than the general heap; it goes back to the pool once the last
+    // reference to it is gone
+    static std::shared_ptr<GameRoom> create(const std::string& id, int maxP, uint64_t seed);
+    
+    // How the room's AI opponent plays; null leaves it to the GameServer's
+    // search. Set before players join, so the AI takes the personality's name.
+    void setPersonality(const AiPersonality* aiPersonality);
+    const AiPersonality* getPersonality() const;
+    
+    // Commands for this room are queued here and run by its RoomExecutor
+    // worker; room state must only be touched from tasks on that worker
+    RoomMailbox& getMailbox();
+    LobbySlot& getLobbySlot();
+    
+    // A quick-match room waits for a second human instead of seating the AI
+    // when its first player joins, and is kept out of the lobby listing
+    void setMatchmaking(bool enabled);
+    bool isMatchmaking() const;
+    
+    // The room's name inside the server, given when it is registered
+    RoomHandle getHandle() const;
+    void setHandle(RoomHandle roomHandle);
     
-    bool addPlayer(std::shared_ptr<Player> player);
-    bool removePlayer(const std::string& playerId);
+    bool addPlayer(std::string_view playerId, std::string_view playerName);
+    // Seats the AI opponent, named after the room's personality if it has one
+    bool addAiOpponent();
+    bool removePlayer(std::string_view playerId);
+    bool removePlayer(PlayerHandle player);
+    
+    // Every change to the room is journaled from here on; set once the
+    // room has its handle, which names it in the journal
+    void setJournal(EventJournal* eventJournal);
+    
+    // Rebuilding a room (JournalReplay): seats the player as recorded, with
+    // no AI opponent added for them, and plays a card with the recorded
+    // POWER follow-up instead of a random one. False if the room can't
+    // take the player (the same checks as addPlayer) or the play doesn't
+    // fit the hand.
+    static const int NO_POWER_CARD = -1;
+    bool restorePlayer(std::string_view playerId, std::string_view playerName, bool isAI);
+    bool replayCard(PlayerHandle player, int cardIndex, int powerIndex);
     
     bool startGame();
     void dealCards(int cardsPerPlayer);
     
-    bool chooseCard(const std::string& playerId, int cardIndex);
+    bool chooseCard(std::string_view playerId, int cardIndex);
+    bool chooseCard(PlayerHandle player, int cardIndex);
+    // Plays the current player's turn with the AI's choice: how AI
+    // opponents move, and what happens to a human whose turn timed out.
+    // The AI uses the room's personality if it has one; humans play at random.
+    bool autoPlay();
     void resolveRound();
     void nextTurn();
     
-    std::shared_ptr<Player> getCurrentPlayer() const;
-    std::shared_ptr<Player> getPlayer(const std::string& playerId) const;
-    std::shared_ptr<Player> getWinner() const;
+    // Player pointers stay valid while the player is in the room
+    const PlayerList& getPlayers() const;
+    Player* getCurrentPlayer() const;
+    Player* getPlayer(std::string_view playerId) const;
+    // Null if the handle is stale: the player left, or never joined this room
+    Player* getPlayer(PlayerHandle player) const;
+    // The handle of the player with this id, invalid if there is none
+    PlayerHandle findPlayer(std::string_view playerId) const;
+    Player* getWinner() const;
     
-    std::string getRoomId() const;
+    const std::string& getRoomId() const;
+    uint64_t getSeed() const;
     int getPlayerCount() const;
+    int getMaxPlayers() const;
     bool isGameStarted() const;
     bool isGameOver() const;
+    int getRoundsPlayed() const;
+    // Every card played so far this game, one bit per ELEMENTAL_DECK index
+    uint64_t getPlayedCardMask() const;
+    
+    // Goes up every time the turn passes to someone, so a timer armed for
+    // one turn can tell that the turn it was meant for is over
+    uint64_t getTurnNumber() const;
+    
+    // Every task that changes the room publishes once when it finishes: the
+    // version goes up by exactly one and each subscriber is pushed the new
+    // state, so a client that sees a version skip has missed an update.
+    uint64_t getVersion() const;
+    void publishChanges();
+    
+    // When the room was created or last published a change
+    std::chrono::steady_clock::time_point getLastActivity() const;
+    
+    // Drops every subscriber and spectator; called once the room is evicted
+    void detachSessions();
+    
+    // Adds the session (once) and pushes it the current state
+    void subscribe(std::shared_ptr<ClientSession> session);
+    size_t getSubscriberCount() const;
+    
+    // Spectators get the same pushes as subscribers but are not players, so
+    // they don't count against maxPlayers and there is no limit on them
+    void addSpectator(std::shared_ptr<ClientSession> session);
+    size_t getSpectatorCount() const;
+    
+    // The encoded GAME_STATE reply / STATE_UPDATE push for the current
+    // version. Built at most once per version and format, then shared by
+    // every reader and every subscriber.
+    SharedBuffer getStateReply(WireFormat format) const;
+    SharedBuffer getStateUpdate(WireFormat format) const;
+    
+    std::string getGameState() const;
+    void appendGameState(std::string& out) const;
+    void appendBinaryState(std::string& out) const;
+    
+    // The room's whole state as one compact record: players and their
+    // cards, the deck order, scores, counters and the generator's state.
+    // Built at most once per version and shared, so a room that hasn't
+    // changed since the last snapshot costs nothing to snapshot again.
+    SharedBuffer getSnapshot() const;
+    void appendSnapshot(std::string& out) const;
+    // The room a snapshot record was taken from, or null if the record
+    // doesn't parse or holds what no game could reach: a card outside the
+    // deck, undealt or held twice, a played-card mask that disagrees with
+    // the hands and table, more points than rounds, or turn and join
+    // counters out of step with them. Subscribers, timers and the
+    // personality aren't part of it; personalityKey gets the
+    // personality's key, empty for none.
+    static std::shared_ptr<GameRoom> restore(std::string_view record, std::string& personalityKey);
+};
+
+// How long a room may sit without a change before it is removed. Finished
+// games go sooner; anything else (waiting for players, abandoned mid-game)
+// gets the idle TTL.
+struct RoomLifecycle {
+    std::chrono::steady_clock::duration idleTtl = std::chrono::minutes(10);
+    std::chrono::steady_clock::duration finishedTtl = std::chrono::minutes(1);
+};
+
+// Pacing of a started game. The AI answers aiThinkDelay after the human's
+// move (zero: as soon as the move has been replied to). A human who doesn't
+// play within turnTimeout has a card played for them; zero disables it. A
+// quick-match player nobody is paired with within quickMatchWait plays the
+// AI; zero seats the AI straight away.
+struct TurnTiming {
+    std::chrono::steady_clock::duration aiThinkDelay = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::duration turnTimeout = std::chrono::seconds(30);
+    std::chrono::steady_clock::duration quickMatchWait = std::chrono::seconds(10);
+};
+
+// How AI players choose their cards (see AiSearch)
+struct AiSettings {
+    // Rollouts per move, split over the search threads; zero turns the
+    // search off and the AI plays a random card
+    size_t rollouts = 2048;
+    // Wall-clock limit per move, after which the rollouts done so far
+    // decide; zero means no limit
+    std::chrono::steady_clock::duration budget = std::chrono::milliseconds(20);
+    // Search threads; zero means one per hardware thread
+    size_t threads = 0;
+    // Solve the rest of the game exactly (EndgameSolver) once this many
+    // rounds or fewer remain; zero never does. HARD_ENDGAME_ROUNDS is the
+    // hard AI, which solves every move after the first round.
+    int endgameRounds = 0;
+    static const int HARD_ENDGAME_ROUNDS = 4;
+};
+
+struct AiChoice;
+
+class AiSearch;
+class PersonalityTable;
+
 class GameServer {
 private:
-    std::map<std::string, std::shared_ptr<GameRoom>> rooms;
-    int nextRoomId;
-
-public:
-    GameServer();
+    RoomRegistry rooms;
+    Lobby lobby;
+    // The quick-match room whose player is waiting for an opponent, if any
+    std::mutex matchMutex;
+    std::shared_ptr<GameRoom> waitingRoom;
+    std::atomic<uint64_t> nextRoomId;
+    std::atomic<uint64_t> evictedRooms;
+    std::atomic<uint64_t> timedOutTurns;
+    RoomLifecycle lifecycle;
+    TurnTiming turnTiming;
+    AiSettings aiSettings;
+    // Declared before the executor so they outlive the workers, which
+    // journal what rooms do, schedule expiry checks and turn timers and
+    // start AI searches
+    std::unique_ptr<EventJournal> journal;
+    Scheduler scheduler;
+    std::unique_ptr<AiSearch> aiSearch;
+    std::unique_ptr<PersonalityTable> personalities;
+    RoomExecutor executor;
+    
+    // Periodic snapshots (startSnapshots), and one snapshot written at a time
+    std::mutex snapshotMutex;
+    std::condition_variable snapshotWake;
+    bool snapshotsStopping;
+    std::thread snapshotThread;
+    std::mutex snapshotWriteMutex;
+    
+    void stopSnapshots();
+    
+    std::shared_ptr<GameRoom> makeRoom(int maxPlayers, uint64_t seed, const AiPersonality* personality,
+                                       bool matchmaking = false);
+    
+    // Seats the AI in a quick-match room still waiting when its wait is up
+    void scheduleMatchFallback(const std::shared_ptr<GameRoom>& room);
+    
+    // Runs work on the room's worker and blocks until it has finished
+    bool runAndWait(std::string_view roomId, const std::function<void(GameRoom&)>& work);
+    
+    // Each room has one pending expiry check. It fires on the timer thread,
+    // runs on the room's worker and either evicts the room or re-arms for
+    // the room's new deadline, so activity costs nothing but a timestamp.
+    void scheduleExpiry(const std::shared_ptr<GameRoom>& room, std::chrono::steady_clock::duration delay);
+    void checkExpiry(GameRoom& room);
+    
+    // Arms the current turn's timer: the AI's move after its think delay,
+    // or the human's turn timeout. Stale timers see the turn number moved on.
+    void scheduleTurn(GameRoom& room);
+    
+    // Searches for the AI's card off the room's worker; the card is played
+    // by a later task if the turn hasn't moved on by then
+    void startSearch(GameRoom& room);
+    
+    // Hints are solved like the hard AI's moves, on the search pool
+    AiSettings hintSettings() const;
     
-    std::string createRoom(int maxPlayers = 2);
-    bool joinRoom(const std::string& roomId, const std::string& playerId, const std::string& playerName);
-    bool leaveRoom(const std::string& roomId, const std::string& playerId);
+    // Timers that follow from what a task just did to the room
+    void afterTask(GameRoom& room, bool wasOver, uint64_t turnBefore);
     
-    bool startGame(const std::string& roomId);
-    bool chooseCard(const std::string& roomId, const std::string& playerId, int cardIndex);
+    // Runs fn as one published step of the room's current task
+    template <typename Fn>
+    void runStep(GameRoom& target, Fn& fn) {
+        bool wasOver = target.isGameOver();
+        uint64_t turnBefore = target.getTurnNumber();
+        fn(target);
+        lobby.update(target);
+        target.publishChanges();
+        afterTask(target, wasOver, turnBefore);
+    }
     
-    std::string getRoomState(const std::string& roomId);
-    std::vector<std::string> getAvailableRooms();
-};  int nextRoomId;
+    template <typename Fn>
+    void post(const std::shared_ptr<GameRoom>& room, Fn&& fn) {
+        executor.submit(room, room->getMailbox(), [this, fn = std::forward<Fn>(fn)](GameRoom& target) mutable {
+            runStep(target, fn);
+        });
+    }
 
 public:
-    GameServer();
+    static const int CARDS_PER_PLAYER = 5;
     
+    explicit GameServer(size_t workerThreads = 0);
+    ~GameServer();
+    
+    // Set before any room is created
+    void setLifecycle(const RoomLifecycle& settings);
+    void setTurnTiming(const TurnTiming& settings);
+    void setAiSettings(const AiSettings& settings);
+    // The personalities rooms can be created with; the built-in ones by default
+    void setPersonalities(const PersonalityTable& table);
+    const AiPersonality* findPersonality(std::string_view key) const;
+    // Journals every room from here on (see EventJournal); call before any
+    // room is created
+    bool openJournal(const JournalSettings& settings, std::string& error);
+    // Null unless a journal is open
+    EventJournal* getJournal() const;
+    
+    // Writes every live room to path (see SnapshotFile). Each room's record
+    // is taken by a task on the room's own worker, between two commands, so
+    // rooms keep playing while the others are copied; a room unchanged since
+    // the last snapshot hands over the record it built then. Never call
+    // from a room task.
+    bool writeSnapshot(const std::string& path, std::string& error);
+    // Brings back every room of a snapshot as it was snapshotted, as if
+    // the rooms had never gone away: players resume with their next
+    // command, turn timers and quick-match waits are armed afresh and idle
+    // clocks restart. Call after the journal and personalities are set and
+    // before any room is created. False, with nothing restored, if the file
+    // can't be read, ends part way through a room or holds a record that
+    // doesn't parse or whose id is taken.
+    bool restoreSnapshot(const std::string& path, size_t& restored, std::string& error);
+    // Writes a snapshot to path every interval on a thread of its own,
+    // until the server is destroyed
+    void startSnapshots(const std::string& path, std::chrono::steady_clock::duration interval);
+    
+    // Asynchronous entry point used by the network layer: queues fn(GameRoom&)
+    // on the room's worker. Returns false if the room does not exist.
+    template <typename Fn>
+    bool submit(std::string_view roomId, Fn&& fn) {
+        auto room = rooms.find(roomId);
+        if (!room) {
+            return false;
+        }
+        post(room, std::forward<Fn>(fn));
+        return true;
+    }
+    
+    // The same by handle; false if the handle is stale
+    template <typename Fn>
+    bool submit(RoomHandle handle, Fn&& fn) {
+        auto room = rooms.find(handle);
+        if (!room) {
+            return false;
+        }
+        post(room, std::forward<Fn>(fn));
+        return true;
+    }
+    
+    static bool startAndDeal(GameRoom& room);
+    
+    // Works out the best card for the player, who must be the one to move,
+    // and calls onDone with it on a search thread; cardIndex is -1 if the
+    // player can't move. Call from a task on the room's worker.
+    void requestHint(GameRoom& room, std::string_view playerId, std::function<void(const AiChoice&)> onDone);
+    
+    // Pairs the player with the quick-match player waiting for an opponent
+    // and starts their game, or opens a two-player room for them to wait in.
+    // onDone gets the room id, or an empty string if the player couldn't be
+    // seated, on the room's worker.
+    void quickMatch(std::string_view playerId, std::string_view playerName,
+                    std::function<void(const std::string&)> onDone);
+    
+    // The rooms that can be joined, as of the last change to any of them
+    Lobby::Snapshot getOpenRooms();
+    
+    // Blocking conveniences built on submit(); never call them from a room task
+
     std::string createRoom(int maxPlayers = 4);
-    bool joinRoom(const std::string& roomId, const std::string& playerId, const std::string& playerName);
-    bool leaveRoom(const std::string& roomId, const std::string& playerId);
+    // A personality makes a two-player room against that AI
+    std::string createRoom(int maxPlayers, uint64_t seed, const AiPersonality* personality = nullptr);
+    bool joinRoom(std::string_view roomId, std::string_view playerId, std::string_view playerName);
+    bool leaveRoom(std::string_view roomId, std::string_view playerId);
     
-    bool startGame(const std::string& roomId);
-    bool playCard(const std::string& roomId, const std::string& playerId, int cardIndex);
+    bool startGame(std::string_view roomId);
+    bool playCard(std::string_view roomId, std::string_view playerId, int cardIndex);
     
-    std::string getRoomState(const std::string& roomId);
-    std::vector<std::string> getAvailableRooms();
+    std::shared_ptr<GameRoom> findRoom(std::string_view roomId);
+    std::shared_ptr<GameRoom> findRoom(RoomHandle handle);
+    RoomHandle lookupRoom(std::string_view roomId) const;
+    std::string getRoomState(std::string_view roomId);
+    size_t getRoomCount() const;
+    uint64_t getCreatedRoomCount() const;
+    uint64_t getEvictedRoomCount() const;
+    uint64_t getTimedOutTurnCount() const;
+    Scheduler::LagStats getTimerLag() const;
 };
 
 #endif // CARD_GAME_H
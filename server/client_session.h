@@ -0,0 +1,34 @@
+#ifndef CLIENT_SESSION_H
+#define CLIENT_SESSION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Wire protocol a connection negotiated (see wire_protocol.h)
+enum class WireFormat : uint8_t {
+    TEXT,
+    BINARY
+};
+
+// An encoded message that is never modified once built, so one copy can be
+// handed to any number of connections
+using SharedBuffer = std::shared_ptr<const std::string>;
+
+// A client connection as seen from the game side. Rooms hold on to the
+// sessions of their subscribers so they can push messages that are not a
+// reply to any command. Implementations must be callable from any thread.
+class ClientSession {
+public:
+    virtual ~ClientSession() = default;
+
+    virtual WireFormat getFormat() const = 0;
+
+    // Queues an encoded message for the client. Messages pushed with the
+    // same stream key are snapshots that supersede each other, so a client
+    // that falls behind may be sent only the latest. Returns false once the
+    // connection has closed; the caller should then drop the session.
+    virtual bool push(SharedBuffer message, const void* stream) = 0;
+};
+
+#endif // CLIENT_SESSION_H
@@ -0,0 +1,205 @@
+#include "command_parser.h"
+#include <array>
+#include <charconv>
+
+#include "game_random.h"
+
+namespace {
+
+struct VerbEntry {
+    std::string_view verb;
+    CommandType type;
+};
+
+constexpr VerbEntry VERBS[] = {
+    { "CREATE_ROOM", CommandType::CREATE_ROOM },
+    { "JOIN_ROOM", CommandType::JOIN_ROOM },
+    { "START_GAME", CommandType::START_GAME },
+    { "PLAY_CARD", CommandType::PLAY_CARD },
+    { "GET_STATE", CommandType::GET_STATE },
+    { "SUBSCRIBE", CommandType::SUBSCRIBE },
+    { "SPECTATE", CommandType::SPECTATE },
+    { "STATS", CommandType::STATS },
+    { "HINT", CommandType::HINT },
+    { "QUICK_MATCH", CommandType::QUICK_MATCH },
+    { "LIST_ROOMS", CommandType::LIST_ROOMS },
+};
+
+const size_t VERB_COUNT = sizeof(VERBS) / sizeof(VERBS[0]);
+const size_t VERB_TABLE_SIZE = 64; // power of two
+
+static_assert(VERB_COUNT == COMMAND_TYPE_COUNT, "Every CommandType needs a verb");
+
+constexpr size_t hashVerb(std::string_view verb, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : verb) {
+        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return h & (VERB_TABLE_SIZE - 1);
+}
+
+constexpr bool seedIsPerfect(uint32_t seed) {
+    for (size_t i = 0; i < VERB_COUNT; i++) {
+        for (size_t j = i + 1; j < VERB_COUNT; j++) {
+            if (hashVerb(VERBS[i].verb, seed) == hashVerb(VERBS[j].verb, seed)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Searches for the first FNV-1a seed that maps every verb to its own slot
+constexpr uint32_t findPerfectSeed() {
+    for (uint32_t seed = 0; seed < 4096; seed++) {
+        if (seedIsPerfect(seed)) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t VERB_SEED = findPerfectSeed();
+static_assert(VERB_SEED != UINT32_MAX, "No perfect hash seed for the command verbs; grow VERB_TABLE_SIZE");
+
+constexpr std::array<VerbEntry, VERB_TABLE_SIZE> buildVerbTable() {
+    std::array<VerbEntry, VERB_TABLE_SIZE> table{};
+    for (auto& slot : table) {
+        slot = { std::string_view(), CommandType::UNKNOWN };
+    }
+    for (const auto& entry : VERBS) {
+        table[hashVerb(entry.verb, VERB_SEED)] = entry;
+    }
+    return table;
+}
+
+constexpr std::array<VerbEntry, VERB_TABLE_SIZE> VERB_TABLE = buildVerbTable();
+
+// Splits off the next space-delimited token, skipping repeated spaces
+std::string_view nextToken(std::string_view& rest) {
+    size_t start = rest.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        rest = std::string_view();
+        return std::string_view();
+    }
+    rest.remove_prefix(start);
+    size_t end = rest.find(' ');
+    std::string_view token = rest.substr(0, end);
+    rest.remove_prefix(end == std::string_view::npos ? rest.size() : end);
+    return token;
+}
+
+bool parseUnsigned(std::string_view token, uint32_t& value) {
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+// The last argument of a command takes the remainder of the line, so player
+// names may contain spaces
+std::string_view remainder(std::string_view rest) {
+    size_t start = rest.find_first_not_of(' ');
+    if (start == std::string_view::npos) return std::string_view();
+    return rest.substr(start);
+}
+
+} // namespace
+
+CommandType lookupVerb(std::string_view verb) {
+    const VerbEntry& entry = VERB_TABLE[hashVerb(verb, VERB_SEED)];
+    return entry.verb == verb ? entry.type : CommandType::UNKNOWN;
+}
+
+ParseStatus parseCommand(std::string_view line, Command& command) {
+    std::string_view rest = line;
+    command = Command();
+    command.type = lookupVerb(nextToken(rest));
+
+    switch (command.type) {
+        case CommandType::CREATE_ROOM: {
+            // CREATE_ROOM [seed] [personality]
+            std::string_view seed = nextToken(rest);
+            if (seed.empty()) {
+                return ParseStatus::OK;
+            }
+            if (seed[0] < '0' || seed[0] > '9') {
+                // Personality keys never start with a digit
+                command.personality = seed;
+                return ParseStatus::OK;
+            }
+            auto result = std::from_chars(seed.data(), seed.data() + seed.size(), command.seed);
+            // Seeds are echoed in JSON, where only 53 bits survive
+            if (result.ec != std::errc() || result.ptr != seed.data() + seed.size() ||
+                command.seed > GameRandom::SEED_MASK) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            command.seeded = true;
+            command.personality = nextToken(rest);
+            return ParseStatus::OK;
+        }
+
+        case CommandType::STATS:
+            return ParseStatus::OK;
+
+        case CommandType::JOIN_ROOM:
+            // JOIN_ROOM <roomId> <playerId> <playerName>
+            command.roomId = nextToken(rest);
+            command.playerId = nextToken(rest);
+            command.playerName = remainder(rest);
+            if (command.roomId.empty() || command.playerId.empty() || command.playerName.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            return ParseStatus::OK;
+
+        case CommandType::START_GAME:
+        case CommandType::GET_STATE:
+        case CommandType::SUBSCRIBE:
+        case CommandType::SPECTATE:
+            // <verb> <roomId>
+            command.roomId = remainder(rest);
+            return command.roomId.empty() ? ParseStatus::INVALID_ARGUMENTS : ParseStatus::OK;
+
+        case CommandType::HINT:
+            // HINT <roomId> <playerId>
+            command.roomId = nextToken(rest);
+            command.playerId = nextToken(rest);
+            if (command.roomId.empty() || command.playerId.empty() || !remainder(rest).empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            return ParseStatus::OK;
+
+        case CommandType::QUICK_MATCH:
+            // QUICK_MATCH <playerId> <playerName>
+            command.playerId = nextToken(rest);
+            command.playerName = remainder(rest);
+            if (command.playerId.empty() || command.playerName.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            return ParseStatus::OK;
+
+        case CommandType::LIST_ROOMS: {
+            // LIST_ROOMS [offset] [limit]
+            std::string_view offset = nextToken(rest);
+            std::string_view limit = nextToken(rest);
+            bool valid = (offset.empty() || parseUnsigned(offset, command.offset)) &&
+                         (limit.empty() || parseUnsigned(limit, command.limit));
+            return valid ? ParseStatus::OK : ParseStatus::INVALID_ARGUMENTS;
+        }
+
+        case CommandType::PLAY_CARD: {
+            // PLAY_CARD <roomId> <playerId> <cardIndex>
+            command.roomId = nextToken(rest);
+            command.playerId = nextToken(rest);
+            std::string_view index = nextToken(rest);
+            if (command.roomId.empty() || command.playerId.empty() || index.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            auto result = std::from_chars(index.data(), index.data() + index.size(), command.cardIndex);
+            if (result.ec != std::errc() || result.ptr != index.data() + index.size()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            return ParseStatus::OK;
+        }
+
+        case CommandType::UNKNOWN:
+            break;
+    }
+    return ParseStatus::UNKNOWN_COMMAND;
+}
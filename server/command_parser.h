@@ -0,0 +1,56 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+enum class CommandType : uint8_t {
+    CREATE_ROOM,
+    JOIN_ROOM,
+    START_GAME,
+    PLAY_CARD,
+    GET_STATE,
+    SUBSCRIBE,
+    SPECTATE,
+    STATS,
+    HINT,
+    QUICK_MATCH,
+    LIST_ROOMS,
+    UNKNOWN
+};
+
+const size_t COMMAND_TYPE_COUNT = static_cast<size_t>(CommandType::UNKNOWN);
+
+enum class ParseStatus : uint8_t {
+    OK,
+    UNKNOWN_COMMAND,
+    INVALID_ARGUMENTS
+};
+
+// A tokenized command. All views point into the caller's line buffer and are
+// only valid while that buffer is.
+struct Command {
+    CommandType type = CommandType::UNKNOWN;
+    std::string_view roomId;
+    std::string_view playerId;
+    std::string_view playerName;
+    int cardIndex = -1;
+    // CREATE_ROOM may name the room's random seed to replay a game exactly
+    bool seeded = false;
+    uint64_t seed = 0;
+    // and an AI personality to play against, for a two-player room
+    std::string_view personality;
+    // LIST_ROOMS pages through the lobby; a zero limit means the default
+    uint32_t offset = 0;
+    uint32_t limit = 0;
+};
+
+// Maps a verb to its CommandType through a perfect hash table built at
+// compile time; costs one hash and at most one string compare.
+CommandType lookupVerb(std::string_view verb);
+
+// Tokenizes one framed command line in place. Never allocates or throws.
+ParseStatus parseCommand(std::string_view line, Command& command);
+
+#endif // COMMAND_PARSER_H
@@ -0,0 +1,399 @@
+#include "endgame_solver.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+
+namespace {
+
+// Cards are grouped into 20 classes: strengths 1-10 of the plain elements
+// (classes 0-9) and strengths 1-10 of POWER (classes 10-19). A set of cards
+// is a count per class packed into 40 bits: three bits per plain class,
+// since five elements share a strength, and one bit per POWER class.
+const int PLAIN_CLASSES = DECK_STRENGTHS;
+const int CLASSES = 2 * DECK_STRENGTHS;
+const int POWER_SHIFT = 3 * PLAIN_CLASSES;
+const uint64_t PLAIN_MASK = (uint64_t(1) << POWER_SHIFT) - 1;
+
+int classOf(Card card) {
+    int plain = card.getStrength() - 1;
+    return card.getElement() == Element::POWER ? PLAIN_CLASSES + plain : plain;
+}
+
+bool isPowerClass(int cls) {
+    return cls >= PLAIN_CLASSES;
+}
+
+int strengthOf(int cls) {
+    return cls % PLAIN_CLASSES + 1;
+}
+
+int shiftOf(int cls) {
+    return isPowerClass(cls) ? POWER_SHIFT + cls - PLAIN_CLASSES : 3 * cls;
+}
+
+int countOf(uint64_t counts, int cls) {
+    return static_cast<int>((counts >> shiftOf(cls)) & (isPowerClass(cls) ? 1 : 7));
+}
+
+int powerCount(uint64_t counts) {
+    return static_cast<int>(std::bitset<64>(counts >> POWER_SHIFT).count());
+}
+
+// Binomial coefficients up to the deck size, zero outside 0 <= r <= n
+struct Binomials {
+    double values[DECK_SIZE + 1][DECK_SIZE + 1] = {};
+
+    Binomials() {
+        for (size_t n = 0; n <= DECK_SIZE; n++) {
+            values[n][0] = 1;
+            for (size_t r = 1; r <= n; r++) {
+                values[n][r] = values[n - 1][r - 1] + (r < n ? values[n - 1][r] : 0);
+            }
+        }
+    }
+
+    double operator()(int n, int r) const {
+        return n < 0 || r < 0 || r > n ? 0.0 : values[n][r];
+    }
+};
+
+const Binomials BINOMIAL;
+
+// Relative likelihood of the opponent's hand holding j POWER cards after
+// it has made `doubles` POWER double plays. Each double play picks its
+// second card at random among the POWER cards then in hand, so it favours
+// hands that had fewer of them: w(d + 1, j) = w(d, j + 2) / (j + 1).
+double powerWeight(int doubles, int j) {
+    double weight = 1;
+    for (int t = 0; t < doubles; t++) {
+        weight /= j + 1 + 2 * t;
+    }
+    return weight;
+}
+
+double outcome(int margin) {
+    return margin > 0 ? 1.0 : margin == 0 ? 0.5 : 0.0;
+}
+
+uint64_t mixKey(uint64_t low, uint32_t high) {
+    uint64_t z = low ^ (uint64_t(high) * 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+const size_t BUCKET_ENTRIES = 4;
+// Values come back from the table as floats; choices closer than this are
+// ties and go to the earlier card
+const double TIE_EPSILON = 1e-6;
+
+} // namespace
+
+// A position between moves. hand and pool use the packed class counts;
+// pool holds every card the opponent might have in its hand.
+struct EndgameSolver::State {
+    uint64_t hand = 0;
+    uint64_t pool = 0;
+    int handSize = 0;
+    int poolSize = 0;
+    int opponentHandSize = 0;
+    int doubles = 0;
+    int margin = 0; // my score minus theirs
+    int rounds = 0;
+    int seat = 0;
+
+    void removeFromHand(int cls) {
+        hand -= uint64_t(1) << shiftOf(cls);
+        handSize--;
+    }
+
+    void removeFromPool(int cls) {
+        pool -= uint64_t(1) << shiftOf(cls);
+        poolSize--;
+        if (powerCount(pool) == 0) {
+            doubles = 0; // nothing left for the weights to tell apart
+        }
+    }
+
+    // The opponent showed it holds no POWER card
+    void dropPoolPowers() {
+        poolSize -= powerCount(pool);
+        pool &= PLAIN_MASK;
+        doubles = 0;
+    }
+
+    // 40 bits of pool and the low 24 of hand, then the rest of hand and the
+    // small fields; bit 31 of high marks the slot as used
+    uint64_t keyLow() const {
+        return pool | (hand << 40);
+    }
+
+    uint32_t keyHigh() const {
+        return static_cast<uint32_t>(hand >> 24) | static_cast<uint32_t>(opponentHandSize) << 16 |
+               static_cast<uint32_t>(doubles) << 20 | static_cast<uint32_t>(margin + 8) << 22 |
+               static_cast<uint32_t>(rounds) << 26 | static_cast<uint32_t>(seat) << 29 | 1u << 31;
+    }
+};
+
+EndgameSolver::EndgameSolver(size_t tableEntries)
+    : nodes(0), nodeLimit(DEFAULT_NODE_LIMIT), aborted(false), hits(0), stores(0) {
+    size_t buckets = 1;
+    while (buckets * BUCKET_ENTRIES < tableEntries) {
+        buckets *= 2;
+    }
+    table.assign(buckets * BUCKET_ENTRIES, Entry{ 0, 0, 0.0f });
+    bucketMask = buckets - 1;
+}
+
+void EndgameSolver::clear() {
+    std::fill(table.begin(), table.end(), Entry{ 0, 0, 0.0f });
+}
+
+bool EndgameSolver::lookup(uint64_t low, uint32_t high, double& value) {
+    const Entry* bucket = &table[(mixKey(low, high) & bucketMask) * BUCKET_ENTRIES];
+    for (size_t i = 0; i < BUCKET_ENTRIES; i++) {
+        if (bucket[i].high == high && bucket[i].low == low) {
+            value = bucket[i].value;
+            hits++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EndgameSolver::store(uint64_t low, uint32_t high, double value) {
+    uint64_t hash = mixKey(low, high);
+    Entry* bucket = &table[(hash & bucketMask) * BUCKET_ENTRIES];
+    // An empty slot if there is one, otherwise a pseudo-random victim
+    Entry* slot = &bucket[(hash >> 60) % BUCKET_ENTRIES];
+    for (size_t i = 0; i < BUCKET_ENTRIES; i++) {
+        if (bucket[i].high == 0) {
+            slot = &bucket[i];
+            break;
+        }
+    }
+    *slot = Entry{ low, high, static_cast<float>(value) };
+    stores++;
+}
+
+double EndgameSolver::roundValue(const State& state) {
+    if (state.rounds >= GameRoom::ROUNDS_PER_GAME) {
+        return outcome(state.margin);
+    }
+    uint64_t low = state.keyLow();
+    uint32_t high = state.keyHigh();
+    double value;
+    if (lookup(low, high, value)) {
+        return value;
+    }
+    if (++nodes > nodeLimit) {
+        aborted = true;
+    }
+    if (aborted) {
+        return 0;
+    }
+    value = state.seat == 0 ? myMove(state, -1) : opponentMove(state, -1);
+    if (!aborted) {
+        store(low, high, value);
+    }
+    return value;
+}
+
+double EndgameSolver::myMove(const State& state, int theirStrength) {
+    if (state.handSize == 0) {
+        return outcome(state.margin); // stalled
+    }
+    double best = 0;
+    for (int cls = 0; cls < CLASSES; cls++) {
+        if (countOf(state.hand, cls) > 0) {
+            best = std::max(best, afterMyCard(state, cls, theirStrength));
+        }
+    }
+    return best;
+}
+
+double EndgameSolver::afterMyCard(const State& state, int cls, int theirStrength) {
+    State next = state;
+    next.removeFromHand(cls);
+    int strength = strengthOf(cls);
+    int powers = isPowerClass(cls) ? powerCount(next.hand) : 0;
+    if (powers == 0) {
+        return finishMyPlay(next, strength, theirStrength);
+    }
+    // A random one of my other POWER cards follows
+    double value = 0;
+    for (int follow = PLAIN_CLASSES; follow < CLASSES; follow++) {
+        if (countOf(next.hand, follow) > 0) {
+            State doubled = next;
+            doubled.removeFromHand(follow);
+            value += finishMyPlay(doubled, strength + strengthOf(follow), theirStrength);
+        }
+    }
+    return value / powers;
+}
+
+double EndgameSolver::finishMyPlay(const State& state, int myStrength, int theirStrength) {
+    return theirStrength < 0 ? opponentMove(state, myStrength) : resolve(state, myStrength, theirStrength);
+}
+
+double EndgameSolver::opponentMove(const State& state, int myStrength) {
+    const int k = state.opponentHandSize;
+    if (k == 0) {
+        return outcome(state.margin); // stalled
+    }
+    const int d = state.doubles;
+    const int p = powerCount(state.pool);
+    const int q = state.poolSize - p;
+    auto next = [&](const State& after, int strength) {
+        return myStrength < 0 ? myMove(after, strength) : resolve(after, myStrength, strength);
+    };
+
+    // The opponent's hand holds j POWER cards with weight w(d, j) per hand.
+    // It plays each card of its hand with chance 1/k, so every plain card
+    // in the pool is equally likely to come out, and so is every POWER card.
+    double total = 0, plainShare = 0, powerShare = 0;
+    for (int j = 0; j <= std::min(k, p); j++) {
+        double w = powerWeight(d, j);
+        total += w * BINOMIAL(p, j) * BINOMIAL(q, k - j);
+        plainShare += w * BINOMIAL(p, j) * BINOMIAL(q - 1, k - 1 - j);
+        powerShare += w * BINOMIAL(p - 1, j - 1) * BINOMIAL(q, k - j);
+    }
+    if (total <= 0) {
+        return outcome(state.margin); // the pool can't hold its hand
+    }
+    plainShare /= k * total;
+    powerShare /= k * total;
+
+    double value = 0;
+    for (int cls = 0; cls < PLAIN_CLASSES; cls++) {
+        int count = countOf(state.pool, cls);
+        if (count > 0) {
+            State after = state;
+            after.removeFromPool(cls);
+            after.opponentHandSize--;
+            value += count * plainShare * next(after, strengthOf(cls));
+        }
+    }
+    if (p == 0) {
+        return value;
+    }
+
+    // After a POWER card the rest of the hand holds i POWER cards with
+    // weight w(d, i + 1): either none, and nothing follows, or one of them
+    // follows at random
+    const int rest = k - 1;
+    const int otherPowers = p - 1;
+    double restTotal = 0, followShare = 0;
+    for (int i = 0; i <= std::min(rest, otherPowers); i++) {
+        double w = powerWeight(d, i + 1);
+        restTotal += w * BINOMIAL(otherPowers, i) * BINOMIAL(q, rest - i);
+        if (i > 0) {
+            followShare += w * BINOMIAL(otherPowers - 1, i - 1) * BINOMIAL(q, rest - i) / i;
+        }
+    }
+    if (restTotal <= 0) {
+        return value;
+    }
+    double noFollow = powerWeight(d, 1) * BINOMIAL(q, rest) / restTotal;
+    followShare /= restTotal;
+
+    for (int cls = PLAIN_CLASSES; cls < CLASSES; cls++) {
+        if (countOf(state.pool, cls) == 0) continue;
+        State after = state;
+        after.removeFromPool(cls);
+        after.opponentHandSize--;
+        int strength = strengthOf(cls);
+
+        double played = 0;
+        if (noFollow > 0) {
+            State single = after;
+            single.dropPoolPowers();
+            played += noFollow * next(single, strength);
+        }
+        if (followShare > 0) {
+            for (int follow = PLAIN_CLASSES; follow < CLASSES; follow++) {
+                if (countOf(after.pool, follow) == 0) continue;
+                State doubled = after;
+                doubled.removeFromPool(follow);
+                doubled.opponentHandSize--;
+                if (powerCount(doubled.pool) > 0) {
+                    doubled.doubles = std::min(doubled.doubles + 1, 3);
+                }
+                played += followShare * next(doubled, strength + strengthOf(follow));
+            }
+        }
+        value += powerShare * played;
+    }
+    return value;
+}
+
+double EndgameSolver::resolve(State state, int myStrength, int theirStrength) {
+    if (myStrength > theirStrength) {
+        state.margin++;
+    } else if (theirStrength > myStrength) {
+        state.margin--;
+    }
+    state.rounds++;
+    return roundValue(state);
+}
+
+bool EndgameSolver::solve(const SearchPosition& position, Result& result, uint64_t limit) {
+    nodes = 0;
+    nodeLimit = limit;
+    aborted = false;
+    if (position.hand.empty() || position.roundsPlayed >= GameRoom::ROUNDS_PER_GAME) {
+        return false;
+    }
+
+    State root;
+    for (const auto& card : position.hand) {
+        root.hand += uint64_t(1) << shiftOf(classOf(card));
+    }
+    root.handSize = static_cast<int>(position.hand.size());
+    for (size_t i = 0; i < DECK_SIZE; i++) {
+        if (position.unseen & (uint64_t(1) << i)) {
+            root.pool += uint64_t(1) << shiftOf(classOf(ELEMENTAL_DECK[i]));
+            root.poolSize++;
+        }
+    }
+    root.opponentHandSize = static_cast<int>(position.opponentHandSize);
+    root.margin = position.scores[position.seat] - position.scores[1 - position.seat];
+    root.rounds = position.roundsPlayed;
+    root.seat = position.seat;
+
+    // What the opponent led with this round says whether it holds POWER
+    // cards: a lone POWER card means none are left in its hand
+    int theirStrength = -1;
+    if (!position.opponentPlayed.empty()) {
+        theirStrength = 0;
+        for (const auto& card : position.opponentPlayed) {
+            theirStrength += card.getStrength();
+        }
+        if (position.opponentPlayed[0].getElement() == Element::POWER) {
+            if (position.opponentPlayed.size() == 1) {
+                root.dropPoolPowers();
+            } else if (powerCount(root.pool) > 0) {
+                root.doubles = 1;
+            }
+        }
+    }
+
+    // One value per class; the first card of the best class is played
+    std::array<bool, CLASSES> tried{};
+    double best = -1;
+    for (size_t i = 0; i < position.hand.size(); i++) {
+        int cls = classOf(position.hand[i]);
+        if (tried[cls]) continue;
+        tried[cls] = true;
+        double value = afterMyCard(root, cls, theirStrength);
+        if (aborted) {
+            return false;
+        }
+        if (value > best + TIE_EPSILON) {
+            best = value;
+            result.cardIndex = static_cast<int>(i);
+            result.expectedScore = value;
+        }
+    }
+    return true;
+}
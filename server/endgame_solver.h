@@ -0,0 +1,83 @@
+#ifndef ENDGAME_SOLVER_H
+#define ENDGAME_SOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ai_search.h"
+
+// Exact expectimax over the rest of a two-player game, for the player to
+// move. The opponent is modelled as AiSearch's rollouts model it: its hand
+// is any set of the unseen cards, all equally likely, and it plays a random
+// card. Its plays are chance nodes, and so are the POWER follow-ups on both
+// sides; what an opponent's POWER play reveals (whether a second POWER card
+// followed) is carried forward exactly. The room doesn't remember that for
+// rounds already over, so those plays only remove cards from the pool. Only
+// strength and whether a card is a POWER card matter to the rules, so hands
+// and the unseen pool are kept as counts per (strength, POWER) class and
+// equal cards are searched once.
+//
+// Positions at the start of a round are memoized in a fixed-size hashed
+// transposition table of 16-byte entries keyed by both packed hands, the
+// opponent's hand size, the score margin and the round. Keys describe the
+// position completely, so entries stay valid from one solve, and one game,
+// to the next. A solver is not thread-safe; give each thread its own.
+class EndgameSolver {
+public:
+    struct Result {
+        int cardIndex = -1;
+        // Chance of winning, counting a tie as half; a game that stalls
+        // because a hand ran out counts as it stands
+        double expectedScore = 0;
+    };
+
+    // Four entries share a 64-byte bucket
+    static const size_t DEFAULT_TABLE_ENTRIES = size_t(1) << 18;
+    // Positions visited before a solve gives up
+    static const uint64_t DEFAULT_NODE_LIMIT = 2000000;
+
+private:
+    struct Entry {
+        uint64_t low;
+        uint32_t high; // zero while the slot is empty
+        float value;
+    };
+
+    struct State;
+
+    std::vector<Entry> table;
+    size_t bucketMask;
+    uint64_t nodes;
+    uint64_t nodeLimit;
+    bool aborted;
+    uint64_t hits;
+    uint64_t stores;
+
+    bool lookup(uint64_t low, uint32_t high, double& value);
+    void store(uint64_t low, uint32_t high, double value);
+
+    double roundValue(const State& state);
+    double myMove(const State& state, int theirStrength);
+    double afterMyCard(const State& state, int category, int theirStrength);
+    double finishMyPlay(const State& state, int myStrength, int theirStrength);
+    double opponentMove(const State& state, int myStrength);
+    double resolve(State state, int myStrength, int theirStrength);
+
+public:
+    explicit EndgameSolver(size_t tableEntries = DEFAULT_TABLE_ENTRIES);
+
+    // Finds the card with the best expected score. False if the position
+    // has no move or the solve visited more than nodeLimit positions.
+    bool solve(const SearchPosition& position, Result& result, uint64_t nodeLimit = DEFAULT_NODE_LIMIT);
+
+    void clear();
+
+    // Positions visited by the last solve
+    uint64_t getNodeCount() const { return nodes; }
+    uint64_t getHitCount() const { return hits; }
+    uint64_t getStoreCount() const { return stores; }
+    size_t getTableSize() const { return table.size(); }
+};
+
+#endif // ENDGAME_SOLVER_H
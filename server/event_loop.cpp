@@ -0,0 +1,641 @@
+#ifdef __linux__
+
+#include "event_loop.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <future>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+namespace {
+    const int MAX_EVENTS = 256;
+    // Stop executing pipelined commands once this much output is queued and
+    // resume after the client has drained it
+    const size_t OUTPUT_HIGH_WATER = EventLoop::OUTPUT_BUFFER_SIZE / 2;
+    const size_t MAX_POOLED_BUFFERS = 1024;
+    // Pipelined commands one connection may have running at once; the rest
+    // wait in its input buffer
+    const size_t MAX_IN_FLIGHT = 64;
+}
+
+EventLoop::EventLoop(int listenPort, RequestHandler requestHandler)
+    : port(listenPort), listenFd(-1), epollFd(-1), wakeFd(-1), running(false), handler(std::move(requestHandler)),
+      nextConnectionId(1), posted(&postStub), wakePending(false), droppedPushes(0) {}
+
+EventLoop::~EventLoop() {
+    while (LoopTask* task = posted.pop()) {
+        delete task;
+    }
+    for (auto& pair : connections) {
+        if (pair.second->session) {
+            pair.second->session->open = false;
+        }
+        close(pair.first);
+    }
+    if (listenFd >= 0) close(listenFd);
+    if (wakeFd >= 0) close(wakeFd);
+    if (epollFd >= 0) close(epollFd);
+}
+
+bool EventLoop::bindListener() {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "Socket creation failed" << std::endl;
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        std::cerr << "SO_REUSEPORT not supported" << std::endl;
+        return false;
+    }
+
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(listenFd, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        std::cerr << "Bind failed" << std::endl;
+        return false;
+    }
+
+    if (listen(listenFd, SOMAXCONN) < 0) {
+        std::cerr << "Listen failed" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool EventLoop::open(int inheritedListenFd) {
+    if (inheritedListenFd >= 0) {
+        listenFd = inheritedListenFd;
+        // Already bound and listening; only the flags didn't survive exec
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+    } else if (!bindListener()) {
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        std::cerr << "epoll setup failed" << std::endl;
+        return false;
+    }
+
+    // The listener and the wake-up eventfd are told apart from connections by
+    // their data pointers: nullptr for the listener, &wakeFd for the eventfd.
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+    return true;
+}
+
+void EventLoop::run() {
+    epoll_event events[MAX_EVENTS];
+    running = true;
+    loopThread = std::this_thread::get_id();
+
+    while (running) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait failed" << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == nullptr) {
+                acceptConnections();
+                continue;
+            }
+            if (tag == &wakeFd) {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                runPosted();
+                continue;
+            }
+
+            Connection* conn = static_cast<Connection*>(tag);
+            uint32_t flags = events[i].events;
+            if (conn->closed) {
+                continue;
+            }
+
+            if (flags & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            if ((flags & EPOLLOUT) && !handleWritable(conn)) {
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLRDHUP)) {
+                handleReadable(conn);
+            }
+        }
+        closedConnections.clear();
+    }
+}
+
+void EventLoop::stop() {
+    running = false;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // The loop is already awake or shutting down
+    }
+}
+
+int EventLoop::getListenFd() const {
+    return listenFd;
+}
+
+void EventLoop::closeForHandOff() {
+    std::promise<void> done;
+    post([this, &done] {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->second.get());
+        }
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+void EventLoop::resumeAccepting() {
+    post([this] {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        // Edge-triggered: whoever queued up meanwhile won't raise a new edge
+        acceptConnections();
+    });
+}
+
+void EventLoop::post(std::function<void()> fn) {
+    LoopTask* task = new LoopTask();
+    task->fn = std::move(fn);
+    enqueue(task);
+}
+
+void EventLoop::enqueue(LoopTask* task) {
+    posted.push(task);
+
+    // One eventfd write per batch of posts is enough to wake the loop
+    if (!wakePending.exchange(true)) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // Counter saturated; the loop is awake anyway
+        }
+    }
+}
+
+void EventLoop::runPosted() {
+    wakePending.store(false);
+    while (true) {
+        LoopTask* task = posted.pop();
+        if (!task) {
+            if (!posted.maybeNonEmpty()) break;
+            // A producer is still linking its task in
+            std::this_thread::yield();
+            continue;
+        }
+        switch (task->kind) {
+            case LoopTask::Kind::CALL:
+                task->fn();
+                break;
+            case LoopTask::Kind::REPLY:
+                completeReply(task->fd, task->connectionId, task->sequence, std::move(task->message));
+                break;
+            case LoopTask::Kind::PUSH:
+                completePush(task->fd, task->connectionId, std::move(task->message), task->stream);
+                break;
+        }
+        delete task;
+    }
+
+    // One write per connection for however many pushes and replies it got in
+    // this batch
+    for (const auto& pending : pendingFlushes) {
+        Connection* conn = findConnection(pending.first, pending.second);
+        if (!conn) continue;
+        conn->flushQueued = false;
+        // Answered commands free slots, so commands still buffered (or a
+        // half-close waiting on them) can go on; handleReadable flushes too
+        if (conn->readPaused || conn->inputClosed || (conn->input && !conn->input->empty())) {
+            handleReadable(conn);
+            continue;
+        }
+        if (!flushOutput(conn)) {
+            closeConnection(conn);
+            continue;
+        }
+        releaseIdleBuffers(conn);
+    }
+    pendingFlushes.clear();
+}
+
+void EventLoop::deliverReply(int fd, uint64_t connectionId, uint64_t sequence, SharedBuffer reply) {
+    if (std::this_thread::get_id() == loopThread) {
+        completeReply(fd, connectionId, sequence, std::move(reply));
+        return;
+    }
+    enqueue(new LoopTask(LoopTask::Kind::REPLY, fd, connectionId, std::move(reply), nullptr, sequence));
+}
+
+WireFormat EventLoop::LoopSession::getFormat() const {
+    return format;
+}
+
+bool EventLoop::LoopSession::push(SharedBuffer message, const void* stream) {
+    if (!open.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    loop->enqueue(new LoopTask(LoopTask::Kind::PUSH, fd, connectionId, std::move(message), stream));
+    return true;
+}
+
+EventLoop::Connection* EventLoop::findConnection(int fd, uint64_t connectionId) {
+    // fds are reused, so the id tells a new connection from the one we want
+    auto it = connections.find(fd);
+    if (it == connections.end() || it->second->id != connectionId) {
+        return nullptr;
+    }
+    return it->second.get();
+}
+
+void EventLoop::completePush(int fd, uint64_t connectionId, SharedBuffer message, const void* stream) {
+    Connection* conn = findConnection(fd, connectionId);
+    if (!conn) {
+        return;
+    }
+    if (conn->pushes.size() >= PushQueue::CAPACITY) {
+        // A burst filled the queue; only drop if the socket is backed up too
+        if (!flushOutput(conn)) {
+            closeConnection(conn);
+            return;
+        }
+    }
+    if (!conn->pushes.push(std::move(message), stream)) {
+        droppedPushes.fetch_add(1, std::memory_order_relaxed);
+    }
+    queueFlush(conn);
+}
+
+void EventLoop::queueFlush(Connection* conn) {
+    if (!conn->flushQueued) {
+        conn->flushQueued = true;
+        pendingFlushes.emplace_back(conn->fd, conn->id);
+    }
+}
+
+void EventLoop::completeReply(int fd, uint64_t connectionId, uint64_t sequence, SharedBuffer reply) {
+    Connection* conn = findConnection(fd, connectionId);
+    if (!conn) {
+        // The client went away while its command was running
+        return;
+    }
+
+    conn->replySlots[sequence - conn->firstSlot] = std::move(reply);
+    // Only the front slots that have answered can go; a later reply waits
+    // for the commands before it
+    while (!conn->replySlots.empty() && conn->replySlots.front()) {
+        if (!conn->output) {
+            conn->output = acquireBuffer(freeOutputBuffers, OUTPUT_BUFFER_SIZE);
+        }
+        RingBuffer& output = *conn->output;
+        const std::string& next = *conn->replySlots.front();
+        if (next.size() > output.available()) {
+            output.reserve(output.size() + next.size());
+        }
+        output.append(next);
+        conn->replySlots.pop_front();
+        conn->firstSlot++;
+    }
+
+    // Replies produced inline go out with the rest of the read that is
+    // already being handled; asynchronous ones with the rest of this batch
+    if (!conn->processing) {
+        queueFlush(conn);
+    }
+}
+
+size_t EventLoop::getConnectionCount() const {
+    return connections.size();
+}
+
+uint64_t EventLoop::getDroppedPushCount() const {
+    return droppedPushes.load(std::memory_order_relaxed);
+}
+
+void EventLoop::acceptConnections() {
+    while (true) {
+        int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Accept failed" << std::endl;
+            }
+            return;
+        }
+
+        int enable = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        auto conn = std::make_unique<Connection>(clientFd, nextConnectionId++);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn.get();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &ev) < 0) {
+            close(clientFd);
+            continue;
+        }
+        connections[clientFd] = std::move(conn);
+    }
+}
+
+std::unique_ptr<RingBuffer> EventLoop::acquireBuffer(std::vector<std::unique_ptr<RingBuffer>>& pool, size_t size) {
+    if (pool.empty()) {
+        return std::make_unique<RingBuffer>(size);
+    }
+    auto buffer = std::move(pool.back());
+    pool.pop_back();
+    return buffer;
+}
+
+bool EventLoop::handleReadable(Connection* conn) {
+    if (!conn->input) {
+        conn->input = acquireBuffer(freeInputBuffers, INPUT_BUFFER_SIZE);
+    }
+    if (!conn->output) {
+        conn->output = acquireBuffer(freeOutputBuffers, OUTPUT_BUFFER_SIZE);
+    }
+
+    // Run anything left buffered from a paused read before taking more input
+    if (!processInput(conn)) {
+        closeConnection(conn);
+        return false;
+    }
+
+    // Edge-triggered: drain the socket until the kernel reports EAGAIN, or
+    // until the client stops reading its responses
+    conn->readPaused = false;
+    while (true) {
+        if (conn->output->size() >= OUTPUT_HIGH_WATER) {
+            if (!flushOutput(conn)) {
+                closeConnection(conn);
+                return false;
+            }
+            if (conn->output->size() >= OUTPUT_HIGH_WATER) {
+                // Wait for EPOLLOUT before running more pipelined commands
+                conn->readPaused = true;
+                break;
+            }
+            if (!processInput(conn)) {
+                closeConnection(conn);
+                return false;
+            }
+            continue;
+        }
+
+        if (conn->inputClosed) {
+            if (!conn->replySlots.empty()) break;
+            flushOutput(conn);
+            closeConnection(conn);
+            return false;
+        }
+
+        RingBuffer::Region regions[2];
+        int count = conn->input->writableRegions(regions);
+        if (count == 0) {
+            if (conn->replySlots.size() >= MAX_IN_FLIGHT) {
+                // Pipelined commands fill the buffer; read more once
+                // replies free slots for them
+                conn->readPaused = true;
+                break;
+            }
+            // processInput rejects oversized frames, so a full buffer here
+            // means the peer is misbehaving
+            closeConnection(conn);
+            return false;
+        }
+
+        iovec iov[2];
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = regions[i].data;
+            iov[i].iov_len = regions[i].length;
+        }
+
+        ssize_t bytesReceived = readv(conn->fd, iov, count);
+        if (bytesReceived > 0) {
+            conn->input->commit(bytesReceived);
+            if (!processInput(conn)) {
+                closeConnection(conn);
+                return false;
+            }
+            continue;
+        }
+        if (bytesReceived == 0) {
+            // Orderly shutdown; commands already received still get answers
+            conn->inputClosed = true;
+            continue;
+        }
+        if (bytesReceived < 0 && errno == EINTR) continue;
+        if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // Hard error; still try to deliver what we have
+        flushOutput(conn);
+        closeConnection(conn);
+        return false;
+    }
+
+    if (!flushOutput(conn)) {
+        closeConnection(conn);
+        return false;
+    }
+    releaseIdleBuffers(conn);
+    return true;
+}
+
+bool EventLoop::handleWritable(Connection* conn) {
+    if (!flushOutput(conn)) {
+        closeConnection(conn);
+        return false;
+    }
+
+    // Commands left buffered by backpressure run once the client catches up
+    if (conn->readPaused && (!conn->output || conn->output->size() < OUTPUT_HIGH_WATER)) {
+        return handleReadable(conn);
+    }
+    releaseIdleBuffers(conn);
+    return true;
+}
+
+bool EventLoop::processInput(Connection* conn) {
+    RingBuffer& input = *conn->input;
+    RingBuffer& output = *conn->output;
+
+    if (!conn->negotiated) {
+        if (input.empty()) return true;
+        conn->negotiated = true;
+        if (input.at(0) == BINARY_HANDSHAKE) {
+            input.consume(1);
+            conn->format = WireFormat::BINARY;
+            const char ack[] = { static_cast<char>(BINARY_HANDSHAKE), static_cast<char>(BINARY_PROTOCOL_VERSION) };
+            output.append(ack, sizeof(ack));
+        }
+    }
+
+    conn->processing = true;
+    while (conn->replySlots.size() < MAX_IN_FLIGHT && output.size() < OUTPUT_HIGH_WATER) {
+        std::string_view frame;
+        size_t consumed = 0;
+        FrameStatus status = nextFrame(input, conn->format, lineScratch, frame, consumed);
+        if (status == FrameStatus::INCOMPLETE) {
+            break;
+        }
+
+        if (status == FrameStatus::OVERSIZED) {
+            conn->processing = false;
+            responseScratch.clear();
+            encodeError(ErrorCode::COMMAND_TOO_LONG, conn->format, responseScratch);
+            output.reserve(output.size() + responseScratch.size());
+            output.append(responseScratch);
+            flushOutput(conn);
+            return false;
+        }
+
+        if (!frame.empty()) {
+            if (!conn->session) {
+                conn->session = std::make_shared<LoopSession>(this, conn->fd, conn->id, conn->format);
+            }
+            int fd = conn->fd;
+            uint64_t connectionId = conn->id;
+            uint64_t sequence = conn->firstSlot + conn->replySlots.size();
+            conn->replySlots.emplace_back();
+            handler(frame, conn->session, [this, fd, connectionId, sequence](SharedBuffer reply) {
+                deliverReply(fd, connectionId, sequence, std::move(reply));
+            });
+        }
+        input.consume(consumed);
+    }
+    conn->processing = false;
+    return true;
+}
+
+bool EventLoop::flushOutput(Connection* conn) {
+    PushQueue& pushes = conn->pushes;
+
+    while (true) {
+        // A half-written push has to finish first, then queued replies, then
+        // the remaining pushes; every message stays contiguous on the wire
+        iovec iov[2 + PushQueue::CAPACITY];
+        int count = 0;
+        size_t leadingPush = 0;
+        size_t firstPush = 0;
+        if (pushes.inProgress()) {
+            std::string_view rest = pushes.pending(0);
+            iov[count++] = { const_cast<char*>(rest.data()), rest.size() };
+            leadingPush = rest.size();
+            firstPush = 1;
+        }
+
+        size_t replyBytes = 0;
+        if (conn->output) {
+            RingBuffer::Region regions[2];
+            int regionCount = conn->output->readableRegions(regions);
+            for (int i = 0; i < regionCount; i++) {
+                iov[count++] = { regions[i].data, regions[i].length };
+                replyBytes += regions[i].length;
+            }
+        }
+
+        // Pushes wait while a command is unanswered: the push might follow
+        // from it, and its reply has to go first
+        size_t pushCount = conn->replySlots.empty() ? pushes.size() : firstPush;
+        for (size_t i = firstPush; i < pushCount && i < PushQueue::CAPACITY; i++) {
+            std::string_view message = pushes.pending(i);
+            iov[count++] = { const_cast<char*>(message.data()), message.size() };
+        }
+
+        if (count == 0) {
+            return true;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        // sendmsg is writev with MSG_NOSIGNAL so a vanished peer can't raise SIGPIPE
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent > 0) {
+            size_t remaining = sent;
+            remaining -= pushes.consume(std::min(remaining, leadingPush));
+            size_t fromReplies = std::min(remaining, replyBytes);
+            if (fromReplies > 0) {
+                conn->output->consume(fromReplies);
+                remaining -= fromReplies;
+            }
+            pushes.consume(remaining);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // EPOLLOUT will fire once the socket drains
+            return true;
+        }
+        return false;
+    }
+}
+
+void EventLoop::releaseIdleBuffers(Connection* conn) {
+    if (conn->input && conn->input->empty()) {
+        if (conn->input->capacity() == INPUT_BUFFER_SIZE && freeInputBuffers.size() < MAX_POOLED_BUFFERS) {
+            freeInputBuffers.push_back(std::move(conn->input));
+        }
+        conn->input.reset();
+    }
+    if (conn->output && conn->output->empty()) {
+        if (conn->output->capacity() == OUTPUT_BUFFER_SIZE && freeOutputBuffers.size() < MAX_POOLED_BUFFERS) {
+            freeOutputBuffers.push_back(std::move(conn->output));
+        }
+        conn->output.reset();
+    }
+}
+
+void EventLoop::closeConnection(Connection* conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = true;
+    if (conn->session) {
+        // Rooms drop the session the next time they try to push to it
+        conn->session->open = false;
+    }
+    int fd = conn->fd;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    auto it = connections.find(fd);
+    closedConnections.push_back(std::move(it->second));
+    connections.erase(it);
+}
+
+#endif // __linux__
@@ -0,0 +1,198 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#ifdef __linux__
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "ring_buffer.h"
+#include "client_session.h"
+#include "wire_protocol.h"
+#include "mpsc_queue.h"
+#include "push_queue.h"
+
+// Non-blocking, edge-triggered epoll reactor. Each EventLoop owns its own
+// SO_REUSEPORT listening socket so the kernel spreads incoming connections
+// across loops; run one loop per core.
+//
+// Each connection speaks the text or binary protocol (see wire_protocol.h),
+// chosen by its first byte. A client may pipeline any number of commands in
+// one segment. They all run at once, each reply waiting in a slot until the
+// commands before it have answered, so replies leave in command order; all
+// responses produced by one read, or by one batch of replies from room
+// workers, are flushed together with a single writev. Messages pushed by
+// rooms are queued as shared buffers and written straight from them, once
+// no command on the connection is still waiting for its reply.
+class EventLoop {
+public:
+    // Handles one framed command from the session. The reply goes to the
+    // sink, either before the handler returns or later from another thread.
+    using RequestHandler = std::function<void(std::string_view, const std::shared_ptr<ClientSession>&, ReplySink)>;
+
+    static const size_t INPUT_BUFFER_SIZE = 4096;
+    static const size_t OUTPUT_BUFFER_SIZE = 16384;
+
+private:
+    // Lets rooms push to a connection from their worker threads. Marked
+    // closed by the loop when the connection goes away.
+    class LoopSession : public ClientSession {
+    private:
+        EventLoop* loop;
+        int fd;
+        uint64_t connectionId;
+        WireFormat format;
+
+    public:
+        std::atomic<bool> open;
+
+        LoopSession(EventLoop* owner, int socketFd, uint64_t id, WireFormat wireFormat)
+            : loop(owner), fd(socketFd), connectionId(id), format(wireFormat), open(true) {}
+
+        WireFormat getFormat() const override;
+        bool push(SharedBuffer message, const void* stream) override;
+    };
+
+    struct Connection {
+        int fd;
+        uint64_t id;
+        // Buffers are borrowed from the loop's pool only while they hold
+        // data, so idle connections cost no buffer memory
+        std::unique_ptr<RingBuffer> input;
+        std::unique_ptr<RingBuffer> output;
+        bool readPaused;
+        bool negotiated;
+        // Replies to the commands in flight, oldest first. A slot stays empty
+        // until its command answers; the front slots go to output as they
+        // fill. firstSlot is the sequence number of the front one.
+        std::deque<SharedBuffer> replySlots;
+        uint64_t firstSlot;
+        bool processing;
+        // The peer shut down its side; close once pending replies are out
+        bool inputClosed;
+        // Set by closeConnection; events already fetched for it are skipped
+        bool closed;
+        WireFormat format;
+        // Created once the format is negotiated, on the first command
+        std::shared_ptr<LoopSession> session;
+        // Messages pushed by rooms; written after any queued replies, and
+        // held while a reply slot is empty so that a reply (SUBSCRIBED, say)
+        // always goes out before the pushes its command started
+        PushQueue pushes;
+        // A flush is queued in pendingFlushes
+        bool flushQueued;
+
+        Connection(int socketFd, uint64_t connectionId)
+            : fd(socketFd), id(connectionId), readPaused(false), negotiated(false),
+              firstSlot(0), processing(false), inputClosed(false), closed(false), format(WireFormat::TEXT),
+              flushQueued(false) {}
+    };
+
+    // Work handed to the loop thread from other threads. Replies and pushes
+    // have their own kinds so the hot paths need no std::function.
+    struct LoopTask {
+        enum class Kind : uint8_t { CALL, REPLY, PUSH };
+
+        std::atomic<LoopTask*> next;
+        Kind kind;
+        int fd;
+        uint64_t connectionId;
+        SharedBuffer message;
+        const void* stream;
+        // The reply slot a REPLY fills
+        uint64_t sequence;
+        std::function<void()> fn;
+
+        LoopTask() : next(nullptr), kind(Kind::CALL), fd(-1), connectionId(0), stream(nullptr), sequence(0) {}
+        LoopTask(Kind taskKind, int socketFd, uint64_t id, SharedBuffer data, const void* pushStream = nullptr,
+                 uint64_t replySequence = 0)
+            : next(nullptr), kind(taskKind), fd(socketFd), connectionId(id), message(std::move(data)),
+              stream(pushStream), sequence(replySequence) {}
+    };
+
+    int port;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    std::atomic<bool> running;
+    RequestHandler handler;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    // Connections closed while handling the current epoll batch. Later events
+    // in the batch may still point at them (and their fd may already belong
+    // to a new connection), so they are freed only once the batch is done.
+    std::vector<std::unique_ptr<Connection>> closedConnections;
+    uint64_t nextConnectionId;
+    std::thread::id loopThread;
+
+    LoopTask postStub;
+    MpscQueue<LoopTask, &LoopTask::next> posted;
+    std::atomic<bool> wakePending;
+    // Connections with pushes or replies queued during the current runPosted()
+    std::vector<std::pair<int, uint64_t>> pendingFlushes;
+    std::atomic<uint64_t> droppedPushes;
+
+    std::vector<std::unique_ptr<RingBuffer>> freeInputBuffers;
+    std::vector<std::unique_ptr<RingBuffer>> freeOutputBuffers;
+    std::string lineScratch;
+    std::string responseScratch;
+
+    bool bindListener();
+    void acceptConnections();
+    // Both return false once the connection has been closed
+    bool handleReadable(Connection* conn);
+    bool handleWritable(Connection* conn);
+    bool processInput(Connection* conn);
+    bool flushOutput(Connection* conn);
+    void releaseIdleBuffers(Connection* conn);
+    void runPosted();
+    void deliverReply(int fd, uint64_t connectionId, uint64_t sequence, SharedBuffer reply);
+    void completeReply(int fd, uint64_t connectionId, uint64_t sequence, SharedBuffer reply);
+    void queueFlush(Connection* conn);
+    void enqueue(LoopTask* task);
+    void completePush(int fd, uint64_t connectionId, SharedBuffer message, const void* stream);
+    Connection* findConnection(int fd, uint64_t connectionId);
+    void closeConnection(Connection* conn);
+
+    std::unique_ptr<RingBuffer> acquireBuffer(std::vector<std::unique_ptr<RingBuffer>>& pool, size_t size);
+
+public:
+    EventLoop(int listenPort, RequestHandler requestHandler);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Binds a new listening socket, or takes over inheritedListenFd, one a
+    // previous server process left open across exec (see closeForHandOff)
+    bool open(int inheritedListenFd = -1);
+    void run();
+    void stop();
+
+    int getListenFd() const;
+    // For a warm restart: stops accepting and closes every connection,
+    // blocking until the loop has done so. The listening socket stays open,
+    // so clients connecting meanwhile wait in its backlog for whichever
+    // process accepts next.
+    void closeForHandOff();
+    // Accepts again after a hand-off that didn't happen
+    void resumeAccepting();
+
+    // Runs fn on the loop thread; callable from any thread
+    void post(std::function<void()> fn);
+
+    size_t getConnectionCount() const;
+    // Pushed messages skipped because a connection fell behind
+    uint64_t getDroppedPushCount() const;
+};
+
+#endif // __linux__
+
+#endif // EVENT_LOOP_H
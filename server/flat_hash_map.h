@@ -0,0 +1,115 @@
+#ifndef FLAT_HASH_MAP_H
+#define FLAT_HASH_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map from strings to small values: one flat array of
+// slots, probed linearly from the key's home slot, kept at most half full.
+// Erasing shifts the rest of the probe run back into the hole, so there are
+// no tombstones and lookups never get slower as keys come and go. Each slot
+// keeps the key's full hash, so a probe only compares strings whose hashes
+// match. Lookups take a string_view and never allocate, and keys short
+// enough for the small-string buffer (such as room ids) don't allocate on
+// insert either. Not thread-safe.
+template <typename Value>
+class FlatStringMap {
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        std::string key;
+        Value value{};
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    size_t count;
+
+    size_t mask() const { return slots.size() - 1; }
+
+    size_t locate(std::string_view key, uint64_t hash) const {
+        for (size_t i = hash & mask();; i = (i + 1) & mask()) {
+            const Slot& slot = slots[i];
+            if (!slot.used || (slot.hash == hash && slot.key == key)) {
+                return i;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        for (auto& slot : old) {
+            if (slot.used) {
+                size_t i = locate(slot.key, slot.hash);
+                slots[i] = std::move(slot);
+            }
+        }
+    }
+
+public:
+    explicit FlatStringMap(size_t capacity = 16) : count(0) {
+        size_t size = 16;
+        while (size < capacity * 2) size *= 2;
+        slots.resize(size);
+    }
+
+    static uint64_t hashOf(std::string_view key) {
+        return std::hash<std::string_view>()(key);
+    }
+
+    // hash must be hashOf(key); callers that already have it save a pass
+    const Value* find(std::string_view key, uint64_t hash) const {
+        const Slot& slot = slots[locate(key, hash)];
+        return slot.used ? &slot.value : nullptr;
+    }
+
+    const Value* find(std::string_view key) const {
+        return find(key, hashOf(key));
+    }
+
+    // False, leaving the map unchanged, if the key is already there
+    bool insert(std::string_view key, uint64_t hash, Value value) {
+        if ((count + 1) * 2 > slots.size()) {
+            grow();
+        }
+        Slot& slot = slots[locate(key, hash)];
+        if (slot.used) {
+            return false;
+        }
+        slot.hash = hash;
+        slot.key.assign(key.data(), key.size());
+        slot.value = std::move(value);
+        slot.used = true;
+        count++;
+        return true;
+    }
+
+    bool erase(std::string_view key, uint64_t hash) {
+        size_t hole = locate(key, hash);
+        if (!slots[hole].used) {
+            return false;
+        }
+        // Pull back every later entry of the run whose home slot is at or
+        // before the hole, so each stays reachable from its home
+        for (size_t next = (hole + 1) & mask(); slots[next].used; next = (next + 1) & mask()) {
+            size_t home = slots[next].hash & mask();
+            if (((next - home) & mask()) >= ((next - hole) & mask())) {
+                slots[hole] = std::move(slots[next]);
+                hole = next;
+            }
+        }
+        slots[hole] = Slot();
+        count--;
+        return true;
+    }
+
+    size_t size() const { return count; }
+};
+
+#endif // FLAT_HASH_MAP_H
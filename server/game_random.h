@@ -0,0 +1,92 @@
+#ifndef GAME_RANDOM_H
+#define GAME_RANDOM_H
+
+#include <array>
+#include <cstdint>
+#include <random>
+
+// xoshiro256** generator: 32 bytes of state and a few cycles per number.
+// Each room owns one, seeded once when the room is created, so a room
+// created with the same seed and sent the same commands plays out exactly
+// the same way on any platform. Everything drawn from it goes through
+// below(), never a std:: distribution, whose output varies between
+// standard libraries.
+class GameRandom {
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static uint64_t splitMix(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+public:
+    // Seeds are kept below 2^53 so JSON clients can hand them back exactly
+    static const uint64_t SEED_MASK = (uint64_t(1) << 53) - 1;
+
+    explicit GameRandom(uint64_t seed) {
+        reseed(seed);
+    }
+
+    void reseed(uint64_t seed) {
+        for (auto& word : state) {
+            word = splitMix(seed);
+        }
+    }
+
+    // The whole state, for snapshots: a generator given another's state
+    // draws the same numbers from then on
+    std::array<uint64_t, 4> getState() const {
+        return {state[0], state[1], state[2], state[3]};
+    }
+
+    void setState(const std::array<uint64_t, 4>& words) {
+        for (size_t i = 0; i < 4; i++) {
+            state[i] = words[i];
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, bound) without modulo bias (Lemire's multiply-shift)
+    uint32_t below(uint32_t bound) {
+        uint64_t product = (next() >> 32) * bound;
+        uint32_t low = static_cast<uint32_t>(product);
+        if (low < bound) {
+            uint32_t threshold = (0u - bound) % bound;
+            while (low < threshold) {
+                product = (next() >> 32) * bound;
+                low = static_cast<uint32_t>(product);
+            }
+        }
+        return static_cast<uint32_t>(product >> 32);
+    }
+
+    // Seed for a room that wasn't given one. Comes from a per-thread
+    // generator seeded from std::random_device the first time it is used.
+    static uint64_t freshSeed() {
+        thread_local GameRandom seeder([] {
+            std::random_device device;
+            return (uint64_t(device()) << 32) ^ device();
+        }());
+        return seeder.next() & SEED_MASK;
+    }
+};
+
+#endif // GAME_RANDOM_H
@@ -0,0 +1,42 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include <cstdint>
+
+// A 64-bit name for a slot that gets reused: the slot's index in the low 32
+// bits and its generation in the high 32. The owner bumps a slot's
+// generation every time it is given to something new, so a stale handle
+// stops matching instead of finding the slot's next occupant. Generations
+// start at one, which keeps the zero handle invalid. The tag keeps room and
+// player handles apart.
+template <typename Tag>
+class Handle {
+private:
+    uint64_t value;
+
+public:
+    constexpr Handle() : value(0) {}
+    constexpr Handle(uint32_t index, uint32_t generation)
+        : value((static_cast<uint64_t>(generation) << 32) | index) {}
+
+    static constexpr Handle fromRaw(uint64_t raw) {
+        Handle handle;
+        handle.value = raw;
+        return handle;
+    }
+
+    constexpr uint64_t raw() const { return value; }
+    constexpr uint32_t index() const { return static_cast<uint32_t>(value); }
+    constexpr uint32_t generation() const { return static_cast<uint32_t>(value >> 32); }
+    constexpr bool valid() const { return value != 0; }
+
+    constexpr bool operator==(Handle other) const { return value == other.value; }
+    constexpr bool operator!=(Handle other) const { return value != other.value; }
+};
+
+using RoomHandle = Handle<struct RoomHandleTag>;
+// Scoped to its room: the seat in the index, the room's join count when
+// the player joined in the generation
+using PlayerHandle = Handle<struct PlayerHandleTag>;
+
+#endif // HANDLE_H
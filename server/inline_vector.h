@@ -0,0 +1,53 @@
+#ifndef INLINE_VECTOR_H
+#define INLINE_VECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Fixed-capacity vector stored inline, for small trivially copyable values
+// such as cards. Never allocates; push_back() on a full vector fails instead
+// of growing. erase() keeps the order, since clients refer to cards by index.
+template <typename T, size_t Capacity>
+class InlineVector {
+    static_assert(std::is_trivially_copyable<T>::value, "InlineVector holds plain values");
+    static_assert(Capacity <= UINT8_MAX, "InlineVector counts in one byte");
+
+private:
+    // Slots past count are left uninitialized, so T needs no default ctor
+    union {
+        T items[Capacity];
+    };
+    uint8_t count;
+
+public:
+    InlineVector() : count(0) {}
+
+    static constexpr size_t capacity() { return Capacity; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Capacity; }
+
+    const T& operator[](size_t index) const { return items[index]; }
+    T& operator[](size_t index) { return items[index]; }
+
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+
+    bool push_back(const T& value) {
+        if (full()) return false;
+        items[count++] = value;
+        return true;
+    }
+
+    void erase(size_t index) {
+        for (size_t i = index + 1; i < count; i++) {
+            items[i - 1] = items[i];
+        }
+        count--;
+    }
+
+    void clear() { count = 0; }
+};
+
+#endif // INLINE_VECTOR_H
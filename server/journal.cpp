@@ -0,0 +1,693 @@
+#include "journal.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+#include "binary_codec.h"
+#include "card_game.h"
+
+namespace {
+
+constexpr std::array<uint32_t, 256> buildCrcTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> CRC_TABLE = buildCrcTable();
+
+uint32_t crc32(const char* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC_TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+const char* const SEGMENT_PREFIX = "journal-";
+const char* const SEGMENT_SUFFIX = ".log";
+
+std::string segmentPath(const std::string& directory, uint64_t firstSequence) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%016llx%s", SEGMENT_PREFIX, static_cast<unsigned long long>(firstSequence),
+                  SEGMENT_SUFFIX);
+    return (std::filesystem::path(directory) / name).string();
+}
+
+template <typename T>
+T load(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+const uint8_t NO_CARD = 0xFF;
+
+std::string cardName(uint8_t byte) {
+    return Card::fromByte(byte).toString();
+}
+
+} // namespace
+
+std::string_view journalEventName(JournalEvent type) {
+    switch (type) {
+        case JournalEvent::SERVER_STARTED: return "SERVER_STARTED";
+        case JournalEvent::ROOM_CREATED: return "ROOM_CREATED";
+        case JournalEvent::PLAYER_JOINED: return "PLAYER_JOINED";
+        case JournalEvent::PLAYER_LEFT: return "PLAYER_LEFT";
+        case JournalEvent::GAME_STARTED: return "GAME_STARTED";
+        case JournalEvent::CARDS_DEALT: return "CARDS_DEALT";
+        case JournalEvent::CARD_PLAYED: return "CARD_PLAYED";
+        case JournalEvent::ROUND_RESOLVED: return "ROUND_RESOLVED";
+        case JournalEvent::ROOM_CLOSED: return "ROOM_CLOSED";
+        case JournalEvent::ROOM_RESTORED: return "ROOM_RESTORED";
+    }
+    return "UNKNOWN";
+}
+
+// EventJournal Implementation
+constexpr char EventJournal::SEGMENT_MAGIC[9];
+
+EventJournal::~EventJournal() {
+    close();
+}
+
+std::string& EventJournal::scratch() {
+    thread_local std::string record;
+    return record;
+}
+
+void EventJournal::begin(std::string& record, JournalEvent type, uint64_t room) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    record.assign(HEADER_SIZE, '\0');
+    record.push_back(static_cast<char>(type));
+    appendVarint(record, std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+    appendVarint(record, room);
+}
+
+void EventJournal::commit(std::string& record) {
+    auto size = static_cast<uint32_t>(record.size());
+    std::memcpy(&record[0], &size, sizeof(size));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if ((!current || current->written + size > current->capacity) && !rotateLocked(size)) {
+        stats.dropped++;
+        return;
+    }
+    uint64_t sequence = nextSequence++;
+    std::memcpy(&record[8], &sequence, sizeof(sequence));
+    uint32_t checksum = crc32(record.data() + 8, size - 8);
+    std::memcpy(&record[4], &checksum, sizeof(checksum));
+    std::memcpy(current->map + current->written, record.data(), size);
+    current->written += size;
+    stats.records++;
+    stats.bytes += size;
+}
+
+#ifndef _WIN32
+
+bool EventJournal::rotateLocked(size_t needed) {
+    if (stopping) {
+        return false;
+    }
+    auto segment = std::make_unique<Segment>();
+    segment->path = segmentPath(settings.directory, nextSequence);
+    segment->capacity = std::max(settings.segmentSize, SEGMENT_HEADER_SIZE + needed);
+    segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    // Allocated up front: a write to a page of a sparse file the disk can't
+    // back would kill the server with SIGBUS
+    bool ok = segment->fd >= 0 && posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->capacity)) == 0;
+    if (ok) {
+        void* map = mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+        ok = map != MAP_FAILED;
+        segment->map = ok ? static_cast<char*>(map) : nullptr;
+    }
+    if (!ok) {
+        if (segment->fd >= 0) {
+            ::close(segment->fd);
+        }
+        if (!failed) {
+            std::cerr << "Journal: cannot create " << segment->path << ": " << std::strerror(errno)
+                      << "; records are dropped until a segment can be created" << std::endl;
+            failed = true;
+        }
+        return false;
+    }
+    failed = false;
+
+    uint64_t firstSequence = nextSequence;
+    uint64_t capacity = segment->capacity;
+    std::memcpy(segment->map, SEGMENT_MAGIC, 8);
+    std::memcpy(segment->map + 8, &firstSequence, sizeof(firstSequence));
+    std::memcpy(segment->map + 16, &capacity, sizeof(capacity));
+    segment->written = SEGMENT_HEADER_SIZE;
+
+    if (current) {
+        retired.push_back(std::move(current));
+        flushWake.notify_one();
+    }
+    current = std::move(segment);
+    stats.segments++;
+    return true;
+}
+
+void EventJournal::finish(Segment& segment) {
+    msync(segment.map, segment.written, MS_SYNC);
+    munmap(segment.map, segment.capacity);
+    if (ftruncate(segment.fd, static_cast<off_t>(segment.written)) == 0) {
+        fsync(segment.fd);
+    }
+    ::close(segment.fd);
+    segment.map = nullptr;
+    segment.fd = -1;
+}
+
+void EventJournal::flushLoop() {
+    static const size_t PAGE = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        flushWake.wait_for(lock, settings.flushInterval, [this] {
+            return stopping || syncRequested || !retired.empty();
+        });
+        bool stop = stopping;
+        syncRequested = false;
+        std::vector<std::unique_ptr<Segment>> done;
+        done.swap(retired);
+        // Stays alive after it's retired until this thread finishes it
+        Segment* segment = current.get();
+        size_t from = segment ? segment->synced : 0;
+        size_t to = segment ? segment->written : 0;
+        uint64_t upTo = nextSequence - 1;
+        lock.unlock();
+
+        // One msync for everything appended since the last pass
+        for (auto& retiredSegment : done) {
+            finish(*retiredSegment);
+        }
+        if (to > from) {
+            size_t start = from / PAGE * PAGE;
+            msync(segment->map + start, to - start, MS_SYNC);
+        }
+
+        lock.lock();
+        if (segment) {
+            segment->synced = std::max(segment->synced, to);
+        }
+        if (upTo > durableSequence) {
+            durableSequence = upTo;
+            stats.flushes++;
+        }
+        flushed.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+bool EventJournal::open(const JournalSettings& journalSettings, std::string& error) {
+    settings = journalSettings;
+    std::error_code ec;
+    std::filesystem::create_directories(settings.directory, ec);
+    if (ec) {
+        error = "cannot create " + settings.directory + ": " + ec.message();
+        return false;
+    }
+
+    // Number on from the newest segment's last intact record
+    std::vector<std::string> segments = JournalReader::listSegments(settings.directory);
+    if (!segments.empty()) {
+        JournalReader::Summary summary;
+        uint64_t last = 0;
+        if (!JournalReader::readSegment(segments.back(), [&](const JournalRecord& record) { last = record.sequence; },
+                                        summary, error)) {
+            return false;
+        }
+        std::string name = std::filesystem::path(segments.back()).filename().string();
+        uint64_t first = std::strtoull(name.c_str() + std::strlen(SEGMENT_PREFIX), nullptr, 16);
+        nextSequence = std::max(last + 1, first);
+        std::filesystem::resize_file(segments.back(), summary.lastSegmentBytes, ec);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!rotateLocked(0)) {
+            error = "cannot create a segment in " + settings.directory + ": " + std::strerror(errno);
+            return false;
+        }
+    }
+    flusher = std::thread(&EventJournal::flushLoop, this);
+    append(JournalEvent::SERVER_STARTED, 0);
+    return true;
+}
+
+void EventJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!flusher.joinable() || stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    flushWake.notify_all();
+    flusher.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& segment : retired) {
+        finish(*segment);
+    }
+    retired.clear();
+    if (current) {
+        finish(*current);
+        current.reset();
+    }
+}
+
+#else
+
+bool EventJournal::rotateLocked(size_t) {
+    return false;
+}
+
+void EventJournal::finish(Segment&) {}
+
+void EventJournal::flushLoop() {}
+
+bool EventJournal::open(const JournalSettings&, std::string& error) {
+    error = "the journal needs POSIX mmap, which this platform doesn't have";
+    return false;
+}
+
+void EventJournal::close() {}
+
+#endif
+
+void EventJournal::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!flusher.joinable()) {
+        return;
+    }
+    uint64_t target = nextSequence - 1;
+    syncRequested = true;
+    flushWake.notify_one();
+    flushed.wait(lock, [&] { return durableSequence >= target || stopping; });
+}
+
+EventJournal::Stats EventJournal::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+// JournalReader Implementation
+std::vector<std::string> JournalReader::listSegments(const std::string& directory) {
+    std::vector<std::string> paths;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > std::strlen(SEGMENT_PREFIX) + std::strlen(SEGMENT_SUFFIX) &&
+            name.compare(0, std::strlen(SEGMENT_PREFIX), SEGMENT_PREFIX) == 0 &&
+            name.compare(name.size() - std::strlen(SEGMENT_SUFFIX), std::string::npos, SEGMENT_SUFFIX) == 0) {
+            paths.push_back(entry.path().string());
+        }
+    }
+    // Fixed-width hex names sort in sequence order
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+bool JournalReader::read(const std::string& directory, const std::function<void(const JournalRecord&)>& fn,
+                         Summary& summary, std::string& error) {
+    if (!std::filesystem::is_directory(directory)) {
+        error = directory + " is not a directory";
+        return false;
+    }
+    for (const auto& path : listSegments(directory)) {
+        if (!readSegment(path, fn, summary, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JournalReader::readSegment(const std::string& path, const std::function<void(const JournalRecord&)>& fn,
+                                Summary& summary, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < EventJournal::SEGMENT_HEADER_SIZE ||
+        std::memcmp(data.data(), EventJournal::SEGMENT_MAGIC, 8) != 0) {
+        error = path + " is not a journal segment";
+        return false;
+    }
+    summary.segments++;
+
+    size_t offset = EventJournal::SEGMENT_HEADER_SIZE;
+    summary.lastSegmentBytes = offset;
+    while (data.size() - offset >= EventJournal::HEADER_SIZE) {
+        auto size = load<uint32_t>(data.data() + offset);
+        if (size == 0) {
+            return true;
+        }
+        if (size <= EventJournal::HEADER_SIZE || size > data.size() - offset ||
+            crc32(data.data() + offset + 8, size - 8) != load<uint32_t>(data.data() + offset + 4)) {
+            summary.tornSegments++;
+            return true;
+        }
+
+        BinaryReader body(std::string_view(data).substr(offset + EventJournal::HEADER_SIZE,
+                                                         size - EventJournal::HEADER_SIZE));
+        JournalRecord record;
+        record.type = static_cast<JournalEvent>(body.readByte());
+        record.sequence = load<uint64_t>(data.data() + offset + 8);
+        record.timeUs = body.readVarint64();
+        record.room = body.readVarint64();
+        record.payload = body.remaining();
+        if (!body.ok()) {
+            summary.tornSegments++;
+            return true;
+        }
+        summary.records++;
+        fn(record);
+        offset += size;
+        summary.lastSegmentBytes = offset;
+    }
+    return true;
+}
+
+// JournalReplay Implementation
+JournalReplay::JournalReplay(std::string onlyRoomId) : roomFilter(std::move(onlyRoomId)) {}
+
+void JournalReplay::mismatch(const JournalRecord& record, const GameRoom& room, const std::string& what) {
+    mismatches.push_back(room.getRoomId() + " #" + std::to_string(record.sequence) + " " +
+                         std::string(journalEventName(record.type)) + ": " + what);
+}
+
+void JournalReplay::apply(const JournalRecord& record) {
+    BinaryReader in(record.payload);
+    if (record.type == JournalEvent::SERVER_STARTED) {
+        // Rooms still open when the last run stopped are gone, and their
+        // handles will be given out again
+        byHandle.clear();
+        return;
+    }
+    if (record.type == JournalEvent::ROOM_CREATED) {
+        std::string_view roomId = in.readString();
+        uint64_t seed = in.readVarint64();
+        int maxPlayers = static_cast<int>(in.readVarint());
+        bool matchmaking = in.readByte() != 0;
+        if (!in.ok() || (!roomFilter.empty() && roomId != roomFilter)) {
+            return;
+        }
+        auto entry = std::make_shared<Room>();
+        entry->room = std::make_shared<GameRoom>(std::string(roomId), maxPlayers, seed);
+        entry->room->setMatchmaking(matchmaking);
+        entry->createdSequence = record.sequence;
+        byHandle[record.room] = entry;
+        byId[std::string(roomId)].push_back(entry);
+        applied++;
+        return;
+    }
+    if (record.type == JournalEvent::ROOM_RESTORED) {
+        std::string_view roomId = in.readString();
+        if (!in.ok() || (!roomFilter.empty() && roomId != roomFilter)) {
+            return;
+        }
+        // Picks up where the snapshot left the room; the personality only
+        // matters to live AI moves, which the journal already records
+        std::string personalityKey;
+        auto entry = std::make_shared<Room>();
+        entry->room = GameRoom::restore(record.payload, personalityKey);
+        if (!entry->room) {
+            mismatches.push_back(std::string(roomId) + " #" + std::to_string(record.sequence) +
+                                 " ROOM_RESTORED: malformed snapshot record");
+            return;
+        }
+        entry->createdSequence = record.sequence;
+        byHandle[record.room] = entry;
+        byId[std::string(roomId)].push_back(entry);
+        applied++;
+        return;
+    }
+
+    auto it = byHandle.find(record.room);
+    if (it == byHandle.end()) {
+        return;
+    }
+    applied++;
+    Room& entry = *it->second;
+    GameRoom& room = *entry.room;
+    switch (record.type) {
+        case JournalEvent::PLAYER_JOINED: {
+            std::string_view playerId = in.readString();
+            std::string_view name = in.readString();
+            bool ai = in.readByte() != 0;
+            if (in.ok() && !room.restorePlayer(playerId, name, ai)) {
+                mismatch(record, room, "cannot seat " + std::string(playerId));
+            }
+            break;
+        }
+        case JournalEvent::PLAYER_LEFT: {
+            std::string_view playerId = in.readString();
+            if (in.ok() && !room.removePlayer(playerId)) {
+                mismatch(record, room, std::string(playerId) + " is not in the room");
+            }
+            break;
+        }
+        case JournalEvent::GAME_STARTED: {
+            uint64_t seed = in.readVarint64();
+            if (in.ok() && (seed != room.getSeed() || !room.startGame())) {
+                mismatch(record, room, "cannot start the game");
+            }
+            break;
+        }
+        case JournalEvent::CARDS_DEALT: {
+            uint32_t count = in.readVarint();
+            std::vector<std::string> hands;
+            for (uint32_t i = 0; i < count && in.ok(); i++) {
+                uint32_t size = in.readVarint();
+                std::string hand;
+                for (uint32_t c = 0; c < size && in.ok(); c++) {
+                    hand.push_back(static_cast<char>(in.readByte()));
+                }
+                hands.push_back(hand);
+            }
+            if (!in.ok()) {
+                break;
+            }
+            room.dealCards(hands.empty() ? 0 : static_cast<int>(hands[0].size()));
+            const auto& players = room.getPlayers();
+            bool same = hands.size() == players.size();
+            for (size_t i = 0; same && i < hands.size(); i++) {
+                const auto& hand = players[i]->getHand();
+                same = hand.size() == hands[i].size();
+                for (size_t c = 0; same && c < hand.size(); c++) {
+                    same = hand[c].toByte() == static_cast<uint8_t>(hands[i][c]);
+                }
+            }
+            if (!same) {
+                mismatch(record, room, "the seeded deal differs from the hands journaled");
+            }
+            break;
+        }
+        case JournalEvent::CARD_PLAYED: {
+            uint32_t seat = in.readVarint();
+            int cardIndex = static_cast<int>(in.readVarint());
+            uint8_t card = in.readByte();
+            uint8_t powerIndex = in.readByte();
+            uint8_t powerCard = in.readByte();
+            if (!in.ok()) {
+                break;
+            }
+            const auto& players = room.getPlayers();
+            if (seat >= players.size()) {
+                mismatch(record, room, "no player in seat " + std::to_string(seat));
+                break;
+            }
+            Player& player = *players[seat];
+            const auto& hand = player.getHand();
+            // The follow-up's index is into the hand without the card itself
+            int powerAt = powerIndex < cardIndex ? powerIndex : powerIndex + 1;
+            int handSize = static_cast<int>(hand.size());
+            if (cardIndex < 0 || cardIndex >= handSize || hand[cardIndex].toByte() != card ||
+                (powerIndex != NO_CARD && (powerAt >= handSize || hand[powerAt].toByte() != powerCard))) {
+                mismatch(record, room, player.getId() + " doesn't hold " + cardName(card) +
+                                           (powerIndex != NO_CARD ? " and " + cardName(powerCard) : ""));
+                break;
+            }
+            if (!room.replayCard(player.getHandle(), cardIndex,
+                                 powerIndex == NO_CARD ? GameRoom::NO_POWER_CARD : powerIndex)) {
+                mismatch(record, room, player.getId() + " cannot play " + cardName(card) + " now");
+            }
+            break;
+        }
+        case JournalEvent::ROUND_RESOLVED: {
+            int rounds = static_cast<int>(in.readVarint());
+            bool over = in.readByte() != 0;
+            uint32_t count = in.readVarint();
+            std::string journaled, replayed;
+            for (uint32_t i = 0; i < count && in.ok(); i++) {
+                journaled += (i ? "-" : "") + std::to_string(in.readVarint());
+            }
+            for (size_t i = 0; i < room.getPlayers().size(); i++) {
+                replayed += (i ? "-" : "") + std::to_string(room.getPlayers()[i]->getScore());
+            }
+            if (in.ok() && (rounds != room.getRoundsPlayed() || over != room.isGameOver() || journaled != replayed)) {
+                mismatch(record, room, "journaled round " + std::to_string(rounds) + " scores " + journaled +
+                                           ", replay has round " + std::to_string(room.getRoundsPlayed()) +
+                                           " scores " + replayed);
+            }
+            break;
+        }
+        case JournalEvent::ROOM_CLOSED:
+            entry.closed = true;
+            byHandle.erase(it);
+            break;
+        default:
+            break;
+    }
+    if (!in.ok()) {
+        mismatch(record, room, "malformed record");
+    }
+}
+
+std::shared_ptr<const JournalReplay::Room> JournalReplay::find(std::string_view roomId) const {
+    auto it = byId.find(roomId);
+    if (it == byId.end() || it->second.empty()) {
+        return nullptr;
+    }
+    return it->second.back();
+}
+
+size_t JournalReplay::getRoomCount() const {
+    size_t count = 0;
+    for (const auto& [roomId, incarnations] : byId) {
+        count += incarnations.size();
+    }
+    return count;
+}
+
+uint64_t JournalReplay::getAppliedCount() const {
+    return applied;
+}
+
+const std::vector<std::string>& JournalReplay::getMismatches() const {
+    return mismatches;
+}
+
+std::string JournalReplay::describe(const JournalRecord& record) {
+    char time[32];
+    std::snprintf(time, sizeof(time), "%llu.%06llu", static_cast<unsigned long long>(record.timeUs / 1000000),
+                  static_cast<unsigned long long>(record.timeUs % 1000000));
+    std::string line = "#" + std::to_string(record.sequence) + " " + time + " " +
+                       std::string(journalEventName(record.type));
+    if (record.type != JournalEvent::SERVER_STARTED) {
+        char room[24];
+        std::snprintf(room, sizeof(room), " %016llx", static_cast<unsigned long long>(record.room));
+        line += room;
+    }
+
+    BinaryReader in(record.payload);
+    switch (record.type) {
+        case JournalEvent::ROOM_CREATED: {
+            line += " " + std::string(in.readString());
+            line += " seed " + std::to_string(in.readVarint64());
+            line += " maxPlayers " + std::to_string(in.readVarint());
+            if (in.readByte()) {
+                line += " matchmaking";
+            }
+            std::string_view personality = in.readString();
+            if (!personality.empty()) {
+                line += " personality " + std::string(personality);
+            }
+            break;
+        }
+        case JournalEvent::ROOM_RESTORED: {
+            line += " " + std::string(in.readString());
+            std::string personalityKey;
+            auto room = GameRoom::restore(record.payload, personalityKey);
+            if (room) {
+                line += " version " + std::to_string(room->getVersion()) + " " + room->getGameState();
+            } else {
+                line += " (malformed)";
+            }
+            break;
+        }
+        case JournalEvent::PLAYER_JOINED: {
+            line += " " + std::string(in.readString());
+            line += " \"" + std::string(in.readString()) + "\"";
+            if (in.readByte()) {
+                line += " AI";
+            }
+            break;
+        }
+        case JournalEvent::PLAYER_LEFT:
+            line += " " + std::string(in.readString());
+            break;
+        case JournalEvent::GAME_STARTED:
+            line += " seed " + std::to_string(in.readVarint64());
+            break;
+        case JournalEvent::CARDS_DEALT: {
+            uint32_t count = in.readVarint();
+            for (uint32_t i = 0; i < count && in.ok(); i++) {
+                line += i ? " |" : "";
+                uint32_t size = in.readVarint();
+                for (uint32_t c = 0; c < size && in.ok(); c++) {
+                    line += " " + cardName(in.readByte());
+                }
+            }
+            break;
+        }
+        case JournalEvent::CARD_PLAYED: {
+            line += " seat " + std::to_string(in.readVarint());
+            line += " index " + std::to_string(in.readVarint());
+            line += " " + cardName(in.readByte());
+            uint8_t powerIndex = in.readByte();
+            uint8_t powerCard = in.readByte();
+            if (powerIndex != NO_CARD) {
+                line += " + " + cardName(powerCard);
+            }
+            if (in.readByte()) {
+                line += " (auto)";
+            }
+            break;
+        }
+        case JournalEvent::ROUND_RESOLVED: {
+            line += " round " + std::to_string(in.readVarint());
+            bool over = in.readByte() != 0;
+            uint32_t count = in.readVarint();
+            line += " scores";
+            for (uint32_t i = 0; i < count && in.ok(); i++) {
+                line += (i ? "-" : " ") + std::to_string(in.readVarint());
+            }
+            if (over) {
+                line += " game over";
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (!in.ok()) {
+        line += " (malformed)";
+    }
+    return line;
+}
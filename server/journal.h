@@ -0,0 +1,229 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class GameRoom;
+
+// What a journal record says happened. Payloads are varints, one-byte
+// fields and varint-length-prefixed strings (binary_codec.h):
+//   SERVER_STARTED  -            room handles from before mean nothing now
+//   ROOM_CREATED    roomId, seed, maxPlayers, matchmaking byte, personality key
+//   PLAYER_JOINED   playerId, name, AI byte
+//   PLAYER_LEFT     playerId
+//   GAME_STARTED    seed
+//   CARDS_DEALT     player count, then each hand: size and card bytes
+//   CARD_PLAYED     seat, hand index, card byte, POWER follow-up index byte
+//                   and card byte (both 0xFF if none), auto-played byte
+//   ROUND_RESOLVED  rounds played, game-over byte, player count, scores
+//   ROOM_CLOSED     -
+//   ROOM_RESTORED   the room's snapshot record (GameRoom::appendSnapshot),
+//                   when a restarted server takes over a live room
+enum class JournalEvent : uint8_t {
+    SERVER_STARTED = 1,
+    ROOM_CREATED,
+    PLAYER_JOINED,
+    PLAYER_LEFT,
+    GAME_STARTED,
+    CARDS_DEALT,
+    CARD_PLAYED,
+    ROUND_RESOLVED,
+    ROOM_CLOSED,
+    ROOM_RESTORED
+};
+
+std::string_view journalEventName(JournalEvent type);
+
+struct JournalSettings {
+    std::string directory;
+    // Segments are preallocated at this size and a new one started when
+    // the next record doesn't fit
+    size_t segmentSize = 64 * 1024 * 1024;
+    // How often written records are flushed to disk, all at once
+    std::chrono::steady_clock::duration flushInterval = std::chrono::milliseconds(5);
+};
+
+// Append-only log of every change to every room. Records go into a
+// memory-mapped segment file with one memcpy under a mutex, so appending
+// costs well under a microsecond and never waits for the disk; a flusher
+// thread msyncs everything written since its last pass every flush
+// interval (group commit). Once copied into the mapping a record survives
+// the process crashing, and after the next flush a machine crash too.
+//
+// A segment starts with a header naming its first sequence number and holds
+// records back to back, each one:
+//   u32 size (whole record), u32 CRC-32 of the rest, u64 sequence,
+//   event byte, varint microseconds since the epoch, varint room handle,
+//   payload
+// The unused tail of a segment is zeros, so readers stop at a zero size,
+// and at a bad checksum, which is how a record torn by a crash shows up.
+// Segment files are named after their first sequence number and are
+// truncated to what they hold when the journal moves on from them.
+class EventJournal {
+public:
+    static const size_t HEADER_SIZE = 16;
+    static const size_t SEGMENT_HEADER_SIZE = 32;
+    static constexpr char SEGMENT_MAGIC[9] = "CGJRNL01";
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t segments = 0;
+        uint64_t flushes = 0;
+        // Records that couldn't be written (a segment couldn't be created)
+        uint64_t dropped = 0;
+    };
+
+private:
+    struct Segment {
+        std::string path;
+        int fd = -1;
+        char* map = nullptr;
+        size_t capacity = 0;
+        size_t written = 0;
+        size_t synced = 0;
+    };
+
+    JournalSettings settings;
+    mutable std::mutex mutex;
+    std::condition_variable flushWake;
+    std::condition_variable flushed;
+    std::unique_ptr<Segment> current;
+    // Segments the journal has moved on from, closed by the flusher
+    std::vector<std::unique_ptr<Segment>> retired;
+    uint64_t nextSequence = 1;
+    uint64_t durableSequence = 0;
+    bool syncRequested = false;
+    bool stopping = false;
+    bool failed = false;
+    Stats stats;
+    std::thread flusher;
+
+    static std::string& scratch();
+    static void begin(std::string& record, JournalEvent type, uint64_t room);
+    void commit(std::string& record);
+    bool rotateLocked(size_t needed);
+    void flushLoop();
+    static void finish(Segment& segment);
+
+public:
+    EventJournal() = default;
+    ~EventJournal();
+    EventJournal(const EventJournal&) = delete;
+    EventJournal& operator=(const EventJournal&) = delete;
+
+    // Creates the directory if needed and starts a new segment after any
+    // already there, numbering on from their last record. The newest old
+    // segment is cut back to its last intact record, as it would have been
+    // had its server stopped cleanly.
+    bool open(const JournalSettings& journalSettings, std::string& error);
+    // Flushes everything and closes the segment; appends after this are
+    // dropped
+    void close();
+
+    // Appends one record from any thread. fill(out) appends the payload.
+    // Records for one room must come from one thread at a time, which the
+    // room's worker ensures, so they are journaled in the order they happen.
+    template <typename Fill>
+    void append(JournalEvent type, uint64_t room, Fill&& fill) {
+        std::string& record = scratch();
+        begin(record, type, room);
+        fill(record);
+        commit(record);
+    }
+    void append(JournalEvent type, uint64_t room) {
+        append(type, room, [](std::string&) {});
+    }
+
+    // Blocks until every record appended so far is on disk
+    void sync();
+
+    Stats getStats() const;
+};
+
+// One record as read back
+struct JournalRecord {
+    JournalEvent type;
+    uint64_t sequence = 0;
+    uint64_t timeUs = 0;
+    uint64_t room = 0;
+    std::string_view payload;
+};
+
+// Reads a journal directory's segments in order
+class JournalReader {
+public:
+    struct Summary {
+        size_t segments = 0;
+        uint64_t records = 0;
+        // Segments whose tail held a torn or corrupt record
+        size_t tornSegments = 0;
+        // Length of the last segment read, up to its last intact record
+        size_t lastSegmentBytes = 0;
+    };
+
+    // Segment paths, oldest first
+    static std::vector<std::string> listSegments(const std::string& directory);
+
+    // Calls fn for every intact record of every segment; false if the
+    // directory or a segment can't be read
+    static bool read(const std::string& directory, const std::function<void(const JournalRecord&)>& fn,
+                     Summary& summary, std::string& error);
+    static bool readSegment(const std::string& path, const std::function<void(const JournalRecord&)>& fn,
+                            Summary& summary, std::string& error);
+};
+
+// Rebuilds rooms from journal records with GameRoom's own rules: joins,
+// the seeded shuffle and every card exactly as journaled. Along the way the
+// rebuilt room is checked against what the journal says happened (hands
+// dealt, cards played, round results), so a room whose live play and
+// replay disagree is reported rather than silently rebuilt.
+class JournalReplay {
+public:
+    struct Room {
+        std::shared_ptr<GameRoom> room;
+        uint64_t createdSequence = 0;
+        bool closed = false;
+    };
+
+private:
+    // Only rooms with this id are rebuilt; empty rebuilds every room
+    std::string roomFilter;
+    // Live handles of the current server run
+    std::map<uint64_t, std::shared_ptr<Room>> byHandle;
+    // Every incarnation of every room id, oldest first
+    std::map<std::string, std::vector<std::shared_ptr<Room>>, std::less<>> byId;
+    std::vector<std::string> mismatches;
+    uint64_t applied = 0;
+
+    void mismatch(const JournalRecord& record, const GameRoom& room, const std::string& what);
+
+public:
+    explicit JournalReplay(std::string onlyRoomId = std::string());
+
+    // Feed every record in journal order
+    void apply(const JournalRecord& record);
+
+    // The latest incarnation of the room, or null
+    std::shared_ptr<const Room> find(std::string_view roomId) const;
+    size_t getRoomCount() const;
+    uint64_t getAppliedCount() const;
+    // One line per disagreement between the journal and the rebuilt room
+    const std::vector<std::string>& getMismatches() const;
+
+    // The record as one line of text, for dumps
+    static std::string describe(const JournalRecord& record);
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,66 @@
+#include "lobby.h"
+#include "card_game.h"
+
+void Lobby::update(GameRoom& room) {
+    LobbySlot& slot = room.getLobbySlot();
+    bool listable = !slot.removed && !room.isGameStarted() && !room.isMatchmaking() && room.getPlayerCount() < room.getMaxPlayers();
+    int players = listable ? room.getPlayerCount() : -1;
+    if (players == slot.listedPlayers) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!listable) {
+        unlistLocked(room, slot);
+        return;
+    }
+    if (slot.index == LobbySlot::NOT_LISTED) {
+        slot.index = open.size();
+        open.push_back({ &room, { room.getRoomId(), players, room.getMaxPlayers() } });
+    } else {
+        open[slot.index].listing.players = players;
+    }
+    slot.listedPlayers = players;
+    changed = true;
+}
+
+void Lobby::remove(GameRoom& room) {
+    std::lock_guard<std::mutex> lock(mutex);
+    LobbySlot& slot = room.getLobbySlot();
+    slot.removed = true;
+    unlistLocked(room, slot);
+}
+
+void Lobby::unlistLocked(GameRoom& room, LobbySlot& slot) {
+    slot.listedPlayers = -1;
+    if (slot.index == LobbySlot::NOT_LISTED) {
+        return;
+    }
+    Entry& last = open.back();
+    if (last.room != &room) {
+        last.room->getLobbySlot().index = slot.index;
+        open[slot.index] = std::move(last);
+    }
+    open.pop_back();
+    slot.index = LobbySlot::NOT_LISTED;
+    changed = true;
+}
+
+Lobby::Snapshot Lobby::getSnapshot() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (changed) {
+        auto listings = std::make_shared<std::vector<Listing>>();
+        listings->reserve(open.size());
+        for (const auto& entry : open) {
+            listings->push_back(entry.listing);
+        }
+        snapshot = std::move(listings);
+        changed = false;
+    }
+    return snapshot;
+}
+
+size_t Lobby::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return open.size();
+}
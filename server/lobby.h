@@ -0,0 +1,71 @@
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class GameRoom;
+
+// A room's place in the Lobby. Embedded in the room; only the Lobby touches it.
+class LobbySlot {
+    friend class Lobby;
+
+private:
+    static const size_t NOT_LISTED = SIZE_MAX;
+
+    // Guarded by the lobby's mutex: where the room's entry is
+    size_t index = NOT_LISTED;
+    // Owned by the room's worker: the player count last listed, -1 if the
+    // room isn't listed, so an unchanged room is checked without the lock
+    int listedPlayers = -1;
+    // Set when the room is evicted; tasks still queued can't list it again
+    bool removed = false;
+};
+
+// The rooms that can still be joined: not started, not full and not held
+// for quick-match. GameServer updates a room's entry after every task it
+// runs, so the index changes with the rooms instead of being found by a
+// scan of the registry, and its size is the number of open rooms however
+// many have been created. Entries are removed by swapping the last one into
+// their place, so listing, updating and unlisting a room are O(1).
+class Lobby {
+public:
+    struct Listing {
+        std::string roomId;
+        int players = 0;
+        int maxPlayers = 0;
+    };
+    using Snapshot = std::shared_ptr<const std::vector<Listing>>;
+
+private:
+    struct Entry {
+        GameRoom* room;
+        Listing listing;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<Entry> open;
+    // Shared by every listing until the index next changes
+    Snapshot snapshot;
+    bool changed = true;
+
+    void unlistLocked(GameRoom& room, LobbySlot& slot);
+
+public:
+    // Lists, relists or unlists the room to match its state. Call from the
+    // room's worker, or before the room has one.
+    void update(GameRoom& room);
+    // Unlists the room for good; call when it is evicted
+    void remove(GameRoom& room);
+
+    // The open rooms as of the last change; rebuilt on the first call after
+    // one, so concurrent lobby reads cost a reference count
+    Snapshot getSnapshot();
+    size_t size() const;
+};
+
+#endif // LOBBY_H
@@ -0,0 +1,67 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+// Intrusive lock-free multi-producer/single-consumer queue (Vyukov). Nodes
+// carry their own link, given as a pointer-to-member, so pushing never
+// allocates. push() is wait-free and may be called from any thread; pop()
+// must only be called by the single consumer.
+//
+// pop() can briefly return nullptr while a producer is between swapping the
+// head and linking its node; callers that must not miss work re-check with
+// maybeNonEmpty().
+template <typename Node, std::atomic<Node*> Node::*Link>
+class MpscQueue {
+private:
+    std::atomic<Node*> head; // producers swap themselves in here
+    Node* tail;              // consumer side
+    Node* stub;
+
+public:
+    explicit MpscQueue(Node* stubNode) : head(stubNode), tail(stubNode), stub(stubNode) {
+        (stub->*Link).store(nullptr, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(Node* node) {
+        (node->*Link).store(nullptr, std::memory_order_relaxed);
+        Node* prev = head.exchange(node);
+        (prev->*Link).store(node, std::memory_order_release);
+    }
+
+    Node* pop() {
+        Node* current = tail;
+        Node* next = (current->*Link).load(std::memory_order_acquire);
+        if (current == stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            current = next;
+            next = (next->*Link).load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+        if (current != head.load()) {
+            // A producer is mid-push; its node will be visible shortly
+            return nullptr;
+        }
+        push(stub);
+        next = (current->*Link).load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+        return nullptr;
+    }
+
+    // Consumer-side check; may report work that is still being linked in
+    bool maybeNonEmpty() const {
+        return tail != stub || head.load() != stub;
+    }
+};
+
+#endif // MPSC_QUEUE_H
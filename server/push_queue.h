@@ -0,0 +1,98 @@
+#ifndef PUSH_QUEUE_H
+#define PUSH_QUEUE_H
+
+#include <cstddef>
+#include <deque>
+#include <string_view>
+#include <utility>
+
+#include "client_session.h"
+
+// Queue of pushed messages waiting to be written to one connection. Messages
+// are shared buffers, so queueing one broadcast to thousands of connections
+// copies nothing.
+//
+// Each message belongs to a stream (one room's state updates) and is a full
+// snapshot that supersedes earlier messages of its stream. Once more than
+// CAPACITY messages are waiting, the oldest superseded one that has not
+// started going out is dropped, so a slow reader skips intermediate states
+// instead of making the server buffer them. The queue only grows past
+// CAPACITY while every waiting message is the latest of its stream.
+class PushQueue {
+public:
+    static const size_t CAPACITY = 8;
+
+private:
+    struct Entry {
+        SharedBuffer message;
+        const void* stream;
+    };
+
+    std::deque<Entry> entries;
+    size_t offset; // bytes of the front message already written
+
+    // Index of the oldest droppable message, or entries.size() if none
+    size_t findSuperseded(const void* incoming) const {
+        size_t first = inProgress() ? 1 : 0;
+        for (size_t i = first; i < entries.size(); i++) {
+            if (entries[i].stream == incoming) return i;
+        }
+        for (size_t i = first; i < entries.size(); i++) {
+            for (size_t j = i + 1; j < entries.size(); j++) {
+                if (entries[j].stream == entries[i].stream) return i;
+            }
+        }
+        return entries.size();
+    }
+
+public:
+    PushQueue() : offset(0) {}
+
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+
+    // True while the front message is partly written; nothing else may be
+    // sent on the connection until it is finished
+    bool inProgress() const { return offset > 0; }
+
+    // Returns false if an older message was dropped to make room
+    bool push(SharedBuffer message, const void* stream) {
+        bool dropped = false;
+        if (entries.size() >= CAPACITY) {
+            size_t victim = findSuperseded(stream);
+            if (victim < entries.size()) {
+                entries.erase(entries.begin() + victim);
+                dropped = true;
+            }
+        }
+        entries.push_back({ std::move(message), stream });
+        return !dropped;
+    }
+
+    // Unwritten bytes of the index-th queued message
+    std::string_view pending(size_t index) const {
+        const std::string& message = *entries[index].message;
+        size_t skip = index == 0 ? offset : 0;
+        return std::string_view(message.data() + skip, message.size() - skip);
+    }
+
+    // Marks bytes as written, front message first; returns how many of them
+    // belonged to queued messages
+    size_t consume(size_t bytes) {
+        size_t used = 0;
+        while (!entries.empty() && bytes > 0) {
+            size_t remaining = entries.front().message->size() - offset;
+            if (bytes < remaining) {
+                offset += bytes;
+                return used + bytes;
+            }
+            bytes -= remaining;
+            used += remaining;
+            entries.pop_front();
+            offset = 0;
+        }
+        return used;
+    }
+};
+
+#endif // PUSH_QUEUE_H
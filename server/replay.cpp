@@ -0,0 +1,101 @@
+// Reads a server's event journal (--journal DIR) and rebuilds rooms from it
+// with the real GameRoom rules, checking every hand dealt, card played and
+// round result against what the journal recorded.
+//
+// Usage: card_game_replay DIR [ROOM_ID] [--dump]
+//   ROOM_ID: rebuild just this room (its latest incarnation), print its
+//            records and its final state
+//   --dump:  print every record in the journal
+//
+// Exits non-zero if the journal can't be read, the room isn't in it, or a
+// rebuilt room disagrees with the journal.
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "binary_codec.h"
+#include "card_game.h"
+#include "journal.h"
+
+namespace {
+
+void printUsage() {
+    std::cerr << "Usage: card_game_replay DIR [ROOM_ID] [--dump]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string directory;
+    std::string roomId;
+    bool dump = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--dump") {
+            dump = true;
+        } else if (directory.empty()) {
+            directory = arg;
+        } else if (roomId.empty()) {
+            roomId = arg;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (directory.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    JournalReplay replay(roomId);
+    // The room each live handle names in the current server run, so a
+    // room's records can be picked out
+    std::map<uint64_t, std::string> roomIds;
+    JournalReader::Summary summary;
+    std::string error;
+    bool ok = JournalReader::read(directory, [&](const JournalRecord& record) {
+        if (record.type == JournalEvent::SERVER_STARTED) {
+            roomIds.clear();
+        } else if (record.type == JournalEvent::ROOM_CREATED || record.type == JournalEvent::ROOM_RESTORED) {
+            BinaryReader in(record.payload);
+            roomIds[record.room] = std::string(in.readString());
+        }
+        auto it = roomIds.find(record.room);
+        bool inRoom = !roomId.empty() && it != roomIds.end() && it->second == roomId;
+        if (dump || inRoom) {
+            std::cout << JournalReplay::describe(record) << std::endl;
+        }
+        if (record.type == JournalEvent::ROOM_CLOSED && it != roomIds.end()) {
+            roomIds.erase(it);
+        }
+        replay.apply(record);
+    }, summary, error);
+    if (!ok) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    std::cout << summary.segments << " segments, " << summary.records << " records";
+    if (summary.tornSegments > 0) {
+        std::cout << ", " << summary.tornSegments << " ending in a torn record";
+    }
+    std::cout << "; " << replay.getRoomCount() << " rooms rebuilt" << std::endl;
+
+    bool consistent = replay.getMismatches().empty();
+    for (const auto& mismatch : replay.getMismatches()) {
+        std::cout << "MISMATCH " << mismatch << std::endl;
+    }
+
+    if (!roomId.empty()) {
+        auto room = replay.find(roomId);
+        if (!room) {
+            std::cerr << "No room " << roomId << " in the journal" << std::endl;
+            return 1;
+        }
+        std::cout << roomId << " from record #" << room->createdSequence << (room->closed ? ", closed" : ", still open")
+                  << std::endl;
+        std::cout << room->room->getGameState() << std::endl;
+    }
+    return consistent ? 0 : 1;
+}
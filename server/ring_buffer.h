@@ -0,0 +1,147 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Fixed-capacity byte ring used for per-connection input and output. The
+// capacity is always a power of two so positions can grow monotonically and
+// be masked on access. Readable/writable space is exposed as at most two
+// contiguous regions, which map directly onto readv/writev iovecs.
+class RingBuffer {
+public:
+    struct Region {
+        char* data;
+        size_t length;
+    };
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+private:
+    std::unique_ptr<char[]> storage;
+    size_t cap;
+    size_t head; // next byte to read
+    size_t tail; // next byte to write
+
+    static size_t roundUp(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+public:
+    explicit RingBuffer(size_t capacity)
+        : storage(new char[roundUp(capacity)]), cap(roundUp(capacity)), head(0), tail(0) {}
+
+    size_t size() const { return tail - head; }
+    size_t capacity() const { return cap; }
+    size_t available() const { return cap - size(); }
+    bool empty() const { return head == tail; }
+    bool full() const { return size() == cap; }
+
+    void clear() { head = tail = 0; }
+
+    // Unread byte at the given offset from the front; offset must be < size()
+    unsigned char at(size_t offset) const {
+        return static_cast<unsigned char>(storage[(head + offset) & (cap - 1)]);
+    }
+
+    // Returns the number of regions (0-2) holding unread bytes
+    int readableRegions(Region regions[2]) const {
+        size_t used = size();
+        if (used == 0) return 0;
+        size_t start = head & (cap - 1);
+        size_t first = std::min(used, cap - start);
+        regions[0] = { storage.get() + start, first };
+        if (first == used) return 1;
+        regions[1] = { storage.get(), used - first };
+        return 2;
+    }
+
+    // Returns the number of regions (0-2) of free space, in write order
+    int writableRegions(Region regions[2]) {
+        size_t freeBytes = available();
+        if (freeBytes == 0) return 0;
+        size_t start = tail & (cap - 1);
+        size_t first = std::min(freeBytes, cap - start);
+        regions[0] = { storage.get() + start, first };
+        if (first == freeBytes) return 1;
+        regions[1] = { storage.get(), freeBytes - first };
+        return 2;
+    }
+
+    // Marks bytes written into the writable regions as readable
+    void commit(size_t n) { tail += n; }
+
+    // Drops bytes from the front after they have been handled or sent
+    void consume(size_t n) {
+        head += n;
+        if (head == tail) head = tail = 0;
+    }
+
+    bool append(const char* bytes, size_t n) {
+        if (n > available()) return false;
+        size_t start = tail & (cap - 1);
+        size_t first = std::min(n, cap - start);
+        memcpy(storage.get() + start, bytes, first);
+        memcpy(storage.get(), bytes + first, n - first);
+        tail += n;
+        return true;
+    }
+
+    bool append(std::string_view bytes) {
+        return append(bytes.data(), bytes.size());
+    }
+
+    // Grows the buffer to at least newCapacity, keeping unread bytes
+    void reserve(size_t newCapacity) {
+        if (newCapacity <= cap) return;
+        size_t newCap = roundUp(newCapacity);
+        std::unique_ptr<char[]> grown(new char[newCap]);
+        Region regions[2];
+        int count = readableRegions(regions);
+        size_t used = 0;
+        for (int i = 0; i < count; i++) {
+            memcpy(grown.get() + used, regions[i].data, regions[i].length);
+            used += regions[i].length;
+        }
+        storage = std::move(grown);
+        cap = newCap;
+        head = 0;
+        tail = used;
+    }
+
+    // Offset of the first occurrence of c among the unread bytes, or npos
+    size_t find(char c) const {
+        Region regions[2];
+        int count = readableRegions(regions);
+        size_t offset = 0;
+        for (int i = 0; i < count; i++) {
+            const void* hit = memchr(regions[i].data, c, regions[i].length);
+            if (hit) {
+                return offset + (static_cast<const char*>(hit) - regions[i].data);
+            }
+            offset += regions[i].length;
+        }
+        return npos;
+    }
+
+    // Contiguous view of the first n unread bytes. Only copies (into the
+    // caller's reusable scratch string) when the bytes wrap around the end.
+    std::string_view view(size_t n, std::string& scratch) const {
+        size_t start = head & (cap - 1);
+        if (start + n <= cap) {
+            return std::string_view(storage.get() + start, n);
+        }
+        size_t first = cap - start;
+        scratch.assign(storage.get() + start, first);
+        scratch.append(storage.get(), n - first);
+        return scratch;
+    }
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,116 @@
+#include "room_executor.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+RoomExecutor::RoomExecutor(size_t threadCount) : nextWorker(0), stopping(false) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        workers[i]->thread = std::thread(&RoomExecutor::workerLoop, this, i);
+    }
+}
+
+RoomExecutor::~RoomExecutor() {
+    stopping = true;
+    for (auto& worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->wakeup.notify_one();
+    }
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+size_t RoomExecutor::getWorkerCount() const {
+    return workers.size();
+}
+
+void RoomExecutor::enqueue(RoomMailbox& mailbox, RoomTask* task) {
+    mailbox.tasks.push(task);
+
+    // Only the producer that flips the room from idle to scheduled hands it
+    // to the worker; everyone else just leaves their task in the mailbox
+    if (!mailbox.scheduled.exchange(true)) {
+        schedule(mailbox);
+    }
+}
+
+void RoomExecutor::schedule(RoomMailbox& mailbox) {
+    uint32_t index = mailbox.worker.load(std::memory_order_relaxed);
+    if (index == RoomMailbox::NO_WORKER) {
+        uint32_t assigned = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        if (mailbox.worker.compare_exchange_strong(index, assigned)) {
+            index = assigned;
+        }
+    }
+
+    Worker& worker = *workers[index];
+    worker.ready.push(&mailbox);
+    if (worker.sleeping.load()) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.wakeup.notify_one();
+    }
+}
+
+void RoomExecutor::runMailbox(Worker& worker, RoomMailbox& mailbox) {
+    // Hold the room while its mailbox is in use: the last task may be the
+    // only remaining owner
+    std::shared_ptr<GameRoom> keepAlive;
+
+    for (int i = 0; i < MAILBOX_BATCH; i++) {
+        RoomTask* task = mailbox.tasks.pop();
+        if (!task) break;
+        if (!keepAlive) keepAlive = task->room;
+        task->run(*task->room);
+        delete task;
+    }
+
+    mailbox.scheduled.store(false);
+    if (mailbox.tasks.maybeNonEmpty() && !mailbox.scheduled.exchange(true)) {
+        // More work arrived (or the batch limit was hit); go to the back of
+        // the line so other rooms on this worker get a turn
+        worker.ready.push(&mailbox);
+    }
+}
+
+void RoomExecutor::workerLoop(size_t index) {
+    Worker& worker = *workers[index];
+
+#ifdef __linux__
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores > 0 && workers.size() <= cores) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+
+    while (true) {
+        RoomMailbox* mailbox = worker.ready.pop();
+        if (mailbox) {
+            runMailbox(worker, *mailbox);
+            continue;
+        }
+
+        if (stopping && !worker.ready.maybeNonEmpty()) {
+            break;
+        }
+
+        // Announce we're about to sleep, then look again so a producer that
+        // pushed before seeing the flag can't be missed
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.sleeping.store(true);
+        worker.wakeup.wait(lock, [&] { return worker.ready.maybeNonEmpty() || stopping; });
+        worker.sleeping.store(false);
+    }
+}
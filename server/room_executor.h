@@ -0,0 +1,112 @@
+#ifndef ROOM_EXECUTOR_H
+#define ROOM_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mpsc_queue.h"
+
+class GameRoom;
+
+// One unit of work for a room. The task keeps its room alive until it runs.
+struct RoomTask {
+    std::atomic<RoomTask*> next;
+    std::shared_ptr<GameRoom> room;
+
+    RoomTask() : next(nullptr) {}
+    explicit RoomTask(std::shared_ptr<GameRoom> target) : next(nullptr), room(std::move(target)) {}
+    virtual ~RoomTask() = default;
+
+    virtual void run(GameRoom& target) = 0;
+};
+
+// Per-room lock-free mailbox. Producers on any thread push tasks; the room's
+// worker drains them, so all mutations of one room are serialized on one
+// thread without locks.
+class RoomMailbox {
+    friend class RoomExecutor;
+
+private:
+    struct StubTask : RoomTask {
+        void run(GameRoom&) override {}
+    };
+
+    StubTask stub;
+    MpscQueue<RoomTask, &RoomTask::next> tasks;
+    std::atomic<bool> scheduled;
+    std::atomic<RoomMailbox*> readyNext;
+    std::atomic<uint32_t> worker;
+
+public:
+    static const uint32_t NO_WORKER = UINT32_MAX;
+
+    RoomMailbox() : tasks(&stub), scheduled(false), readyNext(nullptr), worker(NO_WORKER) {}
+
+    RoomMailbox(const RoomMailbox&) = delete;
+    RoomMailbox& operator=(const RoomMailbox&) = delete;
+};
+
+// Fixed pool of worker threads that run room mailboxes. Each room is pinned
+// to one worker (assigned round-robin on first use) so its state stays hot
+// in that core's cache and never needs a lock.
+class RoomExecutor {
+private:
+    template <typename Fn>
+    struct FunctionTask : RoomTask {
+        Fn fn;
+
+        FunctionTask(std::shared_ptr<GameRoom> target, Fn&& work)
+            : RoomTask(std::move(target)), fn(std::move(work)) {}
+
+        void run(GameRoom& target) override { fn(target); }
+    };
+
+    struct Worker {
+        RoomMailbox stub;
+        MpscQueue<RoomMailbox, &RoomMailbox::readyNext> ready;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::atomic<bool> sleeping;
+        std::thread thread;
+
+        Worker() : ready(&stub), sleeping(false) {}
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<uint32_t> nextWorker;
+    std::atomic<bool> stopping;
+
+    void enqueue(RoomMailbox& mailbox, RoomTask* task);
+    void schedule(RoomMailbox& mailbox);
+    void runMailbox(Worker& worker, RoomMailbox& mailbox);
+    void workerLoop(size_t index);
+
+public:
+    // Tasks run per mailbox visit before the worker moves on to other rooms
+    static const int MAILBOX_BATCH = 64;
+
+    explicit RoomExecutor(size_t threadCount = 0);
+    ~RoomExecutor();
+
+    RoomExecutor(const RoomExecutor&) = delete;
+    RoomExecutor& operator=(const RoomExecutor&) = delete;
+
+    // Queues fn(GameRoom&) on the room's worker. Callable from any thread,
+    // including from inside another room's task.
+    template <typename Fn>
+    void submit(const std::shared_ptr<GameRoom>& room, RoomMailbox& mailbox, Fn&& fn) {
+        using Task = FunctionTask<std::decay_t<Fn>>;
+        enqueue(mailbox, new Task(room, std::decay_t<Fn>(std::forward<Fn>(fn))));
+    }
+
+    size_t getWorkerCount() const;
+};
+
+#endif // ROOM_EXECUTOR_H
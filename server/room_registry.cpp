@@ -0,0 +1,114 @@
+#include "room_registry.h"
+#include <mutex>
+
+const RoomRegistry::Slot* RoomRegistry::slotFor(const Shard& shard, RoomHandle handle) const {
+    size_t index = handle.index() / SHARD_COUNT;
+    if (index >= shard.slots.size()) {
+        return nullptr;
+    }
+    const Slot& slot = shard.slots[index];
+    return slot.room && slot.generation == handle.generation() ? &slot : nullptr;
+}
+
+RoomHandle RoomRegistry::insert(const std::string& roomId, std::shared_ptr<GameRoom> room) {
+    RoomHandle handle = reserve(roomId);
+    if (handle.valid()) {
+        publish(handle, std::move(room));
+    }
+    return handle;
+}
+
+RoomHandle RoomRegistry::reserve(const std::string& roomId) {
+    uint64_t hash = FlatStringMap<RoomHandle>::hashOf(roomId);
+    size_t shardIndex = shardOf(hash);
+    Shard& shard = shards[shardIndex];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (shard.ids.find(roomId, hash)) {
+        return RoomHandle();
+    }
+
+    uint32_t index;
+    if (!shard.freeSlots.empty()) {
+        index = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        index = static_cast<uint32_t>(shard.slots.size());
+        shard.slots.emplace_back();
+    }
+    Slot& slot = shard.slots[index];
+    slot.generation++;
+    RoomHandle handle(static_cast<uint32_t>(index * SHARD_COUNT + shardIndex), slot.generation);
+    shard.ids.insert(roomId, hash, handle);
+    return handle;
+}
+
+void RoomRegistry::publish(RoomHandle handle, std::shared_ptr<GameRoom> room) {
+    Shard& shard = shards[handle.index() & (SHARD_COUNT - 1)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    Slot& slot = shard.slots[handle.index() / SHARD_COUNT];
+    if (!slot.room && slot.generation == handle.generation()) {
+        slot.room = std::move(room);
+        shard.live++;
+    }
+}
+
+void RoomRegistry::release(RoomHandle handle, std::string_view roomId) {
+    Shard& shard = shards[handle.index() & (SHARD_COUNT - 1)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    size_t index = handle.index() / SHARD_COUNT;
+    const Slot& slot = shard.slots[index];
+    if (slot.room || slot.generation != handle.generation()) {
+        return;
+    }
+    shard.freeSlots.push_back(static_cast<uint32_t>(index));
+    shard.ids.erase(roomId, FlatStringMap<RoomHandle>::hashOf(roomId));
+}
+
+bool RoomRegistry::erase(RoomHandle handle, std::string_view roomId) {
+    Shard& shard = shards[handle.index() & (SHARD_COUNT - 1)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    if (!slotFor(shard, handle)) {
+        return false;
+    }
+    size_t index = handle.index() / SHARD_COUNT;
+    shard.slots[index].room.reset();
+    shard.freeSlots.push_back(static_cast<uint32_t>(index));
+    shard.ids.erase(roomId, FlatStringMap<RoomHandle>::hashOf(roomId));
+    shard.live--;
+    return true;
+}
+
+RoomHandle RoomRegistry::lookup(std::string_view roomId) const {
+    uint64_t hash = FlatStringMap<RoomHandle>::hashOf(roomId);
+    const Shard& shard = shards[shardOf(hash)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const RoomHandle* handle = shard.ids.find(roomId, hash);
+    return handle ? *handle : RoomHandle();
+}
+
+std::shared_ptr<GameRoom> RoomRegistry::find(std::string_view roomId) const {
+    uint64_t hash = FlatStringMap<RoomHandle>::hashOf(roomId);
+    const Shard& shard = shards[shardOf(hash)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const RoomHandle* handle = shard.ids.find(roomId, hash);
+    if (!handle) {
+        return nullptr;
+    }
+    return shard.slots[handle->index() / SHARD_COUNT].room;
+}
+
+std::shared_ptr<GameRoom> RoomRegistry::find(RoomHandle handle) const {
+    const Shard& shard = shards[handle.index() & (SHARD_COUNT - 1)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const Slot* slot = slotFor(shard, handle);
+    return slot ? slot->room : nullptr;
+}
+
+size_t RoomRegistry::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.live;
+    }
+    return total;
+}
@@ -0,0 +1,89 @@
+#ifndef ROOM_REGISTRY_H
+#define ROOM_REGISTRY_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flat_hash_map.h"
+#include "handle.h"
+
+class GameRoom;
+
+// Concurrent room table split into independently locked shards chosen by
+// room-id hash. Lookups take a shard's lock in shared mode, so readers on
+// different threads never block each other and writers only contend with
+// rooms that hash to the same shard.
+//
+// Each room lives in a slot of its shard and is named internally by a
+// RoomHandle: the slot's index (times SHARD_COUNT, plus the shard) and its
+// generation. The string ids clients use are mapped to handles by a
+// FlatStringMap per shard, so a string is hashed once, when a command
+// arrives; from then on the server finds the room by index.
+class RoomRegistry {
+public:
+    static const size_t SHARD_COUNT = 64; // power of two
+
+private:
+    struct Slot {
+        std::shared_ptr<GameRoom> room;
+        uint32_t generation = 0;
+    };
+
+    // Each shard sits on its own cache line so locks don't false-share
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        FlatStringMap<RoomHandle> ids;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+        size_t live = 0;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+
+    // The map's home slot comes from the low bits of the hash, so the
+    // shard comes from higher ones
+    static size_t shardOf(uint64_t hash) { return (hash >> 32) & (SHARD_COUNT - 1); }
+
+    // The slot for handle, or null if the handle is stale; hold the lock
+    const Slot* slotFor(const Shard& shard, RoomHandle handle) const;
+
+public:
+    // The room's handle, or an invalid handle if the id is taken
+    RoomHandle insert(const std::string& roomId, std::shared_ptr<GameRoom> room);
+    // Registering in two steps, for a room that needs its handle before
+    // anyone can find it: reserve claims the id and a slot (invalid handle
+    // if the id is taken), publish puts the room in the slot. Until then
+    // the id looks taken but finds no room. release gives back a
+    // reservation that won't be published.
+    RoomHandle reserve(const std::string& roomId);
+    void publish(RoomHandle handle, std::shared_ptr<GameRoom> room);
+    void release(RoomHandle handle, std::string_view roomId);
+    // Erases the room with this handle; false if it is already gone
+    bool erase(RoomHandle handle, std::string_view roomId);
+
+    RoomHandle lookup(std::string_view roomId) const;
+    std::shared_ptr<GameRoom> find(std::string_view roomId) const;
+    std::shared_ptr<GameRoom> find(RoomHandle handle) const;
+
+    size_t size() const;
+
+    // Visits every room shard by shard; fn must not call back into the registry
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& shard : shards) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            for (const auto& slot : shard.slots) {
+                if (slot.room) {
+                    fn(slot.room);
+                }
+            }
+        }
+    }
+};
+
+#endif // ROOM_REGISTRY_H
@@ -0,0 +1,96 @@
+#include "scheduler.h"
+
+Scheduler::Scheduler(Clock::duration tickResolution)
+    : resolution(tickResolution), start(Clock::now()), wheel(0), incoming(&stub), stopping(false), pending(0),
+      fired(0), totalLag(0), maxLag(0) {
+    thread = std::thread(&Scheduler::run, this);
+}
+
+Scheduler::~Scheduler() {
+    stop();
+
+    while (Task* task = incoming.pop()) {
+        delete task;
+    }
+    wheel.clear([](TimingWheel::Timer* timer) {
+        delete static_cast<Task*>(timer);
+    });
+}
+
+void Scheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+uint64_t Scheduler::tickAt(Clock::time_point time) const {
+    if (time <= start) return 0;
+    return static_cast<uint64_t>((time - start + resolution - Clock::duration(1)) / resolution);
+}
+
+void Scheduler::schedule(Clock::duration delay, std::function<void()> fn) {
+    Task* task = new Task();
+    task->due = Clock::now() + delay;
+    task->fn = std::move(fn);
+    pending.fetch_add(1, std::memory_order_relaxed);
+    incoming.push(task);
+}
+
+size_t Scheduler::getPendingCount() const {
+    return pending.load(std::memory_order_relaxed);
+}
+
+Scheduler::LagStats Scheduler::getLagStats() const {
+    LagStats stats;
+    stats.fired = fired.load(std::memory_order_relaxed);
+    stats.total = Clock::duration(totalLag.load(std::memory_order_relaxed));
+    stats.max = Clock::duration(maxLag.load(std::memory_order_relaxed));
+    return stats;
+}
+
+void Scheduler::run() {
+    Clock::time_point nextTick = start + resolution;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait_until(lock, nextTick, [&] { return stopping.load(); });
+            if (stopping) break;
+        }
+
+        // Take in new timers, then fire everything due up to the current tick
+        while (true) {
+            Task* task = incoming.pop();
+            if (!task) {
+                if (!incoming.maybeNonEmpty()) break;
+                std::this_thread::yield();
+                continue;
+            }
+            wheel.schedule(task, tickAt(task->due));
+        }
+
+        // Deadlines round up and elapsed time rounds down, so nothing fires early
+        Clock::time_point now = Clock::now();
+        uint64_t elapsed = static_cast<uint64_t>((now - start) / resolution);
+        wheel.advance(elapsed, [&](TimingWheel::Timer* timer) {
+            Task* task = static_cast<Task*>(timer);
+            pending.fetch_sub(1, std::memory_order_relaxed);
+
+            // Only this thread writes the lag counters
+            Clock::rep lag = (Clock::now() - task->due).count();
+            fired.fetch_add(1, std::memory_order_relaxed);
+            totalLag.fetch_add(lag, std::memory_order_relaxed);
+            if (lag > maxLag.load(std::memory_order_relaxed)) {
+                maxLag.store(lag, std::memory_order_relaxed);
+            }
+            task->fn();
+            delete task;
+        });
+        nextTick = start + resolution * (elapsed + 1);
+    }
+}
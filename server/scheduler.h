@@ -0,0 +1,79 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "mpsc_queue.h"
+#include "timing_wheel.h"
+
+// Runs callbacks after a delay on one timer thread driving a TimingWheel.
+// Any thread may schedule; new timers travel to the timer thread through a
+// lock-free queue, so the wheel itself is never shared. Callbacks must be
+// quick: anything touching a room should just submit a task to it.
+class Scheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // How late callbacks ran compared to when they were due. Includes the
+    // tick rounding, so expect up to one tick of lag on an idle server.
+    struct LagStats {
+        uint64_t fired = 0;
+        Clock::duration total = Clock::duration::zero();
+        Clock::duration max = Clock::duration::zero();
+    };
+
+private:
+    struct Task : TimingWheel::Timer {
+        std::atomic<Task*> link;
+        Clock::time_point due;
+        std::function<void()> fn;
+
+        Task() : link(nullptr) {}
+    };
+
+    const Clock::duration resolution;
+    const Clock::time_point start;
+    TimingWheel wheel;
+
+    Task stub;
+    MpscQueue<Task, &Task::link> incoming;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> pending;
+    std::atomic<uint64_t> fired;
+    std::atomic<Clock::rep> totalLag;
+    std::atomic<Clock::rep> maxLag;
+    std::thread thread;
+
+    uint64_t tickAt(Clock::time_point time) const;
+    void run();
+
+public:
+    explicit Scheduler(Clock::duration tickResolution = std::chrono::milliseconds(10));
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Runs fn on the timer thread once delay has passed, rounded up to the
+    // tick resolution. Callbacks still pending at shutdown are dropped.
+    void schedule(Clock::duration delay, std::function<void()> fn);
+
+    // Stops the timer thread; later schedule() calls are accepted but never
+    // run. Lets owners shut down whatever the callbacks feed before the
+    // scheduler itself goes away.
+    void stop();
+
+    size_t getPendingCount() const;
+    LagStats getLagStats() const;
+};
+
+#endif // SCHEDULER_H
@@ -2,6 +2,17 @@
 #include <cstring>
 #include <thread>
 #include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -13,6 +24,8 @@
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <csignal>
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
@@ -20,92 +33,388 @@
 #endif
 
 #include "card_game.h"
+#include "ai_personality.h"
+#include "client_session.h"
+#include "command_parser.h"
+#include "event_loop.h"
+#ifdef __linux__
+    #include <sys/eventfd.h>
+#endif
+#include "ring_buffer.h"
+#include "slab_pool.h"
+#include "wire_protocol.h"
 
-const int PORT = 8080;
+const int DEFAULT_PORT = 8080;
+const size_t MAX_COMMAND_LENGTH = 4096;
 GameServer gameServer;
 
+struct ServerOptions {
+    int port = DEFAULT_PORT;
+    bool legacyThreads = false;
+    int loops = 0; // 0 = one event loop per hardware thread
+    RoomLifecycle lifecycle;
+    TurnTiming turnTiming;
+    AiSettings ai;
+    std::string personalityFile; // empty keeps the built-in personalities
+    JournalSettings journal;     // no directory, no journal
+    std::string snapshotFile;    // empty: no periodic snapshots
+    int snapshotInterval = 60;   // seconds; 0 = only on hand-off
+};
+
+// Set by a server handing over to this process (see handOff): its listening
+// sockets, and the snapshot its rooms are in
+const char* const LISTEN_FDS_ENV = "CARD_GAME_LISTEN_FDS";
+const char* const RESTORE_ENV = "CARD_GAME_RESTORE";
+char** serverArgv = nullptr;
+
+void sendReply(const Reply& reply, WireFormat format, const ReplySink& sink) {
+    auto encoded = std::make_shared<std::string>();
+    encodeReply(reply, format, *encoded);
+    sink(std::move(encoded));
+}
+
+// Runs fn(room, reply) on the room's worker and sends the reply from there.
+// If the room does not exist the notFound reply is sent immediately.
+template <typename Fn>
+void runInRoom(std::string_view roomId, WireFormat format, ReplySink sink, const Reply& notFound, Fn fn) {
+    bool queued = gameServer.submit(roomId, [format, sink, fn](GameRoom& room) {
+        Reply reply;
+        fn(room, reply);
+        sendReply(reply, format, sink);
+    });
+    if (!queued) {
+        sendReply(notFound, format, sink);
+    }
+}
+
+Reply failedReply(ReplyType type) {
+    Reply reply;
+    reply.type = type;
+    reply.success = false;
+    return reply;
+}
+
+using SessionPtr = std::shared_ptr<ClientSession>;
+
+void handleCreateRoom(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    Reply reply;
+    reply.type = ReplyType::ROOM_CREATED;
+    const AiPersonality* personality = nullptr;
+    if (!command.personality.empty()) {
+        personality = gameServer.findPersonality(command.personality);
+        if (!personality) {
+            auto encoded = std::make_shared<std::string>();
+            encodeError(ErrorCode::INVALID_ARGUMENTS, format, *encoded);
+            sink(std::move(encoded));
+            return;
+        }
+    }
+    reply.seed = command.seeded ? command.seed : GameRandom::freshSeed();
+    reply.roomId = gameServer.createRoom(personality ? 2 : 4, reply.seed, personality);
+    sendReply(reply, format, sink);
+}
+
+void handleJoinRoom(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    runInRoom(command.roomId, format, std::move(sink), failedReply(ReplyType::JOIN_RESULT),
+        [playerId = std::string(command.playerId), playerName = std::string(command.playerName)](GameRoom& room, Reply& reply) {
+            reply.type = ReplyType::JOIN_RESULT;
+            reply.success = room.addPlayer(playerId, playerName);
+        });
+}
+
+void handleStartGame(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    runInRoom(command.roomId, format, std::move(sink), failedReply(ReplyType::GAME_STARTED),
+        [](GameRoom& room, Reply& reply) {
+            reply.type = ReplyType::GAME_STARTED;
+            reply.success = GameServer::startAndDeal(room);
+        });
+}
+
+void handlePlayCard(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    std::string playerId(command.playerId);
+    int cardIndex = command.cardIndex;
+    runInRoom(command.roomId, format, std::move(sink), failedReply(ReplyType::CARD_PLAYED),
+        [playerId, cardIndex](GameRoom& room, Reply& reply) {
+            reply.type = ReplyType::CARD_PLAYED;
+            reply.success = room.chooseCard(playerId, cardIndex);
+        });
+}
+
+void handleGetState(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    Reply notFound;
+    notFound.type = ReplyType::ERROR;
+    notFound.error = ErrorCode::ROOM_NOT_FOUND;
+    bool queued = gameServer.submit(command.roomId, [format, sink](GameRoom& room) {
+        // An unchanged room hands out the same encoded buffer every time
+        sink(room.getStateReply(format));
+    });
+    if (!queued) {
+        sendReply(notFound, format, sink);
+    }
+}
+
+// Replies, then registers the session with the room, which follows the
+// reply with a snapshot and pushes every update from then on
+template <typename Fn>
+void startPushes(std::string_view roomId, const SessionPtr& session, ReplySink sink, ReplyType type, Fn attach) {
+    WireFormat format = session->getFormat();
+    bool queued = gameServer.submit(roomId, [session, format, sink, type, attach](GameRoom& room) {
+        Reply reply;
+        reply.type = type;
+        reply.success = true;
+        sendReply(reply, format, sink);
+        attach(room, session);
+    });
+    if (!queued) {
+        sendReply(failedReply(type), format, sink);
+    }
+}
+
+void handleSubscribe(const Command& command, const SessionPtr& session, ReplySink sink) {
+    startPushes(command.roomId, session, std::move(sink), ReplyType::SUBSCRIBED,
+        [](GameRoom& room, const SessionPtr& subscriber) { room.subscribe(subscriber); });
+}
+
+void handleSpectate(const Command& command, const SessionPtr& session, ReplySink sink) {
+    startPushes(command.roomId, session, std::move(sink), ReplyType::SPECTATING,
+        [](GameRoom& room, const SessionPtr& spectator) { room.addSpectator(spectator); });
+}
+
+void handleStats(const Command&, const SessionPtr& session, ReplySink sink) {
+    Reply reply;
+    reply.type = ReplyType::STATS;
+    reply.stats.liveRooms = gameServer.getRoomCount();
+    reply.stats.createdRooms = gameServer.getCreatedRoomCount();
+    reply.stats.evictedRooms = gameServer.getEvictedRoomCount();
+    reply.stats.timedOutTurns = gameServer.getTimedOutTurnCount();
+    
+    using std::chrono::microseconds;
+    Scheduler::LagStats lag = gameServer.getTimerLag();
+    reply.stats.timersFired = lag.fired;
+    if (lag.fired > 0) {
+        reply.stats.timerLagAvgUs = std::chrono::duration_cast<microseconds>(lag.total).count() / lag.fired;
+    }
+    reply.stats.timerLagMaxUs = std::chrono::duration_cast<microseconds>(lag.max).count();
+
+    SlabPool::Stats pool = SlabPool::getStats();
+    reply.stats.poolSlabs = pool.slabs;
+    reply.stats.poolBlocksInUse = pool.blocksInUse;
+    reply.stats.poolBlocksFree = pool.blocksFree;
+    sendReply(reply, session->getFormat(), sink);
+}
+
+void handleHint(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    std::string playerId(command.playerId);
+    bool queued = gameServer.submit(command.roomId, [format, sink, playerId](GameRoom& room) {
+        // Answered from the search thread once the hint is worked out
+        gameServer.requestHint(room, playerId, [format, sink](const AiChoice& choice) {
+            Reply reply;
+            reply.type = ReplyType::HINT;
+            reply.success = choice.cardIndex >= 0;
+            reply.hint = choice;
+            sendReply(reply, format, sink);
+        });
+    });
+    if (!queued) {
+        sendReply(failedReply(ReplyType::HINT), format, sink);
+    }
+}
+
+void handleQuickMatch(const Command& command, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    gameServer.quickMatch(command.playerId, command.playerName, [format, sink](const std::string& roomId) {
+        Reply reply;
+        reply.type = ReplyType::MATCHED;
+        reply.success = !roomId.empty();
+        reply.roomId = roomId;
+        sendReply(reply, format, sink);
+    });
+}
+
+void handleListRooms(const Command& command, const SessionPtr& session, ReplySink sink) {
+    Reply reply;
+    reply.type = ReplyType::ROOM_LIST;
+    reply.lobby = gameServer.getOpenRooms();
+    size_t limit = command.limit == 0 ? DEFAULT_ROOM_LIST_LIMIT : std::min(command.limit, MAX_ROOM_LIST_LIMIT);
+    reply.offset = std::min<size_t>(command.offset, reply.lobby->size());
+    reply.count = std::min(limit, reply.lobby->size() - reply.offset);
+    sendReply(reply, session->getFormat(), sink);
+}
+
+using CommandHandler = void (*)(const Command&, const SessionPtr&, ReplySink);
+
+// Indexed by CommandType; shared by the text and binary protocols. Handlers
+// must copy anything they need from the command before returning, since the
+// frame it points into is reused as soon as they do.
+const CommandHandler COMMAND_HANDLERS[COMMAND_TYPE_COUNT] = {
+    handleCreateRoom,
+    handleJoinRoom,
+    handleStartGame,
+    handlePlayCard,
+    handleGetState,
+    handleSubscribe,
+    handleSpectate,
+    handleStats,
+    handleHint,
+    handleQuickMatch,
+    handleListRooms,
+};
+
+void handleRequest(std::string_view frame, const SessionPtr& session, ReplySink sink) {
+    WireFormat format = session->getFormat();
+    Command command;
+    ParseStatus status = format == WireFormat::TEXT ? parseCommand(frame, command)
+                                                    : parseBinaryCommand(frame, command);
+    switch (status) {
+        case ParseStatus::OK:
+            COMMAND_HANDLERS[static_cast<size_t>(command.type)](command, session, std::move(sink));
+            break;
+        case ParseStatus::INVALID_ARGUMENTS: {
+            auto encoded = std::make_shared<std::string>();
+            encodeError(ErrorCode::INVALID_ARGUMENTS, format, *encoded);
+            sink(std::move(encoded));
+            break;
+        }
+        case ParseStatus::UNKNOWN_COMMAND: {
+            auto encoded = std::make_shared<std::string>();
+            encodeError(ErrorCode::UNKNOWN_COMMAND, format, *encoded);
+            sink(std::move(encoded));
+            break;
+        }
+    }
+}
+
+bool sendAll(SOCKET clientSocket, const char* data, size_t length) {
+    while (length > 0) {
+        int sent = send(clientSocket, data, static_cast<int>(length), 0);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Session for a thread-per-connection client. Pushes are sent straight
+// from the room worker, so all sends on the socket take the mutex.
+class SocketSession : public ClientSession {
+private:
+    SOCKET socket;
+    WireFormat format;
+    std::mutex sendMutex;
+    bool open;
+
+public:
+    SocketSession(SOCKET clientSocket, WireFormat wireFormat)
+        : socket(clientSocket), format(wireFormat), open(true) {}
+
+    WireFormat getFormat() const override {
+        return format;
+    }
+
+    bool send(const std::string& data) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (open && !sendAll(socket, data.data(), data.size())) {
+            open = false;
+        }
+        return open;
+    }
+
+    bool push(SharedBuffer message, const void*) override {
+        return send(*message);
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        open = false;
+    }
+};
+
 void handleClient(SOCKET clientSocket) {
-    char buffer[4096];
+    RingBuffer input(MAX_COMMAND_LENGTH);
+    std::string frameScratch;
+    std::string output;
+    std::shared_ptr<SocketSession> session;
     
     while (true) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        RingBuffer::Region regions[2];
+        if (input.writableRegions(regions) == 0) {
+            break;
+        }
         
+        int bytesReceived = recv(clientSocket, regions[0].data, static_cast<int>(regions[0].length), 0);
         if (bytesReceived <= 0) {
             std::cout << "Client disconnected" << std::endl;
             break;
         }
+        input.commit(bytesReceived);
+        output.clear();
         
-        std::string request(buffer);
-        std::string response;
-        
-        // Simple command parsing
-        if (request.find("CREATE_ROOM") == 0) {
-            std::string roomId = gameServer.createRoom(4);
-            response = "{\"type\":\"ROOM_CREATED\",\"roomId\":\"" + roomId + "\"}";
-        }
-        else if (request.find("JOIN_ROOM") == 0) {
-            // Expected format: JOIN_ROOM roomId playerId playerName
-            size_t pos1 = request.find(' ');
-            size_t pos2 = request.find(' ', pos1 + 1);
-            size_t pos3 = request.find(' ', pos2 + 1);
-            
-            if (pos1 != std::string::npos && pos2 != std::string::npos && pos3 != std::string::npos) {
-                std::string roomId = request.substr(pos1 + 1, pos2 - pos1 - 1);
-                std::string playerId = request.substr(pos2 + 1, pos3 - pos2 - 1);
-                std::string playerName = request.substr(pos3 + 1);
-                
-                bool success = gameServer.joinRoom(roomId, playerId, playerName);
-                response = "{\"type\":\"JOIN_RESULT\",\"success\":" + std::string(success ? "true" : "false") + "}";
+        if (!session) {
+            WireFormat format = WireFormat::TEXT;
+            if (input.at(0) == BINARY_HANDSHAKE) {
+                input.consume(1);
+                format = WireFormat::BINARY;
+                output.push_back(static_cast<char>(BINARY_HANDSHAKE));
+                output.push_back(static_cast<char>(BINARY_PROTOCOL_VERSION));
             }
+            session = std::make_shared<SocketSession>(clientSocket, format);
         }
-        else if (request.find("START_GAME") == 0) {
-            size_t pos = request.find(' ');
-            if (pos != std::string::npos) {
-                std::string roomId = request.substr(pos + 1);
-                bool success = gameServer.startGame(roomId);
-                response = "{\"type\":\"GAME_STARTED\",\"success\":" + std::string(success ? "true" : "false") + "}";
+        
+        // Answer every complete command in this read with one send
+        bool oversized = false;
+        std::string_view frame;
+        size_t consumed = 0;
+        FrameStatus status;
+        while ((status = nextFrame(input, session->getFormat(), frameScratch, frame, consumed)) != FrameStatus::INCOMPLETE) {
+            if (status == FrameStatus::OVERSIZED) {
+                encodeError(ErrorCode::COMMAND_TOO_LONG, session->getFormat(), output);
+                oversized = true;
+                break;
             }
-        }
-        else if (request.find("PLAY_CARD") == 0) {
-            // Expected format: PLAY_CARD roomId playerId cardIndex
-            size_t pos1 = request.find(' ');
-            size_t pos2 = request.find(' ', pos1 + 1);
-            size_t pos3 = request.find(' ', pos2 + 1);
-            
-            if (pos1 != std::string::npos && pos2 != std::string::npos && pos3 != std::string::npos) {
-                std::string roomId = request.substr(pos1 + 1, pos2 - pos1 - 1);
-                std::string playerId = request.substr(pos2 + 1, pos3 - pos2 - 1);
-                int cardIndex = std::stoi(request.substr(pos3 + 1));
-                
-                bool success = gameServer.playCard(roomId, playerId, cardIndex);
-                response = "{\"type\":\"CARD_PLAYED\",\"success\":" + std::string(success ? "true" : "false") + "}";
+            if (!frame.empty()) {
+                // This thread serves one client, so just wait for the room worker
+                auto reply = std::make_shared<std::promise<SharedBuffer>>();
+                std::future<SharedBuffer> ready = reply->get_future();
+                handleRequest(frame, session, [reply](SharedBuffer encoded) {
+                    reply->set_value(std::move(encoded));
+                });
+                output += *ready.get();
             }
+            input.consume(consumed);
         }
-        else if (request.find("GET_STATE") == 0) {
-            size_t pos = request.find(' ');
-            if (pos != std::string::npos) {
-                std::string roomId = request.substr(pos + 1);
-                response = gameServer.getRoomState(roomId);
-            }
+        
+        if (!output.empty() && !session->send(output)) {
+            break;
         }
-        else {
-            response = "{\"type\":\"ERROR\",\"message\":\"Unknown command\"}";
+        if (oversized) {
+            break;
         }
-        
-        send(clientSocket, response.c_str(), response.length(), 0);
     }
     
+    if (session) {
+        session->close();
+    }
     closesocket(clientSocket);
 }
 
-int main() {
+int runThreadPerConnection(int port) {
 #ifdef _WIN32
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         std::cerr << "WSAStartup failed" << std::endl;
         return 1;
     }
+#else
+    // Pushes can reach a client that has just gone away; let the send fail
+    signal(SIGPIPE, SIG_IGN);
 #endif
 
     SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -119,7 +428,7 @@ int main() {
     
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(PORT);
+    serverAddr.sin_port = htons(port);
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     
     if (bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
@@ -140,7 +449,7 @@ int main() {
         return 1;
     }
     
-    std::cout << "Card Game Server running on port " << PORT << std::endl;
+    std::cout << "Card Game Server running on port " << port << " (thread per connection)" << std::endl;
     
     while (true) {
         sockaddr_in clientAddr;
@@ -163,3 +472,239 @@ int main() {
     
     return 0;
 }
+
+#ifdef __linux__
+// Written to by the SIGUSR2 handler; the hand-off thread waits on it
+int handOffFd = -1;
+
+void requestHandOff(int) {
+    uint64_t one = 1;
+    if (write(handOffFd, &one, sizeof(one)) < 0) {
+        // Already requested
+    }
+}
+
+// The listening sockets a previous server process handed over, if any
+std::vector<int> inheritedListenFds() {
+    std::vector<int> fds;
+    const char* list = std::getenv(LISTEN_FDS_ENV);
+    if (!list) {
+        return fds;
+    }
+    for (const char* p = list; *p;) {
+        char* end = nullptr;
+        long fd = std::strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        fds.push_back(static_cast<int>(fd));
+        p = *end == ',' ? end + 1 : end;
+    }
+    unsetenv(LISTEN_FDS_ENV);
+    return fds;
+}
+
+// Warm restart: stops taking connections, snapshots every room, then execs
+// the server binary (a new build, on a deploy) with the same arguments and
+// the listening sockets left open. The new process restores the rooms
+// before it accepts anyone, so clients reconnect to the games they left;
+// connections made meanwhile wait in the sockets' backlog. If anything
+// fails before the exec this process goes back to serving.
+void handOff(const std::vector<std::unique_ptr<EventLoop>>& loops, const ServerOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& loop : loops) {
+        loop->closeForHandOff();
+    }
+    std::string path = options.snapshotFile.empty()
+        ? "/tmp/card_game_server." + std::to_string(getpid()) + ".snapshot"
+        : options.snapshotFile;
+    std::string error;
+    bool ok = gameServer.writeSnapshot(path, error);
+    if (ok) {
+        if (auto journal = gameServer.getJournal()) {
+            journal->sync();
+        }
+        std::string fds;
+        for (const auto& loop : loops) {
+            fcntl(loop->getListenFd(), F_SETFD, 0);
+            fds += (fds.empty() ? "" : ",") + std::to_string(loop->getListenFd());
+        }
+        setenv(LISTEN_FDS_ENV, fds.c_str(), 1);
+        setenv(RESTORE_ENV, path.c_str(), 1);
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Handing " << gameServer.getRoomCount() << " rooms over to a new " << serverArgv[0] << " ("
+                  << elapsed.count() << " ms to snapshot)" << std::endl;
+        execvp(serverArgv[0], serverArgv);
+        error = std::string("cannot exec ") + serverArgv[0] + ": " + std::strerror(errno);
+        unsetenv(LISTEN_FDS_ENV);
+        unsetenv(RESTORE_ENV);
+        for (const auto& loop : loops) {
+            fcntl(loop->getListenFd(), F_SETFD, FD_CLOEXEC);
+        }
+    }
+    std::cerr << "Hand-off failed, still serving: " << error << std::endl;
+    for (const auto& loop : loops) {
+        loop->resumeAccepting();
+    }
+}
+
+int runEventLoops(const ServerOptions& options) {
+    std::vector<int> inherited = inheritedListenFds();
+    int loopCount = options.loops;
+    if (!inherited.empty()) {
+        loopCount = static_cast<int>(inherited.size());
+    } else if (loopCount <= 0) {
+        loopCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (int i = 0; i < loopCount; i++) {
+        auto loop = std::make_unique<EventLoop>(options.port, handleRequest);
+        if (!loop->open(inherited.empty() ? -1 : inherited[i])) {
+            return 1;
+        }
+        loops.push_back(std::move(loop));
+    }
+    
+    std::cout << "Card Game Server running on port " << options.port
+              << " (" << loopCount << " epoll event loops" << (inherited.empty() ? "" : ", handed over") << ")"
+              << std::endl;
+    
+    handOffFd = eventfd(0, EFD_CLOEXEC);
+    struct sigaction action{};
+    action.sa_handler = requestHandOff;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+    std::thread([&loops, &options] {
+        uint64_t requests;
+        while (read(handOffFd, &requests, sizeof(requests)) > 0) {
+            handOff(loops, options);
+        }
+    }).detach();
+    
+    std::vector<std::thread> threads;
+    for (int i = 1; i < loopCount; i++) {
+        threads.emplace_back(&EventLoop::run, loops[i].get());
+    }
+    loops[0]->run();
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return 0;
+}
+#endif
+
+ServerOptions parseOptions(int argc, char* argv[]) {
+    ServerOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--legacy") {
+            options.legacyThreads = true;
+        } else if (arg == "--port" && i + 1 < argc) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--loops" && i + 1 < argc) {
+            options.loops = std::atoi(argv[++i]);
+        } else if (arg == "--idle-ttl" && i + 1 < argc) {
+            options.lifecycle.idleTtl = std::chrono::seconds(std::atoi(argv[++i]));
+        } else if (arg == "--finished-ttl" && i + 1 < argc) {
+            options.lifecycle.finishedTtl = std::chrono::seconds(std::atoi(argv[++i]));
+        } else if (arg == "--ai-delay" && i + 1 < argc) {
+            options.turnTiming.aiThinkDelay = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--turn-timeout" && i + 1 < argc) {
+            options.turnTiming.turnTimeout = std::chrono::seconds(std::atoi(argv[++i]));
+        } else if (arg == "--ai-rollouts" && i + 1 < argc) {
+            options.ai.rollouts = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--ai-budget" && i + 1 < argc) {
+            options.ai.budget = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--ai-threads" && i + 1 < argc) {
+            options.ai.threads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--match-wait" && i + 1 < argc) {
+            options.turnTiming.quickMatchWait = std::chrono::seconds(std::atoi(argv[++i]));
+        } else if (arg == "--ai-hard") {
+            options.ai.endgameRounds = AiSettings::HARD_ENDGAME_ROUNDS;
+        } else if (arg == "--ai-personalities" && i + 1 < argc) {
+            options.personalityFile = argv[++i];
+        } else if (arg == "--journal" && i + 1 < argc) {
+            options.journal.directory = argv[++i];
+        } else if (arg == "--journal-segment-mb" && i + 1 < argc) {
+            options.journal.segmentSize = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--journal-flush-ms" && i + 1 < argc) {
+            options.journal.flushInterval = std::chrono::milliseconds(std::atoi(argv[++i]));
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            options.snapshotFile = argv[++i];
+        } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+            options.snapshotInterval = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: card_game_server [--port N] [--loops N] [--idle-ttl SEC] [--finished-ttl SEC]"
+                      << " [--ai-delay MS] [--turn-timeout SEC] [--match-wait SEC] [--ai-rollouts N] [--ai-budget MS] [--ai-threads N]"
+                      << " [--ai-hard] [--ai-personalities FILE] [--journal DIR] [--journal-segment-mb N]"
+                      << " [--journal-flush-ms MS] [--snapshot FILE] [--snapshot-interval SEC] [--legacy]" << std::endl;
+        }
+    }
+    return options;
+}
+
+// Brings back the rooms of the server that handed over to this one, or else
+// of the last periodic snapshot. A snapshot that can't be restored brings
+// back no rooms at all; it is moved aside rather than deleted, or written
+// over by the next periodic snapshot, so it can be looked at or retried.
+void restoreRooms(const ServerOptions& options) {
+    const char* handedOver = std::getenv(RESTORE_ENV);
+    std::string path = handedOver ? handedOver : options.snapshotFile;
+    unsetenv(RESTORE_ENV);
+    if (path.empty() || (!handedOver && !std::ifstream(path))) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t restored = 0;
+    std::string error;
+    if (!gameServer.restoreSnapshot(path, restored, error)) {
+        std::string aside = path + ".rejected";
+        bool moved = std::rename(path.c_str(), aside.c_str()) == 0;
+        std::cerr << "No rooms restored: " << error << "; the snapshot is kept in " << (moved ? aside : path)
+                  << std::endl;
+        return;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::cout << "Restored " << restored << " rooms from " << path << " in " << elapsed.count() << " ms" << std::endl;
+    if (handedOver && path != options.snapshotFile) {
+        std::remove(path.c_str());
+    }
+}
+
+int main(int argc, char* argv[]) {
+    serverArgv = argv;
+    ServerOptions options = parseOptions(argc, argv);
+    gameServer.setLifecycle(options.lifecycle);
+    gameServer.setTurnTiming(options.turnTiming);
+    gameServer.setAiSettings(options.ai);
+    if (!options.personalityFile.empty()) {
+        PersonalityTable personalities;
+        std::string error;
+        if (!personalities.load(options.personalityFile, error)) {
+            std::cerr << "Cannot load AI personalities: " << error << std::endl;
+            return 1;
+        }
+        gameServer.setPersonalities(personalities);
+    }
+    if (!options.journal.directory.empty()) {
+        std::string error;
+        if (!gameServer.openJournal(options.journal, error)) {
+            std::cerr << "Cannot open the journal: " << error << std::endl;
+            return 1;
+        }
+    }
+    restoreRooms(options);
+    if (!options.snapshotFile.empty() && options.snapshotInterval > 0) {
+        gameServer.startSnapshots(options.snapshotFile, std::chrono::seconds(options.snapshotInterval));
+    }
+    
+#ifdef __linux__
+    if (!options.legacyThreads) {
+        return runEventLoops(options);
+    }
+#endif
+    return runThreadPerConnection(options.port);
+}
@@ -0,0 +1,427 @@
+// Headless match simulator for balance testing. Plays two-player games with
+// the real GameRoom rules on every core and prints aggregate statistics.
+//
+// Usage: card_game_sim [--games N] [--threads N] [--seed N]
+//                      [--seat1 POLICY] [--seat2 POLICY] [--rollouts N] [--batch]
+//   POLICY: random (default), first, strongest, weakest, search, hard, or
+//           a built-in AI personality key such as EMBER or NEXUS
+//   --rollouts: rollouts per move for the search and hard policies (default 512)
+//   --batch: play each work batch's games side by side in a BatchEngine
+//            instead of one GameRoom at a time
+//
+// Game g is played with room seed (seed + g), so a run is reproducible
+// whatever the thread count, and --batch prints the same results.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "card_game.h"
+#include "game_random.h"
+#include "batch_engine.h"
+#include "ai_search.h"
+#include "ai_personality.h"
+
+namespace {
+
+enum class Policy : uint8_t {
+    RANDOM,
+    FIRST,
+    STRONGEST,
+    WEAKEST,
+    SEARCH,
+    HARD,
+    PERSONALITY
+};
+
+const char* const POLICY_NAMES[] = { "random", "first", "strongest", "weakest", "search", "hard" };
+
+const PersonalityTable PERSONALITIES = PersonalityTable::builtin();
+
+bool parsePolicy(const std::string& name, Policy& policy, const AiPersonality*& personality) {
+    for (size_t i = 0; i < sizeof(POLICY_NAMES) / sizeof(POLICY_NAMES[0]); i++) {
+        if (name == POLICY_NAMES[i]) {
+            policy = static_cast<Policy>(i);
+            return true;
+        }
+    }
+    personality = PERSONALITIES.find(name);
+    policy = Policy::PERSONALITY;
+    return personality != nullptr;
+}
+
+struct SimOptions {
+    uint64_t games = 1000000;
+    size_t threads = 0; // 0 = one per hardware thread
+    uint64_t seed = 1;
+    Policy seats[2] = { Policy::RANDOM, Policy::RANDOM };
+    const AiPersonality* personalities[2] = {}; // for PERSONALITY seats
+    size_t rollouts = 512;
+    bool batch = false;
+};
+
+struct SimStats {
+    uint64_t games = 0;
+    uint64_t wins[2] = {};
+    uint64_t ties = 0;
+    uint64_t stalled = 0; // a hand ran out before round 5
+    uint64_t rounds = 0;
+    uint64_t marginTotal = 0;
+    uint64_t powerCards[2] = {};
+    uint64_t doublePlays[2] = {};
+
+    void merge(const SimStats& other) {
+        games += other.games;
+        ties += other.ties;
+        stalled += other.stalled;
+        rounds += other.rounds;
+        marginTotal += other.marginTotal;
+        for (int seat = 0; seat < 2; seat++) {
+            wins[seat] += other.wins[seat];
+            powerCards[seat] += other.powerCards[seat];
+            doublePlays[seat] += other.doublePlays[seat];
+        }
+    }
+};
+
+int totalStrength(const Player::CardList& cards) {
+    int total = 0;
+    for (const auto& card : cards) total += card.getStrength();
+    return total;
+}
+
+int powerCount(const Player::CardList& cards) {
+    int count = 0;
+    for (const auto& card : cards) count += card.getElement() == Element::POWER ? 1 : 0;
+    return count;
+}
+
+int pickCard(Policy policy, const Player::CardList& hand, GameRandom& random) {
+    int best = 0;
+    switch (policy) {
+        case Policy::RANDOM:
+            return static_cast<int>(random.below(static_cast<uint32_t>(hand.size())));
+        case Policy::FIRST:
+            return 0;
+        case Policy::SEARCH:
+        case Policy::HARD:
+        case Policy::PERSONALITY:
+            break; // needs the room; see playGame
+        case Policy::STRONGEST:
+        case Policy::WEAKEST:
+            for (size_t i = 1; i < hand.size(); i++) {
+                bool stronger = hand[i].getStrength() > hand[best].getStrength();
+                bool weaker = hand[i].getStrength() < hand[best].getStrength();
+                if (policy == Policy::STRONGEST ? stronger : weaker) best = static_cast<int>(i);
+            }
+            return best;
+    }
+    return 0;
+}
+
+// One game: seat 0 is the human who joins, seat 1 the AI the room adds for
+// them. Card strengths played each round are read off the hands, since a
+// resolved round clears the played cards.
+void playGame(uint64_t seed, const SimOptions& options, SimStats& stats) {
+    GameRoom room("room_sim", 2, seed);
+    room.addPlayer("seat_1", "Seat 1");
+    GameServer::startAndDeal(room);
+    Player* seats[2] = { room.getPlayer("seat_1"), room.getPlayer("ai_player") };
+    GameRandom policyRandom(~seed);
+
+    int roundStrength[2] = {};
+    int movesThisRound = 0;
+    stats.games++;
+    while (!room.isGameOver()) {
+        int seat = room.getCurrentPlayer() == seats[0] ? 0 : 1;
+        Player& player = *seats[seat];
+        Player::CardList before = player.getHand();
+        if (before.empty()) {
+            stats.stalled++;
+            return;
+        }
+
+        int choice = pickCard(options.seats[seat], before, policyRandom);
+        if (options.seats[seat] == Policy::SEARCH || options.seats[seat] == Policy::HARD) {
+            // No time limit, so the result doesn't depend on machine load
+            AiSettings settings;
+            settings.rollouts = options.rollouts;
+            settings.budget = std::chrono::steady_clock::duration::zero();
+            if (options.seats[seat] == Policy::HARD) {
+                settings.endgameRounds = AiSettings::HARD_ENDGAME_ROUNDS;
+            }
+            SearchPosition position;
+            makeSearchPosition(room, position);
+            choice = AiSearch::searchNow(position, settings, policyRandom.next()).cardIndex;
+        } else if (options.seats[seat] == Policy::PERSONALITY) {
+            PersonalityContext context = makePersonalityContext(room, player);
+            choice = options.personalities[seat]->chooseCard(before, context, policyRandom);
+        }
+        room.chooseCard(player.getId(), choice);
+
+        // The chosen card, plus a second POWER card if the rule fired
+        const Player::CardList& after = player.getHand();
+        roundStrength[seat] += totalStrength(before) - totalStrength(after);
+        stats.powerCards[seat] += powerCount(before) - powerCount(after);
+        stats.doublePlays[seat] += before.size() - after.size() > 1 ? 1 : 0;
+
+        if (++movesThisRound == 2) {
+            stats.rounds++;
+            stats.marginTotal += std::abs(roundStrength[0] - roundStrength[1]);
+            roundStrength[0] = roundStrength[1] = 0;
+            movesThisRound = 0;
+        }
+    }
+
+    auto winner = room.getWinner();
+    if (!winner) {
+        stats.ties++;
+    } else {
+        stats.wins[winner == seats[0] ? 0 : 1]++;
+    }
+}
+
+// The same games as playGame for seeds [firstSeed, firstSeed + count),
+// played a round at a time across the whole batch
+void playBatch(uint64_t firstSeed, size_t count, const SimOptions& options, SimStats& stats) {
+    BatchEngine engine(count);
+    std::vector<GameRandom> policyRandom;
+    policyRandom.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        engine.deal(i, firstSeed + i);
+        policyRandom.emplace_back(~(firstSeed + i));
+    }
+    std::vector<bool> stalled(count, false);
+    stats.games += count;
+
+    for (int round = 0; round < GameRoom::ROUNDS_PER_GAME; round++) {
+        for (int seat = 0; seat < 2; seat++) {
+            for (size_t i = 0; i < count; i++) {
+                if (stalled[i]) continue;
+                Player::CardList hand;
+                for (size_t c = 0; c < engine.getHandSize(i, seat); c++) {
+                    hand.push_back(engine.getCard(i, seat, c));
+                }
+                if (hand.empty()) {
+                    stalled[i] = true;
+                    stats.stalled++;
+                    continue;
+                }
+
+                int choice = pickCard(options.seats[seat], hand, policyRandom[i]);
+                engine.play(i, seat, choice);
+                // A second card only ever follows a POWER card, and is one
+                bool doublePlay = hand.size() - engine.getHandSize(i, seat) > 1;
+                stats.powerCards[seat] += hand[choice].getElement() == Element::POWER ? (doublePlay ? 2 : 1) : 0;
+                stats.doublePlays[seat] += doublePlay ? 1 : 0;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (stalled[i]) continue;
+            stats.rounds++;
+            stats.marginTotal += std::abs(engine.getPlayedStrength(i, 0) - engine.getPlayedStrength(i, 1));
+        }
+        engine.resolve();
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (stalled[i]) continue;
+        int first = engine.getScore(i, 0), second = engine.getScore(i, 1);
+        if (first == second) {
+            stats.ties++;
+        } else {
+            stats.wins[first > second ? 0 : 1]++;
+        }
+    }
+}
+
+// Runs fn(begin, end, thread) over [0, total) in batches. Each thread owns
+// a deque of batches and works from its back; once that is empty it steals
+// from the front of the others', so threads that finish early take over
+// work from slower ones instead of idling.
+class WorkStealingPool {
+private:
+    struct Batch {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Batch> batches;
+    };
+
+    std::vector<Queue> queues;
+
+    bool popOwn(size_t self, Batch& batch) {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        if (queues[self].batches.empty()) return false;
+        batch = queues[self].batches.back();
+        queues[self].batches.pop_back();
+        return true;
+    }
+
+    bool steal(size_t self, Batch& batch) {
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.batches.empty()) {
+                batch = victim.batches.front();
+                victim.batches.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    static const uint64_t BATCH_SIZE = 4096;
+
+    explicit WorkStealingPool(size_t threads) : queues(threads) {}
+
+    template <typename Fn>
+    void run(uint64_t total, Fn&& fn) {
+        // Deal batches round-robin so every thread starts with local work
+        size_t owner = 0;
+        for (uint64_t begin = 0; begin < total; begin += BATCH_SIZE) {
+            queues[owner].batches.push_back({ begin, std::min(total, begin + BATCH_SIZE) });
+            owner = (owner + 1) % queues.size();
+        }
+
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < queues.size(); t++) {
+            threads.emplace_back([this, t, &fn] {
+                Batch batch;
+                while (popOwn(t, batch) || steal(t, batch)) {
+                    fn(batch.begin, batch.end, t);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
+
+void printUsage() {
+    std::cerr << "Usage: card_game_sim [--games N] [--threads N] [--seed N] [--seat1 POLICY] [--seat2 POLICY]"
+              << " [--rollouts N] [--batch]" << std::endl;
+    std::cerr << "  POLICY: random, first, strongest, weakest, search, hard, or a personality:";
+    for (const auto& personality : PERSONALITIES.all()) {
+        std::cerr << " " << personality.getKey();
+    }
+    std::cerr << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], SimOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--games" && i + 1 < argc) {
+            options.games = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if ((arg == "--seat1" || arg == "--seat2") && i + 1 < argc) {
+            int seat = arg == "--seat1" ? 0 : 1;
+            if (!parsePolicy(argv[++i], options.seats[seat], options.personalities[seat])) {
+                std::cerr << "Unknown policy: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--rollouts" && i + 1 < argc) {
+            options.rollouts = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    for (Policy seat : options.seats) {
+        if (options.batch && (seat == Policy::SEARCH || seat == Policy::HARD || seat == Policy::PERSONALITY)) {
+            std::cerr << "The search, hard and personality policies need whole rooms; drop --batch" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+void printStats(const SimStats& stats, const SimOptions& options, size_t threads, double seconds) {
+    uint64_t decided = stats.games - stats.stalled;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << stats.games << " games in " << seconds << " s (" << static_cast<uint64_t>(stats.games / seconds)
+              << " games/s on " << threads << " threads";
+    if (options.batch) {
+        std::cout << ", batched, " << BatchEngine::kernelName(BatchEngine::bestKernel()) << " kernel";
+    }
+    std::cout << ")" << std::endl;
+    for (int seat = 0; seat < 2; seat++) {
+        const char* policy = options.seats[seat] == Policy::PERSONALITY
+            ? options.personalities[seat]->getKey().c_str()
+            : POLICY_NAMES[static_cast<int>(options.seats[seat])];
+        std::cout << "seat " << seat + 1 << " (" << policy
+                  << "): wins " << percent(stats.wins[seat], decided) << "% of finished games, "
+                  << static_cast<double>(stats.powerCards[seat]) / stats.games << " POWER cards and "
+                  << static_cast<double>(stats.doublePlays[seat]) / stats.games << " double plays per game"
+                  << std::endl;
+    }
+    std::cout << "ties " << percent(stats.ties, decided) << "% of finished games" << std::endl;
+    std::cout << "stalled " << percent(stats.stalled, stats.games)
+              << "% of games (a hand ran out of cards before round 5)" << std::endl;
+    std::cout << "rounds per game " << static_cast<double>(stats.rounds) / stats.games
+              << ", average round margin " << (stats.rounds ? static_cast<double>(stats.marginTotal) / stats.rounds : 0.0)
+              << " strength" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    SimOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+    size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Each thread accumulates its own stats on its own cache lines
+    struct alignas(64) ThreadStats {
+        SimStats stats;
+    };
+    std::vector<ThreadStats> perThread(threads);
+    WorkStealingPool pool(threads);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(options.games, [&](uint64_t begin, uint64_t end, size_t thread) {
+        if (options.batch) {
+            playBatch(options.seed + begin, end - begin, options, perThread[thread].stats);
+            return;
+        }
+        for (uint64_t game = begin; game < end; game++) {
+            playGame(options.seed + game, options, perThread[thread].stats);
+        }
+    });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    SimStats total;
+    for (const auto& entry : perThread) {
+        total.merge(entry.stats);
+    }
+    printStats(total, options, threads, seconds);
+    return 0;
+}
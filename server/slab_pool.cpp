@@ -0,0 +1,169 @@
+#include "slab_pool.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const size_t CLASS_COUNT = SlabPool::MAX_BLOCK_SIZE / SlabPool::BLOCK_ALIGN;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ThreadPool;
+
+// One block size in one thread's pool
+struct alignas(64) SizeClass {
+    ThreadPool* pool = nullptr;
+    size_t blockSize = 0;
+    FreeBlock* local = nullptr; // only the owning thread touches this
+    std::atomic<FreeBlock*> returned{nullptr};
+    std::atomic<size_t> slabs{0};
+    std::atomic<size_t> inUse{0};
+
+    size_t blocksPerSlab() const;
+};
+
+// Starts every slab, padded to BLOCK_ALIGN; a block finds its slab, and so
+// its size class, by masking its address
+struct alignas(SlabPool::BLOCK_ALIGN) SlabHeader {
+    SizeClass* owner;
+};
+
+size_t SizeClass::blocksPerSlab() const {
+    return (SlabPool::SLAB_SIZE - sizeof(SlabHeader)) / blockSize;
+}
+
+struct ThreadPool {
+    SizeClass classes[CLASS_COUNT];
+    bool owned = false; // guarded by poolsMutex
+
+    ThreadPool() {
+        for (size_t i = 0; i < CLASS_COUNT; i++) {
+            classes[i].pool = this;
+            classes[i].blockSize = (i + 1) * SlabPool::BLOCK_ALIGN;
+        }
+    }
+};
+
+std::mutex poolsMutex;
+
+// Never destroyed: rooms can still be freed during static destruction
+std::vector<ThreadPool*>& allPools() {
+    static auto* pools = new std::vector<ThreadPool*>();
+    return *pools;
+}
+
+ThreadPool* adoptPool() {
+    std::lock_guard<std::mutex> lock(poolsMutex);
+    for (ThreadPool* pool : allPools()) {
+        if (!pool->owned) {
+            pool->owned = true;
+            return pool;
+        }
+    }
+    allPools().push_back(new ThreadPool());
+    allPools().back()->owned = true;
+    return allPools().back();
+}
+
+thread_local ThreadPool* currentPool = nullptr;
+thread_local bool threadExiting = false;
+
+// Hands the thread's pool back for adoption when the thread exits
+struct PoolLease {
+    ~PoolLease() {
+        std::lock_guard<std::mutex> lock(poolsMutex);
+        currentPool->owned = false;
+        currentPool = nullptr;
+        threadExiting = true;
+    }
+};
+
+ThreadPool* threadPool() {
+    if (currentPool) {
+        return currentPool;
+    }
+    currentPool = adoptPool();
+    if (!threadExiting) {
+        // A thread allocating during its own teardown keeps the pool it
+        // adopts, which is rare enough not to matter
+        static thread_local PoolLease lease;
+    }
+    return currentPool;
+}
+
+void carveSlab(SizeClass& sizeClass) {
+    char* slab = static_cast<char*>(::operator new(SlabPool::SLAB_SIZE, std::align_val_t(SlabPool::SLAB_SIZE)));
+    reinterpret_cast<SlabHeader*>(slab)->owner = &sizeClass;
+    char* first = slab + sizeof(SlabHeader);
+    size_t count = sizeClass.blocksPerSlab();
+    // Linked in address order, so the slab is handed out front to back
+    for (size_t i = count; i-- > 0;) {
+        auto* block = reinterpret_cast<FreeBlock*>(first + i * sizeClass.blockSize);
+        block->next = sizeClass.local;
+        sizeClass.local = block;
+    }
+    sizeClass.slabs.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void* SlabPool::allocate(size_t size) {
+    if (size > MAX_BLOCK_SIZE) {
+        return ::operator new(size);
+    }
+    SizeClass& sizeClass = threadPool()->classes[(size + BLOCK_ALIGN - 1) / BLOCK_ALIGN - 1];
+    if (!sizeClass.local) {
+        sizeClass.local = sizeClass.returned.exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!sizeClass.local) {
+        carveSlab(sizeClass);
+    }
+    FreeBlock* block = sizeClass.local;
+    sizeClass.local = block->next;
+    sizeClass.inUse.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+void SlabPool::deallocate(void* memory, size_t size) noexcept {
+    if (size > MAX_BLOCK_SIZE) {
+        ::operator delete(memory);
+        return;
+    }
+    auto address = reinterpret_cast<uintptr_t>(memory);
+    SizeClass* sizeClass = reinterpret_cast<SlabHeader*>(address & ~(uintptr_t(SLAB_SIZE) - 1))->owner;
+    sizeClass->inUse.fetch_sub(1, std::memory_order_relaxed);
+
+    auto* block = static_cast<FreeBlock*>(memory);
+    if (sizeClass->pool == currentPool) {
+        block->next = sizeClass->local;
+        sizeClass->local = block;
+        return;
+    }
+    // The owner takes the whole list at once, so pushes can't suffer ABA
+    FreeBlock* head = sizeClass->returned.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!sizeClass->returned.compare_exchange_weak(head, block, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+}
+
+SlabPool::Stats SlabPool::getStats() {
+    Stats stats;
+    std::lock_guard<std::mutex> lock(poolsMutex);
+    stats.pools = allPools().size();
+    for (const ThreadPool* pool : allPools()) {
+        for (const auto& sizeClass : pool->classes) {
+            size_t slabs = sizeClass.slabs.load(std::memory_order_relaxed);
+            size_t inUse = sizeClass.inUse.load(std::memory_order_relaxed);
+            size_t capacity = slabs * sizeClass.blocksPerSlab();
+            stats.slabs += slabs;
+            stats.blocksInUse += inUse;
+            stats.blocksFree += capacity > inUse ? capacity - inUse : 0;
+        }
+    }
+    stats.bytesReserved = stats.slabs * SLAB_SIZE;
+    return stats;
+}
@@ -0,0 +1,77 @@
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+// Fixed-size block allocator for objects that come and go all the time,
+// like rooms. Blocks are carved from 64 KiB slabs, one size class per 64
+// bytes of block size, so a thread's rooms sit side by side instead of
+// scattered across the heap. Each thread allocates from its own pool
+// without locks or atomics on the free list. A block freed on its pool's
+// thread goes straight back on that free list; one freed elsewhere (a room
+// created on a network thread and dropped by a room worker) is pushed onto
+// the pool's lock-free return list, which the owner takes over in one swap
+// when its own list runs dry.
+//
+// Slabs are never given back to the system: memory freed by evicted rooms
+// is reused by the next ones, so a server's footprint follows its peak
+// room count. A thread's pool outlives the thread and is adopted, with its
+// free blocks, by the next thread that needs one.
+class SlabPool {
+public:
+    static const size_t SLAB_SIZE = 64 * 1024;
+    static const size_t BLOCK_ALIGN = 64;
+    // Larger blocks come from the general heap
+    static const size_t MAX_BLOCK_SIZE = 4096;
+
+    struct Stats {
+        size_t pools = 0;          // threads' pools, owned or waiting for adoption
+        size_t slabs = 0;
+        size_t blocksInUse = 0;
+        size_t blocksFree = 0;     // carved and free, on any free list
+        size_t bytesReserved = 0;  // slabs times SLAB_SIZE
+    };
+
+    static void* allocate(size_t size);
+    static void deallocate(void* block, size_t size) noexcept;
+
+    // Totals over every pool; blocks freed on other threads may be counted
+    // a moment late
+    static Stats getStats();
+};
+
+// std allocator over SlabPool, for std::allocate_shared: the object and its
+// control block are one pooled block
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        if (count != 1) {
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+        return static_cast<T*>(SlabPool::allocate(sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t count) noexcept {
+        if (count != 1) {
+            ::operator delete(block);
+            return;
+        }
+        SlabPool::deallocate(block, sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+#endif // SLAB_POOL_H
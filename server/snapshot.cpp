@@ -0,0 +1,228 @@
+#include "snapshot.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+template <typename T>
+T load(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+template <typename T>
+void store(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Records are gathered into chunks about this big before each write
+const size_t WRITE_CHUNK = 1 << 20;
+
+} // namespace
+
+constexpr char SnapshotFile::MAGIC[9];
+
+SnapshotFile::~SnapshotFile() {
+    close();
+}
+
+#ifndef _WIN32
+
+bool SnapshotFile::write(const std::string& filePath, uint64_t createdRoomCount, const std::vector<SharedBuffer>& records,
+                         std::string& error) {
+    std::string temporary = filePath + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "cannot create " + temporary + ": " + std::strerror(errno);
+        return false;
+    }
+
+    std::string chunk;
+    chunk.reserve(WRITE_CHUNK + 4096);
+    chunk.append(MAGIC, 8);
+    store<uint64_t>(chunk, records.size());
+    store<uint64_t>(chunk, createdRoomCount);
+    bool ok = true;
+    auto flush = [&] {
+        size_t done = 0;
+        while (ok && done < chunk.size()) {
+            ssize_t n = ::write(fd, chunk.data() + done, chunk.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = n > 0;
+            done += ok ? static_cast<size_t>(n) : 0;
+        }
+        chunk.clear();
+    };
+    for (const auto& record : records) {
+        store<uint32_t>(chunk, static_cast<uint32_t>(record->size()));
+        chunk += *record;
+        if (chunk.size() >= WRITE_CHUNK) {
+            flush();
+        }
+    }
+    flush();
+    ok = ok && fsync(fd) == 0;
+    if (!ok) {
+        error = "cannot write " + temporary + ": " + std::strerror(errno);
+    }
+    ::close(fd);
+    if (ok && std::rename(temporary.c_str(), filePath.c_str()) != 0) {
+        error = "cannot rename " + temporary + " to " + filePath + ": " + std::strerror(errno);
+        ok = false;
+    }
+    if (!ok) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    // The rename itself only survives a machine crash once the directory is synced
+    auto directory = std::filesystem::path(filePath).parent_path();
+    int dirFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
+}
+
+bool SnapshotFile::open(const std::string& filePath, std::string& error) {
+    close();
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "cannot open " + filePath + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= HEADER_SIZE;
+    if (ok) {
+        size = static_cast<size_t>(info.st_size);
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ok = map != MAP_FAILED;
+        data = ok ? static_cast<const char*>(map) : nullptr;
+    }
+    ::close(fd);
+    if (ok) {
+        madvise(const_cast<char*>(data), size, MADV_SEQUENTIAL);
+    }
+    if (!ok || std::memcmp(data, MAGIC, 8) != 0) {
+        error = filePath + " is not a room snapshot";
+        close();
+        return false;
+    }
+    roomCount = load<uint64_t>(data + 8);
+    createdRooms = load<uint64_t>(data + 16);
+    return true;
+}
+
+void SnapshotFile::close() {
+    if (data && contents.empty()) {
+        munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    contents.clear();
+}
+
+#else
+
+bool SnapshotFile::write(const std::string& filePath, uint64_t createdRoomCount, const std::vector<SharedBuffer>& records,
+                         std::string& error) {
+    std::string temporary = filePath + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        std::string header(MAGIC, 8);
+        store<uint64_t>(header, records.size());
+        store<uint64_t>(header, createdRoomCount);
+        file << header;
+        for (const auto& record : records) {
+            std::string length;
+            store<uint32_t>(length, static_cast<uint32_t>(record->size()));
+            file << length << *record;
+        }
+        if (!file.flush()) {
+            error = "cannot write " + temporary;
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, filePath, ec);
+    if (ec) {
+        error = "cannot rename " + temporary + " to " + filePath + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotFile::open(const std::string& filePath, std::string& error) {
+    close();
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + filePath;
+        return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (contents.size() < HEADER_SIZE || std::memcmp(contents.data(), MAGIC, 8) != 0) {
+        error = filePath + " is not a room snapshot";
+        close();
+        return false;
+    }
+    data = contents.data();
+    size = contents.size();
+    roomCount = load<uint64_t>(data + 8);
+    createdRooms = load<uint64_t>(data + 16);
+    return true;
+}
+
+void SnapshotFile::close() {
+    data = nullptr;
+    size = 0;
+    contents.clear();
+}
+
+#endif
+
+uint64_t SnapshotFile::getRoomCount() const {
+    return roomCount;
+}
+
+uint64_t SnapshotFile::getCreatedRoomCount() const {
+    return createdRooms;
+}
+
+size_t SnapshotFile::getSize() const {
+    return size;
+}
+
+bool SnapshotFile::forEach(const std::function<void(std::string_view)>& fn) const {
+    if (!data) {
+        return false;
+    }
+    size_t offset = HEADER_SIZE;
+    for (uint64_t i = 0; i < roomCount; i++) {
+        if (size - offset < sizeof(uint32_t)) {
+            return false;
+        }
+        auto length = load<uint32_t>(data + offset);
+        offset += sizeof(uint32_t);
+        if (length > size - offset) {
+            return false;
+        }
+        fn(std::string_view(data + offset, length));
+        offset += length;
+    }
+    return true;
+}
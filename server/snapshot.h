@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "client_session.h"
+
+// Every live room at one moment, in one file:
+//   "CGSNAP01", u64 room count, u64 rooms created so far (so restored
+//   servers don't hand out a live room's id again), then per room a u32
+//   length and the room's record (GameRoom::appendSnapshot)
+// A snapshot is written to a temporary file, synced and renamed over the
+// old one, so a crash part way through leaves the last complete snapshot.
+// Reading maps the file and hands out records in place; nothing is copied
+// before the rooms themselves are rebuilt.
+class SnapshotFile {
+public:
+    static const size_t HEADER_SIZE = 24;
+    static constexpr char MAGIC[9] = "CGSNAP01";
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    // Holds the file on platforms without mmap
+    std::string contents;
+    uint64_t roomCount = 0;
+    uint64_t createdRooms = 0;
+
+public:
+    SnapshotFile() = default;
+    ~SnapshotFile();
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    static bool write(const std::string& filePath, uint64_t createdRoomCount, const std::vector<SharedBuffer>& records,
+                      std::string& error);
+
+    // False if the file can't be read or isn't a snapshot
+    bool open(const std::string& filePath, std::string& error);
+    void close();
+
+    uint64_t getRoomCount() const;
+    uint64_t getCreatedRoomCount() const;
+    size_t getSize() const;
+
+    // Calls fn with every room record, which stays valid until close();
+    // false if the file ends part way through one
+    bool forEach(const std::function<void(std::string_view)>& fn) const;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,156 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Hierarchical timing wheel. Time is counted in ticks; LEVELS wheels of
+// SLOTS slots each cover SLOTS, SLOTS^2, ... ticks ahead. A timer sits in the
+// coarsest slot that still separates it from "now" and moves down one level
+// each time its slot comes round, so scheduling and cancelling are O(1) and
+// advancing costs O(1) amortized per timer. Deadlines beyond the last level
+// are parked there and re-placed when they come round.
+//
+// Timers are intrusive and owned by the caller. Not thread-safe: one thread
+// owns the wheel (see Scheduler).
+class TimingWheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const size_t SLOTS = size_t(1) << SLOT_BITS;
+
+    struct Timer {
+        Timer* prev = nullptr;
+        Timer* next = nullptr;
+        uint64_t expiry = 0; // tick
+
+        bool isScheduled() const { return next != nullptr; }
+    };
+
+private:
+    // Circular lists with sentinel heads; an empty slot points at itself
+    Timer slots[LEVELS][SLOTS];
+    Timer overdue;
+    uint64_t now;
+    size_t count;
+
+    static void initList(Timer& head) {
+        head.prev = head.next = &head;
+    }
+
+    static void link(Timer& head, Timer* timer) {
+        timer->prev = head.prev;
+        timer->next = &head;
+        head.prev->next = timer;
+        head.prev = timer;
+    }
+
+    static void unlink(Timer* timer) {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        timer->prev = timer->next = nullptr;
+    }
+
+    void place(Timer* timer) {
+        if (timer->expiry <= now) {
+            link(overdue, timer);
+            return;
+        }
+        uint64_t delta = timer->expiry - now;
+        for (int level = 0; level < LEVELS; level++) {
+            int shift = level * SLOT_BITS;
+            if (delta < (uint64_t(SLOTS) << shift) || level == LEVELS - 1) {
+                uint64_t at = timer->expiry;
+                if (level == LEVELS - 1 && delta >= (uint64_t(SLOTS) << shift)) {
+                    // Past the horizon: park in the farthest slot and retry then
+                    at = now + (uint64_t(SLOTS - 1) << shift);
+                }
+                link(slots[level][(at >> shift) & (SLOTS - 1)], timer);
+                return;
+            }
+        }
+    }
+
+    // Moves every timer in one slot down to where it now belongs
+    void cascade(int level) {
+        Timer& head = slots[level][(now >> (level * SLOT_BITS)) & (SLOTS - 1)];
+        while (head.next != &head) {
+            Timer* timer = head.next;
+            unlink(timer);
+            place(timer);
+        }
+    }
+
+    template <typename Fn>
+    void fireList(Timer& head, Fn& onExpired) {
+        while (head.next != &head) {
+            Timer* timer = head.next;
+            unlink(timer);
+            count--;
+            onExpired(timer);
+        }
+    }
+
+public:
+    explicit TimingWheel(uint64_t startTick = 0) : now(startTick), count(0) {
+        for (auto& level : slots) {
+            for (auto& slot : level) {
+                initList(slot);
+            }
+        }
+        initList(overdue);
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    uint64_t getNow() const { return now; }
+    size_t size() const { return count; }
+
+    // Fires at the first advance() that reaches expiry; an expiry that has
+    // already passed fires on the next advance()
+    void schedule(Timer* timer, uint64_t expiry) {
+        timer->expiry = expiry;
+        place(timer);
+        count++;
+    }
+
+    void cancel(Timer* timer) {
+        if (timer->isScheduled()) {
+            unlink(timer);
+            count--;
+        }
+    }
+
+    // Unschedules every timer without firing it, calling onRemoved(Timer*)
+    // for each so the owner can release them
+    template <typename Fn>
+    void clear(Fn&& onRemoved) {
+        fireList(overdue, onRemoved);
+        for (auto& level : slots) {
+            for (auto& slot : level) {
+                fireList(slot, onRemoved);
+            }
+        }
+    }
+
+    // Moves time forward to tick, calling onExpired(Timer*) for each timer
+    // that comes due. The timer is unscheduled before the call, so the
+    // callback may schedule it again.
+    template <typename Fn>
+    void advance(uint64_t tick, Fn&& onExpired) {
+        fireList(overdue, onExpired);
+        while (now < tick) {
+            now++;
+            // Each time a level wraps, the next level's current slot drops down
+            for (int level = 1; level < LEVELS; level++) {
+                if (((now >> ((level - 1) * SLOT_BITS)) & (SLOTS - 1)) != 0) break;
+                cascade(level);
+            }
+            fireList(slots[0][now & (SLOTS - 1)], onExpired);
+            fireList(overdue, onExpired);
+        }
+    }
+};
+
+#endif // TIMING_WHEEL_H
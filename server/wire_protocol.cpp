@@ -0,0 +1,367 @@
+#include "wire_protocol.h"
+#include "binary_codec.h"
+#include <cstdio>
+
+namespace {
+
+const char* replyTypeName(ReplyType type) {
+    switch (type) {
+        case ReplyType::ROOM_CREATED: return "ROOM_CREATED";
+        case ReplyType::JOIN_RESULT: return "JOIN_RESULT";
+        case ReplyType::GAME_STARTED: return "GAME_STARTED";
+        case ReplyType::CARD_PLAYED: return "CARD_PLAYED";
+        case ReplyType::GAME_STATE: return "GAME_STATE";
+        case ReplyType::SUBSCRIBED: return "SUBSCRIBED";
+        case ReplyType::STATE_UPDATE: return "STATE_UPDATE";
+        case ReplyType::SPECTATING: return "SPECTATING";
+        case ReplyType::STATS: return "STATS";
+        case ReplyType::HINT: return "HINT";
+        case ReplyType::MATCHED: return "MATCHED";
+        case ReplyType::ROOM_LIST: return "ROOM_LIST";
+        case ReplyType::ERROR: return "ERROR";
+    }
+    return "ERROR";
+}
+
+const char* errorMessage(ErrorCode error) {
+    switch (error) {
+        case ErrorCode::UNKNOWN_COMMAND: return "Unknown command";
+        case ErrorCode::INVALID_ARGUMENTS: return "Invalid arguments";
+        case ErrorCode::ROOM_NOT_FOUND: return "Room not found";
+        case ErrorCode::COMMAND_TOO_LONG: return "Command too long";
+    }
+    return "Unknown error";
+}
+
+void encodeTextError(ErrorCode error, std::string& out) {
+    if (error == ErrorCode::ROOM_NOT_FOUND) {
+        // GET_STATE has always answered a missing room this way
+        out += "{\"error\":\"Room not found\"}\n";
+        return;
+    }
+    out += "{\"type\":\"ERROR\",\"message\":\"";
+    out += errorMessage(error);
+    out += "\"}\n";
+}
+
+void encodeText(const Reply& reply, std::string& out) {
+    switch (reply.type) {
+        case ReplyType::ROOM_CREATED:
+            out += "{\"type\":\"ROOM_CREATED\",\"roomId\":\"";
+            out += reply.roomId;
+            out += "\",\"seed\":";
+            out += std::to_string(reply.seed);
+            out += "}\n";
+            return;
+        case ReplyType::JOIN_RESULT:
+        case ReplyType::GAME_STARTED:
+        case ReplyType::CARD_PLAYED:
+        case ReplyType::SUBSCRIBED:
+        case ReplyType::SPECTATING:
+            out += "{\"type\":\"";
+            out += replyTypeName(reply.type);
+            out += reply.success ? "\",\"success\":true}\n" : "\",\"success\":false}\n";
+            return;
+        case ReplyType::GAME_STATE:
+            reply.room->appendGameState(out);
+            out += '\n';
+            return;
+        case ReplyType::STATE_UPDATE:
+            out += "{\"type\":\"STATE_UPDATE\",\"version\":";
+            out += std::to_string(reply.room->getVersion());
+            out += ",\"state\":";
+            {
+                // Reuses the cached GET_STATE reply, minus its newline
+                SharedBuffer state = reply.room->getStateReply(WireFormat::TEXT);
+                out.append(*state, 0, state->size() - 1);
+            }
+            out += "}\n";
+            return;
+        case ReplyType::STATS:
+            out += "{\"type\":\"STATS\",\"liveRooms\":";
+            out += std::to_string(reply.stats.liveRooms);
+            out += ",\"createdRooms\":";
+            out += std::to_string(reply.stats.createdRooms);
+            out += ",\"evictedRooms\":";
+            out += std::to_string(reply.stats.evictedRooms);
+            out += ",\"timedOutTurns\":";
+            out += std::to_string(reply.stats.timedOutTurns);
+            out += ",\"timersFired\":";
+            out += std::to_string(reply.stats.timersFired);
+            out += ",\"timerLagAvgUs\":";
+            out += std::to_string(reply.stats.timerLagAvgUs);
+            out += ",\"timerLagMaxUs\":";
+            out += std::to_string(reply.stats.timerLagMaxUs);
+            out += ",\"poolSlabs\":";
+            out += std::to_string(reply.stats.poolSlabs);
+            out += ",\"poolBlocksInUse\":";
+            out += std::to_string(reply.stats.poolBlocksInUse);
+            out += ",\"poolBlocksFree\":";
+            out += std::to_string(reply.stats.poolBlocksFree);
+            out += "}\n";
+            return;
+        case ReplyType::HINT:
+            if (!reply.success) {
+                out += "{\"type\":\"HINT\",\"success\":false}\n";
+                return;
+            }
+            out += "{\"type\":\"HINT\",\"success\":true,\"cardIndex\":";
+            out += std::to_string(reply.hint.cardIndex);
+            out += ",\"expectedScore\":";
+            {
+                char score[16];
+                std::snprintf(score, sizeof(score), "%.3f", reply.hint.expectedScore);
+                out += score;
+            }
+            out += ",\"exact\":";
+            out += reply.hint.exact ? "true" : "false";
+            out += "}\n";
+            return;
+        case ReplyType::MATCHED:
+            if (!reply.success) {
+                out += "{\"type\":\"MATCHED\",\"success\":false}\n";
+                return;
+            }
+            out += "{\"type\":\"MATCHED\",\"success\":true,\"roomId\":\"";
+            out += reply.roomId;
+            out += "\"}\n";
+            return;
+        case ReplyType::ROOM_LIST:
+            out += "{\"type\":\"ROOM_LIST\",\"total\":";
+            out += std::to_string(reply.lobby->size());
+            out += ",\"offset\":";
+            out += std::to_string(reply.offset);
+            out += ",\"rooms\":[";
+            for (size_t i = reply.offset; i < reply.offset + reply.count; i++) {
+                const Lobby::Listing& listing = (*reply.lobby)[i];
+                out += i == reply.offset ? "{\"roomId\":\"" : ",{\"roomId\":\"";
+                out += listing.roomId;
+                out += "\",\"players\":";
+                out += std::to_string(listing.players);
+                out += ",\"maxPlayers\":";
+                out += std::to_string(listing.maxPlayers);
+                out += '}';
+            }
+            out += "]}\n";
+            return;
+        case ReplyType::ERROR:
+            encodeTextError(reply.error, out);
+            return;
+    }
+}
+
+// Writes the header with a zero length and returns where the length goes
+size_t beginBinaryFrame(uint8_t opcode, std::string& out) {
+    size_t start = out.size();
+    out.push_back(static_cast<char>(opcode));
+    out.push_back(0);
+    out.push_back(0);
+    return start;
+}
+
+void endBinaryFrame(size_t start, std::string& out) {
+    size_t length = out.size() - start - BINARY_HEADER_SIZE;
+    out[start + 1] = static_cast<char>(length & 0xFF);
+    out[start + 2] = static_cast<char>((length >> 8) & 0xFF);
+}
+
+void encodeBinary(const Reply& reply, std::string& out) {
+    size_t start = beginBinaryFrame(static_cast<uint8_t>(reply.type), out);
+    switch (reply.type) {
+        case ReplyType::ROOM_CREATED:
+            appendBinaryString(out, reply.roomId);
+            appendVarint(out, reply.seed);
+            break;
+        case ReplyType::JOIN_RESULT:
+        case ReplyType::GAME_STARTED:
+        case ReplyType::CARD_PLAYED:
+        case ReplyType::SUBSCRIBED:
+        case ReplyType::SPECTATING:
+            out.push_back(reply.success ? 1 : 0);
+            break;
+        case ReplyType::GAME_STATE:
+            reply.room->appendBinaryState(out);
+            break;
+        case ReplyType::STATE_UPDATE:
+            appendVarint(out, reply.room->getVersion());
+            reply.room->appendBinaryState(out);
+            break;
+        case ReplyType::STATS:
+            appendVarint(out, reply.stats.liveRooms);
+            appendVarint(out, reply.stats.createdRooms);
+            appendVarint(out, reply.stats.evictedRooms);
+            appendVarint(out, reply.stats.timedOutTurns);
+            appendVarint(out, reply.stats.timersFired);
+            appendVarint(out, reply.stats.timerLagAvgUs);
+            appendVarint(out, reply.stats.timerLagMaxUs);
+            appendVarint(out, reply.stats.poolSlabs);
+            appendVarint(out, reply.stats.poolBlocksInUse);
+            appendVarint(out, reply.stats.poolBlocksFree);
+            break;
+        case ReplyType::HINT:
+            out.push_back(reply.success ? 1 : 0);
+            if (reply.success) {
+                appendVarint(out, static_cast<uint32_t>(reply.hint.cardIndex));
+                appendVarint(out, static_cast<uint32_t>(reply.hint.expectedScore * 1000 + 0.5));
+                out.push_back(reply.hint.exact ? 1 : 0);
+            }
+            break;
+        case ReplyType::MATCHED:
+            out.push_back(reply.success ? 1 : 0);
+            if (reply.success) {
+                appendBinaryString(out, reply.roomId);
+            }
+            break;
+        case ReplyType::ROOM_LIST:
+            appendVarint(out, reply.lobby->size());
+            appendVarint(out, reply.offset);
+            appendVarint(out, reply.count);
+            for (size_t i = reply.offset; i < reply.offset + reply.count; i++) {
+                const Lobby::Listing& listing = (*reply.lobby)[i];
+                appendBinaryString(out, listing.roomId);
+                appendVarint(out, static_cast<uint32_t>(listing.players));
+                appendVarint(out, static_cast<uint32_t>(listing.maxPlayers));
+            }
+            break;
+        case ReplyType::ERROR:
+            out.push_back(static_cast<char>(reply.error));
+            break;
+    }
+    endBinaryFrame(start, out);
+}
+
+} // namespace
+
+FrameStatus nextFrame(const RingBuffer& input, WireFormat format, std::string& scratch,
+                      std::string_view& frame, size_t& consumed) {
+    if (format == WireFormat::TEXT) {
+        size_t lineEnd = input.find('\n');
+        if (lineEnd == RingBuffer::npos) {
+            return input.full() ? FrameStatus::OVERSIZED : FrameStatus::INCOMPLETE;
+        }
+        frame = input.view(lineEnd, scratch);
+        if (!frame.empty() && frame.back() == '\r') {
+            frame.remove_suffix(1);
+        }
+        consumed = lineEnd + 1;
+        return FrameStatus::READY;
+    }
+
+    if (input.size() < BINARY_HEADER_SIZE) {
+        return FrameStatus::INCOMPLETE;
+    }
+    size_t total = BINARY_HEADER_SIZE + (input.at(1) | (input.at(2) << 8));
+    if (total > input.capacity()) {
+        return FrameStatus::OVERSIZED;
+    }
+    if (input.size() < total) {
+        return FrameStatus::INCOMPLETE;
+    }
+    frame = input.view(total, scratch);
+    consumed = total;
+    return FrameStatus::READY;
+}
+
+ParseStatus parseBinaryCommand(std::string_view frame, Command& command) {
+    command = Command();
+    uint8_t opcode = static_cast<uint8_t>(frame[0]);
+    if (opcode == 0 || opcode > COMMAND_TYPE_COUNT) {
+        return ParseStatus::UNKNOWN_COMMAND;
+    }
+    command.type = static_cast<CommandType>(opcode - 1);
+
+    BinaryReader reader(frame.substr(BINARY_HEADER_SIZE));
+    switch (command.type) {
+        case CommandType::CREATE_ROOM:
+            // [seed varint][personality string], both optional
+            if (!reader.atEnd()) {
+                command.seed = reader.readVarint64();
+                command.seeded = true;
+                if (command.seed > GameRandom::SEED_MASK) {
+                    return ParseStatus::INVALID_ARGUMENTS;
+                }
+            }
+            if (!reader.atEnd()) {
+                command.personality = reader.readString();
+            }
+            break;
+        case CommandType::STATS:
+            break;
+        case CommandType::JOIN_ROOM:
+            command.roomId = reader.readString();
+            command.playerId = reader.readString();
+            command.playerName = reader.readString();
+            if (command.playerId.empty() || command.playerName.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            break;
+        case CommandType::START_GAME:
+        case CommandType::GET_STATE:
+        case CommandType::SUBSCRIBE:
+        case CommandType::SPECTATE:
+            command.roomId = reader.readString();
+            break;
+        case CommandType::HINT:
+            command.roomId = reader.readString();
+            command.playerId = reader.readString();
+            if (command.playerId.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            break;
+        case CommandType::QUICK_MATCH:
+            command.playerId = reader.readString();
+            command.playerName = reader.readString();
+            if (command.playerId.empty() || command.playerName.empty()) {
+                return ParseStatus::INVALID_ARGUMENTS;
+            }
+            break;
+        case CommandType::LIST_ROOMS:
+            // [offset varint][limit varint], both optional
+            if (!reader.atEnd()) {
+                command.offset = reader.readVarint();
+            }
+            if (!reader.atEnd()) {
+                command.limit = reader.readVarint();
+            }
+            break;
+        case CommandType::PLAY_CARD:
+            command.roomId = reader.readString();
+            command.playerId = reader.readString();
+            command.cardIndex = static_cast<int>(reader.readVarint());
+            break;
+        case CommandType::UNKNOWN:
+            return ParseStatus::UNKNOWN_COMMAND;
+    }
+
+    if (!reader.ok() || !reader.atEnd()) {
+        return ParseStatus::INVALID_ARGUMENTS;
+    }
+    bool needsRoom = command.type != CommandType::CREATE_ROOM && command.type != CommandType::STATS &&
+                     command.type != CommandType::QUICK_MATCH && command.type != CommandType::LIST_ROOMS;
+    if (needsRoom && command.roomId.empty()) {
+        return ParseStatus::INVALID_ARGUMENTS;
+    }
+    return ParseStatus::OK;
+}
+
+void encodeReply(const Reply& reply, WireFormat format, std::string& out) {
+    if (format == WireFormat::TEXT) {
+        encodeText(reply, out);
+    } else {
+        encodeBinary(reply, out);
+    }
+}
+
+void encodeStateUpdate(const GameRoom& room, WireFormat format, std::string& out) {
+    Reply reply;
+    reply.type = ReplyType::STATE_UPDATE;
+    reply.room = room.shared_from_this();
+    encodeReply(reply, format, out);
+}
+
+void encodeError(ErrorCode error, WireFormat format, std::string& out) {
+    Reply reply;
+    reply.type = ReplyType::ERROR;
+    reply.error = error;
+    encodeReply(reply, format, out);
+}
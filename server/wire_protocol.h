@@ -0,0 +1,117 @@
+#ifndef WIRE_PROTOCOL_H
+#define WIRE_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "card_game.h"
+#include "ai_search.h"
+#include "client_session.h"
+#include "command_parser.h"
+#include "ring_buffer.h"
+
+// The server speaks two protocols on the same port. Connections start in
+// TEXT mode (newline-delimited commands, JSON replies). A client that sends
+// BINARY_HANDSHAKE as its very first byte switches the connection to the
+// binary protocol; the server acknowledges with BINARY_HANDSHAKE followed by
+// BINARY_PROTOCOL_VERSION.
+//
+// Binary frames have a fixed three byte header, [opcode][payload length as
+// u16 little-endian], followed by the payload. Integers in payloads are
+// LEB128 varints, strings are varint-length-prefixed and cards are one byte
+// each (Card::toByte). Request opcodes are CommandType + 1; replies use the
+// ReplyType opcodes below.
+const uint8_t BINARY_HANDSHAKE = 0xB1;
+const uint8_t BINARY_PROTOCOL_VERSION = 1;
+const size_t BINARY_HEADER_SIZE = 3;
+
+enum class ReplyType : uint8_t {
+    ROOM_CREATED = 0x81,
+    JOIN_RESULT = 0x82,
+    GAME_STARTED = 0x83,
+    CARD_PLAYED = 0x84,
+    GAME_STATE = 0x85,
+    SUBSCRIBED = 0x86,
+    // Pushed to subscribers, never a reply: [version varint][state]
+    STATE_UPDATE = 0x87,
+    SPECTATING = 0x88,
+    STATS = 0x89,
+    HINT = 0x8A,
+    MATCHED = 0x8B,
+    ROOM_LIST = 0x8C,
+    ERROR = 0xFF
+};
+
+enum class ErrorCode : uint8_t {
+    UNKNOWN_COMMAND = 1,
+    INVALID_ARGUMENTS = 2,
+    ROOM_NOT_FOUND = 3,
+    COMMAND_TOO_LONG = 4
+};
+
+// Counters reported by STATS
+struct ServerStats {
+    uint64_t liveRooms = 0;
+    uint64_t createdRooms = 0;
+    uint64_t evictedRooms = 0;
+    uint64_t timedOutTurns = 0;
+    uint64_t timersFired = 0;
+    uint64_t timerLagAvgUs = 0; // scheduled vs fired
+    uint64_t timerLagMaxUs = 0;
+    // Slab pool rooms are allocated from
+    uint64_t poolSlabs = 0;
+    uint64_t poolBlocksInUse = 0;
+    uint64_t poolBlocksFree = 0;
+};
+
+// Outcome of one command, independent of the wire format it is sent in
+struct Reply {
+    ReplyType type = ReplyType::ERROR;
+    bool success = false;
+    ErrorCode error = ErrorCode::UNKNOWN_COMMAND;
+    std::string roomId;
+    uint64_t seed = 0;
+    std::shared_ptr<const GameRoom> room;
+    ServerStats stats;
+    AiChoice hint;
+    // ROOM_LIST: rooms [offset, offset + count) of the lobby snapshot
+    Lobby::Snapshot lobby;
+    size_t offset = 0;
+    size_t count = 0;
+};
+
+// Rooms per LIST_ROOMS page when the client doesn't say, and at most
+const uint32_t DEFAULT_ROOM_LIST_LIMIT = 20;
+const uint32_t MAX_ROOM_LIST_LIMIT = 100;
+
+// Encodes the room's current state as a STATE_UPDATE push message
+void encodeStateUpdate(const GameRoom& room, WireFormat format, std::string& out);
+
+// Receives a command's encoded reply. Called exactly once per command, on
+// whichever thread finished it (often a room worker).
+using ReplySink = std::function<void(SharedBuffer)>;
+
+enum class FrameStatus : uint8_t {
+    INCOMPLETE,
+    READY,
+    OVERSIZED
+};
+
+// Finds the next complete frame at the front of input. On READY, frame views
+// the command (a text line without its terminator, or a whole binary frame
+// including the header) and consumed is the number of bytes to drop once the
+// frame has been handled.
+FrameStatus nextFrame(const RingBuffer& input, WireFormat format, std::string& scratch,
+                      std::string_view& frame, size_t& consumed);
+
+// Decodes one binary frame into the same Command the text parser produces
+ParseStatus parseBinaryCommand(std::string_view frame, Command& command);
+
+void encodeReply(const Reply& reply, WireFormat format, std::string& out);
+void encodeError(ErrorCode error, WireFormat format, std::string& out);
+
+#endif // WIRE_PROTOCOL_H